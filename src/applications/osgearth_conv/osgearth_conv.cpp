@@ -28,9 +28,17 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ElevationLayer>
+#include <osgEarth/ThreadingUtils>
 #include <osg/ArgumentParser>
 #include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Condition>
+#include <OpenThreads/Atomic>
 #include <iomanip>
+#include <fstream>
+#include <deque>
+#include <vector>
+#include <set>
 #include <algorithm>
 #include <iterator>
 
@@ -49,6 +57,9 @@ int usage(char** argv)
         << "\n    --min-level [int]                   : minimum level of detail"
         << "\n    --max-level [int]                   : maximum level of detail"
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
+        << "\n    --threads [n]                       : number of reader threads (default = 1)"
+        << "\n    --queue-size [n]                    : max tiles waiting to be written (default = 64)"
+        << "\n    --checkpoint [file]                 : record written tiles in a file, and skip them when resuming"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
         << std::endl;
 
@@ -56,28 +67,211 @@ int usage(char** argv)
 }
 
 
-// TileHandler that copies images from an ImageLayer to a TileSource.
+/**
+ * Single thread that stores tiles in the output TileSource. Reader threads
+ * push tiles onto a bounded queue and block when it is full, so memory use
+ * stays flat no matter how far the readers get ahead of the output. Most
+ * write-capable TileSources (MBTiles for example) are not safe to write from
+ * more than one thread, so all writes funnel through here.
+ *
+ * If a checkpoint file is set, the key of each stored tile is appended to it
+ * so that an interrupted run can pick up where it left off. Drivers that
+ * batch their writes (MBTiles with batch_size) hold stored tiles in an open
+ * transaction, so keys are only recorded after flushing the output; a key in
+ * the checkpoint always refers to a tile that is on disk.
+ */
+class TileWriter : public OpenThreads::Thread
+{
+public:
+    struct Entry
+    {
+        TileKey                          _key;
+        osg::ref_ptr<osg::Image>         _image;
+        osg::ref_ptr<osg::HeightField>   _hf;
+    };
+
+    TileWriter(TileSource* dest, unsigned maxQueueSize) :
+        _dest(dest),
+        _maxQueueSize(osg::maximum(maxQueueSize, 1u)),
+        _done(false),
+        _checkpointInterval(1u),
+        _numWritten(0u),
+        _numFailed(0u)
+    {
+        //nop
+    }
+
+    //! Loads the keys of previously written tiles and opens the checkpoint for appending.
+    //! Stored keys are flushed and recorded every "interval" tiles.
+    bool setCheckpoint(const std::string& filename, unsigned interval)
+    {
+        _checkpointInterval = osg::maximum(interval, 1u);
+
+        std::ifstream in(filename.c_str());
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty())
+                _written.insert(line);
+        }
+        in.close();
+
+        _checkpoint.open(filename.c_str(), std::ios::out | std::ios::app);
+        return _checkpoint.is_open();
+    }
+
+    //! Number of tiles recorded in the checkpoint by a previous run
+    unsigned getNumResumed() const { return _written.size(); }
+
+    //! Whether a previous run already stored this tile
+    bool isWritten(const TileKey& key) const
+    {
+        // _written is only modified before the writer starts, so no lock needed.
+        return _written.find(key.str()) != _written.end();
+    }
+
+    //! Queues a tile for writing, blocking while the queue is full.
+    void push(const Entry& entry)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+        while (_queue.size() >= _maxQueueSize)
+            _notFull.wait(&_mutex);
+        _queue.push_back(entry);
+        _notEmpty.signal();
+    }
+
+    //! Number of tiles waiting to be written
+    unsigned getQueueSize() const
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+        return _queue.size();
+    }
+
+    unsigned getNumWritten() const { return _numWritten; }
+    unsigned getNumFailed() const { return _numFailed; }
+
+    //! Writes whatever is still queued and then stops the thread.
+    void finish()
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _done = true;
+            _notEmpty.broadcast();
+        }
+        join();
+        _checkpoint.close();
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            Entry entry;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                while (_queue.empty() && !_done)
+                    _notEmpty.wait(&_mutex);
+
+                if (_queue.empty())
+                    break;
+
+                entry = _queue.front();
+                _queue.pop_front();
+                _notFull.signal();
+            }
+
+            bool ok =
+                entry._image.valid() ? _dest->storeImage(entry._key, entry._image.get(), 0L) :
+                entry._hf.valid()    ? _dest->storeHeightField(entry._key, entry._hf.get(), 0L) :
+                false;
+
+            if (ok)
+            {
+                ++_numWritten;
+                if (_checkpoint.is_open())
+                {
+                    _pending.push_back(entry._key.str());
+                    if (_pending.size() >= _checkpointInterval)
+                        writeCheckpoint();
+                }
+            }
+            else
+            {
+                ++_numFailed;
+
+                // a failed write may have rolled back the whole batch, so
+                // don't vouch for anything else stored since the last flush.
+                _pending.clear();
+            }
+        }
+
+        writeCheckpoint();
+    }
+
+private:
+    //! Flushes the output and records the keys stored since the last flush.
+    void writeCheckpoint()
+    {
+        if (_pending.empty())
+            return;
+
+        if (_dest->flush())
+        {
+            for (std::vector<std::string>::const_iterator i = _pending.begin(); i != _pending.end(); ++i)
+                _checkpoint << *i << std::endl;
+            _checkpoint.flush();
+        }
+        else
+        {
+            OE_WARN << LC << "Failed to flush output; " << _pending.size() << " tiles will be written again on resume" << std::endl;
+        }
+        _pending.clear();
+    }
+
+    TileSource*                 _dest;
+    unsigned                    _maxQueueSize;
+    std::deque<Entry>           _queue;
+    mutable OpenThreads::Mutex  _mutex;
+    OpenThreads::Condition      _notFull;
+    OpenThreads::Condition      _notEmpty;
+    bool                        _done;
+    std::set<std::string>       _written;
+    std::ofstream               _checkpoint;
+    unsigned                    _checkpointInterval;
+    std::vector<std::string>    _pending;
+    OpenThreads::Atomic         _numWritten;
+    OpenThreads::Atomic         _numFailed;
+};
+
+
+// TileHandler that reads images from an ImageLayer and hands them to a TileWriter.
 // This will automatically handle any mosaicing and reprojection that is
 // necessary to translate from one Profile/SRS to another.
 struct ImageLayerToTileSource : public TileHandler
 {
-    ImageLayerToTileSource(ImageLayer* source, TileSource* dest)
-        : _source(source), _dest(dest)
+    ImageLayerToTileSource(ImageLayer* source, TileWriter* writer)
+        : _source(source), _writer(writer)
     {
         //nop
     }
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
+        // written by a previous run; keep going so we visit the children.
+        if (_writer->isWritten(key))
+            return true;
+
         GeoImage image = _source->createImage(key);
         if (image.valid())
         {
-            //OE_INFO << "Read " << key.str() << ", image size = " << image.getImage()->s() << std::endl;
-            ok = _dest->storeImage(key, image.getImage(), 0L);
+            TileWriter::Entry entry;
+            entry._key = key;
+            entry._image = image.getImage();
+            _writer->push(entry);
+            return true;
         }
 
-        return ok;
+        return false;
     }
 
     bool hasData(const TileKey& key) const
@@ -86,28 +280,37 @@ struct ImageLayerToTileSource : public TileHandler
     }
 
     osg::ref_ptr<ImageLayer> _source;
-    TileSource*              _dest;
+    TileWriter*              _writer;
 };
 
 
-// TileHandler that copies images from an ElevationLayer to a TileSource.
+// TileHandler that reads heightfields from an ElevationLayer and hands them to a TileWriter.
 // This will automatically handle any mosaicing and reprojection that is
 // necessary to translate from one Profile/SRS to another.
 struct ElevationLayerToTileSource : public TileHandler
 {
-    ElevationLayerToTileSource(ElevationLayer* source, TileSource* dest)
-        : _source(source), _dest(dest)
+    ElevationLayerToTileSource(ElevationLayer* source, TileWriter* writer)
+        : _source(source), _writer(writer)
     {
         //nop
     }
 
     bool handleTile(const TileKey& key, const TileVisitor& tv)
     {
-        bool ok = false;
+        if (_writer->isWritten(key))
+            return true;
+
         GeoHeightField hf = _source->createHeightField(key, 0L);
         if ( hf.valid() )
-            ok = _dest->storeHeightField(key, hf.getHeightField(), 0L);
-        return ok;
+        {
+            TileWriter::Entry entry;
+            entry._key = key;
+            entry._hf = hf.getHeightField();
+            _writer->push(entry);
+            return true;
+        }
+
+        return false;
     }
 
     bool hasData(const TileKey& key) const
@@ -116,14 +319,14 @@ struct ElevationLayerToTileSource : public TileHandler
     }
 
     osg::ref_ptr<ElevationLayer> _source;
-    TileSource*                  _dest;
+    TileWriter*                  _writer;
 };
 
 
 // Custom progress reporter
 struct ProgressReporter : public osgEarth::ProgressCallback
 {
-    ProgressReporter() : _first(true) { }
+    ProgressReporter(TileWriter* writer) : _writer(writer), _first(true) { }
 
     bool reportProgress(double             current,
                         double             total,
@@ -152,13 +355,17 @@ struct ProgressReporter : public osgEarth::ProgressCallback
         double minsTotal = projectedTotalTime/60.0;
         double secsTotal = fmod(projectedTotalTime,60.0);
 
+        double tilesPerSec = timeSoFar > 0.0 ? (double)_writer->getNumWritten() / timeSoFar : 0.0;
+
         std::cout
             << std::fixed
             << std::setprecision(1) << "\r"
             << (int)current << "/" << (int)total
             << " (" << (100.0f*percentage) << "%, " 
             << (int)minsTotal << "m" << (int)secsTotal << "s projected, "
-            << (int)minsToGo << "m" << (int)secsToGo << "s remaining)        "
+            << (int)minsToGo << "m" << (int)secsToGo << "s remaining, "
+            << tilesPerSec << " tiles/s, "
+            << _writer->getQueueSize() << " queued)        "
             << std::flush;
 
         if ( percentage >= 100.0f )
@@ -169,6 +376,7 @@ struct ProgressReporter : public osgEarth::ProgressCallback
         return false;
     }
 
+    TileWriter* _writer;
     Threading::Mutex _mutex;
     bool _first;
     osg::Timer_t _start;
@@ -199,7 +407,13 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --profile [profile]   : reproject to the target profile, e.g. "wgs84"
  *      --min-level [int]     : min level of detail to copy
  *      --max-level [int]     : max level of detail to copy
- *      --threads [n]         : threads to use (may crash. Careful.)
+ *      --threads [n]         : number of threads reading from the input
+ *      --queue-size [n]      : max tiles waiting to be written (default = 64)
+ *      --checkpoint [file]   : record each written tile in [file]; if the file
+ *                              exists, skip the tiles it lists (resume)
+ *
+ * Tiles are read on one or more threads and written by a single writer
+ * thread, so output drivers never see concurrent writes.
  *
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *
@@ -329,6 +543,26 @@ main(int argc, char** argv)
         << outConf.toJSON(true)
         << std::endl;
 
+    // the single thread that stores tiles in the output:
+    unsigned queueSize = 64u;
+    args.read("--queue-size", queueSize);
+    TileWriter writer(output.get(), queueSize);
+
+    std::string checkpoint;
+    if (args.read("--checkpoint", checkpoint))
+    {
+        // record keys once per output batch, since that's when they are committed.
+        if (!writer.setCheckpoint(checkpoint, outConf.value<unsigned>("batch_size", 1u)))
+        {
+            OE_WARN << LC << "Failed to open checkpoint file " << checkpoint << std::endl;
+            return -1;
+        }
+        if (writer.getNumResumed() > 0)
+        {
+            OE_NOTICE << LC << "Resuming; skipping " << writer.getNumResumed() << " tiles already written" << std::endl;
+        }
+    }
+
     // create the visitor.
     osg::ref_ptr<TileVisitor> visitor;
 
@@ -358,7 +592,7 @@ main(int argc, char** argv)
             OE_WARN << LC << "Input profile is not valid" << std::endl;
             return -1;
         }
-        visitor->setTileHandler( new ElevationLayerToTileSource(layer, output.get()) );
+        visitor->setTileHandler( new ElevationLayerToTileSource(layer, &writer) );
     }
 
     else // image layers
@@ -375,7 +609,7 @@ main(int argc, char** argv)
             OE_WARN << LC << "Input profile is not valid" << std::endl;
             return -1;
         }
-        visitor->setTileHandler( new ImageLayerToTileSource(layer, output.get()) );
+        visitor->setTileHandler( new ImageLayerToTileSource(layer, &writer) );
     }
 
     // set the manula extents, if specified:
@@ -429,20 +663,30 @@ main(int argc, char** argv)
     // Ready!!!
     std::cout << "Working..." << std::endl;
 
-    visitor->setProgressCallback( new ProgressReporter() );
+    visitor->setProgressCallback( new ProgressReporter(&writer) );
 
     osg::Timer_t t0 = osg::Timer::instance()->tick();
 
+    writer.start();
+
     visitor->run( outputProfile.get() );
 
+    // drain the write queue:
+    writer.finish();
+
     osg::Timer_t t1 = osg::Timer::instance()->tick();
 
+    double seconds = osg::Timer::instance()->delta_s(t0, t1);
+
     std::cout
-        << "Time = "
+        << "\nTime = "
         << std::fixed
         << std::setprecision(1)
-        << osg::Timer::instance()->delta_s(t0, t1)
-        << " seconds." << std::endl;
+        << seconds
+        << " seconds; "
+        << writer.getNumWritten() << " tiles written ("
+        << (seconds > 0.0 ? (double)writer.getNumWritten()/seconds : 0.0) << " tiles/s), "
+        << writer.getNumFailed() << " failed." << std::endl;
 
     return 0;
 }
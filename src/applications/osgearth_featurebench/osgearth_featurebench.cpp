@@ -0,0 +1,240 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#define LC "[osgearth_featurebench] "
+
+#include <osgEarth/Notify>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/FeatureListSource>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/Session>
+#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osg/ArgumentParser>
+#include <osg/NodeVisitor>
+#include <osg/Geometry>
+#include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <cfloat>
+#include <iomanip>
+#include <iostream>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Drivers;
+
+// documentation
+int usage(char** argv)
+{
+    std::cout
+        << "Measures how long it takes to compile a feature set into extruded geometry, without a window.\n\n"
+        << argv[0] << " [file.shp]"
+        << "\n    --generate [num]  : compile [num] synthetic square buildings instead of reading a file"
+        << "\n    --height [expr]   : extrusion height expression (default = 15)"
+        << "\n    --threads [num]   : compile threads to try; repeat to try several (default = 0 and one per core)"
+        << "\n    --chunk [num]     : features per parallel compile chunk (default = 2500)"
+        << "\n    --runs [num]      : runs per thread count; the best is reported (default = 1)"
+        << std::endl;
+
+    return -1;
+}
+
+/** Counts the geometry in a compiled graph, to check that each run built the same thing */
+struct CountGeometry : public osg::NodeVisitor
+{
+    unsigned _drawables, _vertices;
+
+    CountGeometry() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _drawables(0), _vertices(0) { }
+
+    void apply(osg::Geode& geode)
+    {
+        for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
+        {
+            osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+            if ( geom && geom->getVertexArray() )
+            {
+                ++_drawables;
+                _vertices += geom->getVertexArray()->getNumElements();
+            }
+        }
+    }
+};
+
+/** Square buildings on a grid of city blocks somewhere in Europe */
+void
+generate(unsigned count, FeatureList& out)
+{
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    unsigned cols = (unsigned)ceil(sqrt((double)count));
+    const double spacing = 0.0003, size = 0.0001;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        double x = 5.0 + spacing*(double)(i % cols);
+        double y = 45.0 + spacing*(double)(i / cols);
+
+        Polygon* poly = new Polygon();
+        poly->push_back(osg::Vec3d(x, y, 0));
+        poly->push_back(osg::Vec3d(x+size, y, 0));
+        poly->push_back(osg::Vec3d(x+size, y+size, 0));
+        poly->push_back(osg::Vec3d(x, y+size, 0));
+
+        Feature* feature = new Feature(poly, wgs84);
+        feature->set("height", 5.0 + (double)(i % 40));
+        out.push_back(feature);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc, argv);
+
+    if ( args.read("--help") )
+        return usage(argv);
+
+    unsigned generateCount = 0;
+    args.read("--generate", generateCount);
+
+    std::string height = "15";
+    args.read("--height", height);
+
+    std::vector<unsigned> threadCounts;
+    unsigned threads;
+    while ( args.read("--threads", threads) )
+        threadCounts.push_back(threads);
+    if ( threadCounts.empty() )
+    {
+        threadCounts.push_back(0u);
+        threadCounts.push_back((unsigned)OpenThreads::GetNumberOfProcessors());
+    }
+
+    unsigned chunkSize = 2500;
+    args.read("--chunk", chunkSize);
+
+    unsigned runs = 1;
+    args.read("--runs", runs);
+    runs = osg::maximum(runs, 1u);
+
+    // Read all the features into memory first, so the runs time
+    // the compile and not the file access.
+    osg::ref_ptr<FeatureListSource> features = new FeatureListSource();
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    if ( generateCount > 0 )
+    {
+        generate(generateCount, features->getFeatures());
+
+        Bounds bounds;
+        for (FeatureList::const_iterator i = features->getFeatures().begin(); i != features->getFeatures().end(); ++i)
+            bounds.expandBy(i->get()->getGeometry()->getBounds());
+        features->setFeatureProfile(new FeatureProfile(GeoExtent(SpatialReference::get("wgs84"), bounds)));
+    }
+    else
+    {
+        if ( argc < 2 )
+            return usage(argv);
+
+        OGRFeatureOptions ogr;
+        ogr.url() = argv[1];
+
+        osg::ref_ptr<FeatureSource> source = FeatureSourceFactory::create(ogr);
+        if ( !source.valid() || source->open().isError() )
+        {
+            OE_WARN << LC << "Failed to open " << argv[1] << std::endl;
+            return -1;
+        }
+
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(0L);
+        if ( cursor.valid() )
+            cursor->fill(features->getFeatures());
+
+        features->setFeatureProfile(source->getFeatureProfile());
+    }
+
+    features->open();
+
+    std::cout << "Read " << features->getFeatures().size() << " features in "
+        << std::fixed << std::setprecision(2) << osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()) << "s" << std::endl;
+
+    if ( features->getFeatures().empty() )
+        return -1;
+
+    osg::ref_ptr<Map> map = new Map();
+
+    Style style;
+    ExtrusionSymbol* extrusion = style.getOrCreate<ExtrusionSymbol>();
+    extrusion->heightExpression() = NumericExpression(height);
+    extrusion->flatten() = true;
+    style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::White;
+
+    osg::ref_ptr<StyleSheet> styles = new StyleSheet();
+    styles->addStyle(style);
+
+    double baseline = 0.0;
+
+    for (unsigned t = 0; t < threadCounts.size(); ++t)
+    {
+        double best = DBL_MAX;
+        CountGeometry count;
+
+        for (unsigned r = 0; r < runs; ++r)
+        {
+            FeatureModelSourceOptions options;
+            options.styles() = styles.get();
+            options.compileThreads() = threadCounts[t];
+            options.compileChunkSize() = chunkSize;
+
+            osg::ref_ptr<Session> session = new Session(map.get(), styles.get(), features.get(), 0L);
+
+            // With no layout, the graph compiles everything in its constructor.
+            start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<FeatureModelGraph> graph = new FeatureModelGraph(
+                session.get(),
+                options,
+                new GeomFeatureNodeFactory(GeometryCompilerOptions()),
+                0L);
+
+            best = osg::minimum(best, osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick()));
+
+            if ( r == 0 )
+                graph->accept(count);
+        }
+
+        if ( t == 0 )
+            baseline = best;
+
+        std::cout
+            << "threads=" << std::setw(3) << threadCounts[t]
+            << "  time=" << std::fixed << std::setprecision(2) << best << "s"
+            << "  features/s=" << (unsigned)((double)features->getFeatures().size() / best)
+            << "  speedup=" << std::setprecision(2) << baseline / best
+            << "  drawables=" << count._drawables
+            << "  vertices=" << count._vertices
+            << std::endl;
+    }
+
+    return 0;
+}
@@ -62,7 +62,8 @@ void printStats(FeatureSource* features)
 void printFeature( Feature* feature )
 {
     std::cout << "FID: " << feature->getFID() << std::endl;
-    for (AttributeTable::const_iterator itr = feature->getAttrs().begin(); itr != feature->getAttrs().end(); ++itr)
+    const AttributeTable& attrs = feature->getAllAttrs();
+    for (AttributeTable::const_iterator itr = attrs.begin(); itr != attrs.end(); ++itr)
     {
         std::cout 
             << indent 
@@ -84,7 +84,7 @@ public:
             _grid->setControl( 1, r, new LabelControl(Stringify()<<feature->getFID(), Color::White) );
             ++r;
 
-            const AttributeTable& attrs = feature->getAttrs();
+            const AttributeTable& attrs = feature->getAllAttrs();
             for( AttributeTable::const_iterator i = attrs.begin(); i != attrs.end(); ++i, ++r )
             {
                 _grid->setControl( 0, r, new LabelControl(i->first, 14.0f, Color::Yellow) );
@@ -0,0 +1,452 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#define LC "[osgearth_pagingbench] "
+
+#include <osgEarth/Notify>
+#include <osgEarth/MapNode>
+#include <osgEarth/Metrics>
+#include <osgEarth/Viewpoint>
+#include <osgEarth/Extension>
+#include <osgEarth/URI>
+#include <osgEarth/ThreadingUtils>
+#include <osg/ArgumentParser>
+#include <osg/FrameStamp>
+#include <osg/Timer>
+#include <osgGA/EventVisitor>
+#include <osgUtil/SceneView>
+#include <osgUtil/UpdateVisitor>
+#include <osgDB/DatabasePager>
+#include <OpenThreads/Thread>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+using namespace osgEarth;
+
+// documentation
+int usage(char** argv)
+{
+    std::cout
+        << "Measures terrain paging performance without a window.\n\n"
+        << argv[0] << " file.earth"
+        << "\n    --viewpoints [file]    : XML file of <viewpoint> elements to visit (default = viewpoints in the earth file)"
+        << "\n    --orbit [num]          : visit [num] synthetic viewpoints circling the globe instead"
+        << "\n    --range [meters]       : eye range for --orbit viewpoints (default = 100000)"
+        << "\n    --size [w] [h]         : viewport size in pixels (default = 1920 1080)"
+        << "\n    --fov [degrees]        : vertical field of view (default = 30)"
+        << "\n    --fps [num]            : frames per second to simulate; 0 = unthrottled (default = 60)"
+        << "\n    --settle-frames [num]  : idle frames required to call a viewpoint fully loaded (default = 10)"
+        << "\n    --max-frames [num]     : give up on a viewpoint after this many frames (default = 3600)"
+        << "\n    --csv [file]           : write per-frame statistics to a CSV file"
+        << std::endl;
+
+    return -1;
+}
+
+/**
+ * Collects the counters that the terrain engine reports through the
+ * Metrics interface, passing everything along to any backend (like a
+ * Chrome trace file) that was already installed.
+ */
+class CounterCollector : public MetricsBackend
+{
+public:
+    CounterCollector(MetricsBackend* next) : _next(next) { }
+
+    void begin(const std::string& name, const Config& args)
+    {
+        if ( _next.valid() ) _next->begin(name, args);
+    }
+
+    void end(const std::string& name, const Config& args)
+    {
+        if ( _next.valid() ) _next->end(name, args);
+    }
+
+    void counter(const std::string& graph,
+                 const std::string& name0, double value0,
+                 const std::string& name1, double value1,
+                 const std::string& name2, double value2)
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            record(graph, name0, value0);
+            record(graph, name1, value1);
+            record(graph, name2, value2);
+        }
+        if ( _next.valid() ) _next->counter(graph, name0, value0, name1, value1, name2, value2);
+    }
+
+    void async(const std::string& name, unsigned id,
+               osg::Timer_t start, osg::Timer_t end,
+               const Config& args)
+    {
+        if ( _next.valid() ) _next->async(name, id, start, end, args);
+    }
+
+    //! Most recent value of a counter
+    double latest(const std::string& name) const
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        std::map<std::string, double>::const_iterator i = _latest.find(name);
+        return i != _latest.end() ? i->second : 0.0;
+    }
+
+    //! Sum of a counter's values since the last call to takeSum
+    double takeSum(const std::string& name)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        double sum = _sums[name];
+        _sums[name] = 0.0;
+        return sum;
+    }
+
+private:
+    void record(const std::string& graph, const std::string& name, double value)
+    {
+        if ( !name.empty() )
+        {
+            std::string key = graph + "." + name;
+            _latest[key] = value;
+            _sums[key] += value;
+        }
+    }
+
+    osg::ref_ptr<MetricsBackend>  _next;
+    std::map<std::string, double> _latest;
+    std::map<std::string, double> _sums;
+    mutable Threading::Mutex      _mutex;
+};
+
+/** Terrain paging activity in one frame */
+struct FrameStats
+{
+    unsigned _loaded, _merged, _unloaded, _tiles, _requests, _mergeQueue;
+    double   _seconds;
+
+    FrameStats(CounterCollector* counters, double seconds) : _seconds(seconds)
+    {
+        _loaded     = (unsigned)counters->takeSum("RexLoader.Loaded");
+        _merged     = (unsigned)counters->takeSum("RexLoader.Merged");
+        _unloaded   = (unsigned)counters->takeSum("RexUnloader.Unloaded");
+        _tiles      = (unsigned)counters->latest("RexStats.Tiles");
+        _requests   = (unsigned)counters->latest("RexLoader.Requests");
+        _mergeQueue = (unsigned)counters->latest("RexLoaderQueue.MergeQueue");
+    }
+
+    bool idle() const { return _requests == 0 && _mergeQueue == 0 && _loaded == 0 && _merged == 0; }
+};
+
+/** Totals for one viewpoint */
+struct ViewpointStats
+{
+    std::string _name;
+    unsigned    _frames, _loaded, _merged, _unloaded, _peakTiles, _peakRequests;
+    double      _secondsToFullRes;
+    bool        _settled;
+
+    ViewpointStats(const std::string& name) :
+        _name(name), _frames(0), _loaded(0), _merged(0), _unloaded(0),
+        _peakTiles(0), _peakRequests(0), _secondsToFullRes(0.0), _settled(false) { }
+
+    void add(const FrameStats& f)
+    {
+        _frames++;
+        _loaded   += f._loaded;
+        _merged   += f._merged;
+        _unloaded += f._unloaded;
+        _peakTiles    = osg::maximum(_peakTiles, f._tiles);
+        _peakRequests = osg::maximum(_peakRequests, f._requests);
+    }
+};
+
+/** View matrix that looks at a viewpoint's focal point from its heading, pitch and range */
+osg::Matrixd
+computeViewMatrix(const Viewpoint& vp, const SpatialReference* mapSRS)
+{
+    GeoPoint focal = vp.focalPoint()->transform(mapSRS);
+    focal.altitudeMode() = ALTMODE_ABSOLUTE;
+
+    osg::Vec3d focalWorld;
+    focal.toWorld(focalWorld);
+
+    osg::Matrixd local2world;
+    focal.createLocalToWorld(local2world);
+
+    double h = vp.heading().isSet() ? vp.heading()->as(Units::RADIANS) : 0.0;
+    double p = vp.pitch().isSet()   ? vp.pitch()->as(Units::RADIANS)   : osg::DegreesToRadians(-45.0);
+    double r = vp.range().isSet()   ? vp.range()->as(Units::METERS)    : 10000.0;
+
+    // in the local east/north/up frame:
+    osg::Vec3d look( sin(h)*cos(p), cos(h)*cos(p), sin(p) );
+    osg::Vec3d up  ( -sin(h)*sin(p), -cos(h)*sin(p), cos(p) );
+
+    osg::Vec3d eyeWorld = (-look * r) * local2world;
+    osg::Vec3d upWorld  = osg::Matrixd::transform3x3(up, local2world);
+
+    return osg::Matrixd::lookAt(eyeWorld, focalWorld, upWorld);
+}
+
+/** Reads the <viewpoint> elements from the earth file's extensions */
+void
+getEarthFileViewpoints(MapNode* mapNode, std::vector<Viewpoint>& out)
+{
+    const std::vector< osg::ref_ptr<Extension> >& extensions = mapNode->getExtensions();
+    for (unsigned i = 0; i < extensions.size(); ++i)
+    {
+        const ConfigSet children = extensions[i]->getConfigOptions().getConfig().children("viewpoint");
+        for (ConfigSet::const_iterator c = children.begin(); c != children.end(); ++c)
+            out.push_back(Viewpoint(*c));
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc, argv);
+
+    if ( argc < 2 || args.read("--help") )
+        return usage(argv);
+
+    std::string viewpointsFile;
+    args.read("--viewpoints", viewpointsFile);
+
+    unsigned orbit = 0;
+    args.read("--orbit", orbit);
+
+    double orbitRange = 100000.0;
+    args.read("--range", orbitRange);
+
+    unsigned width = 1920, height = 1080;
+    args.read("--size", width, height);
+
+    double fov = 30.0;
+    args.read("--fov", fov);
+
+    double fps = 60.0;
+    args.read("--fps", fps);
+
+    unsigned settleFrames = 10;
+    args.read("--settle-frames", settleFrames);
+
+    unsigned maxFrames = 3600;
+    args.read("--max-frames", maxFrames);
+
+    std::string csvFile;
+    args.read("--csv", csvFile);
+
+    // intercept the terrain engine's counters before the map loads.
+    osg::ref_ptr<CounterCollector> counters = new CounterCollector(Metrics::getMetricsBackend());
+    Metrics::setMetricsBackend(counters.get());
+
+    osg::ref_ptr<MapNode> mapNode = MapNode::load(args);
+    if ( !mapNode.valid() )
+    {
+        OE_WARN << LC << "Failed to load an earth file" << std::endl;
+        return usage(argv);
+    }
+
+    // gather the camera path.
+    std::vector<Viewpoint> viewpoints;
+    if ( orbit > 0 )
+    {
+        for (unsigned i = 0; i < orbit; ++i)
+        {
+            double lon = -180.0 + 360.0 * (double)i / (double)orbit;
+            double lat = 45.0 * sin(osg::DegreesToRadians(lon));
+            Viewpoint vp;
+            vp.name() = Stringify() << "orbit " << i;
+            vp.focalPoint() = GeoPoint(SpatialReference::get("wgs84"), lon, lat, 0.0, ALTMODE_ABSOLUTE);
+            vp.pitch() = Angle(-60.0, Units::DEGREES);
+            vp.range() = Distance(orbitRange, Units::METERS);
+            viewpoints.push_back(vp);
+        }
+    }
+    else if ( !viewpointsFile.empty() )
+    {
+        std::ifstream in(viewpointsFile.c_str());
+        Config conf;
+        if ( !in.is_open() || !conf.fromXML(in) )
+        {
+            OE_WARN << LC << "Failed to read viewpoints from " << viewpointsFile << std::endl;
+            return -1;
+        }
+        const Config& root = conf.hasChild("viewpoints") ? conf.child("viewpoints") : conf;
+        const ConfigSet children = root.children("viewpoint");
+        for (ConfigSet::const_iterator c = children.begin(); c != children.end(); ++c)
+            viewpoints.push_back(Viewpoint(*c));
+    }
+    else
+    {
+        getEarthFileViewpoints(mapNode.get(), viewpoints);
+    }
+
+    if ( viewpoints.empty() )
+    {
+        OE_WARN << LC << "No viewpoints; use --viewpoints, --orbit, or an earth file with <viewpoints>" << std::endl;
+        return usage(argv);
+    }
+
+    const SpatialReference* mapSRS = mapNode->getMapSRS();
+
+    // A cull-only "viewer": no graphics context and no draw traversal.
+    osg::ref_ptr<osgDB::DatabasePager> pager = osgDB::DatabasePager::create();
+
+    osg::ref_ptr<osgUtil::SceneView> sceneView = new osgUtil::SceneView();
+    sceneView->setDefaults();
+    sceneView->setSceneData(mapNode.get());
+    sceneView->setViewport(0, 0, width, height);
+    sceneView->setProjectionMatrixAsPerspective(fov, (double)width/(double)height, 1.0, 1e10);
+    sceneView->getCullVisitor()->setDatabaseRequestHandler(pager.get());
+
+    osg::ref_ptr<osgGA::EventVisitor> eventVisitor = new osgGA::EventVisitor();
+    osg::ref_ptr<osgUtil::UpdateVisitor> updateVisitor = new osgUtil::UpdateVisitor();
+    osg::ref_ptr<osg::FrameStamp> frameStamp = new osg::FrameStamp();
+
+    std::ofstream csv;
+    if ( !csvFile.empty() )
+    {
+        csv.open(csvFile.c_str());
+        csv << "viewpoint,frame,seconds,loaded,merged,unloaded,tiles,requests,merge_queue\n";
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    double frameTime = fps > 0.0 ? 1.0/fps : 0.0;
+    unsigned frameNumber = 0;
+    unsigned peakTiles = 0, peakRequests = 0;
+    std::vector<ViewpointStats> results;
+
+    for (unsigned v = 0; v < viewpoints.size(); ++v)
+    {
+        const Viewpoint& vp = viewpoints[v];
+        ViewpointStats stats( vp.name().isSet() ? vp.name().get() : std::string(Stringify() << "viewpoint " << v) );
+        sceneView->setViewMatrix(computeViewMatrix(vp, mapSRS));
+
+        osg::Timer_t vpStart = osg::Timer::instance()->tick();
+        unsigned idleFrames = 0;
+
+        while ( stats._frames < maxFrames && !stats._settled )
+        {
+            osg::Timer_t frameStart = osg::Timer::instance()->tick();
+            double t = osg::Timer::instance()->delta_s(start, frameStart);
+
+            frameStamp->setFrameNumber(frameNumber);
+            frameStamp->setReferenceTime(t);
+            frameStamp->setSimulationTime(t);
+
+            pager->signalBeginFrame(frameStamp.get());
+
+            eventVisitor->setFrameStamp(frameStamp.get());
+            eventVisitor->setTraversalNumber(frameNumber);
+            mapNode->accept(*eventVisitor);
+
+            updateVisitor->setFrameStamp(frameStamp.get());
+            updateVisitor->setTraversalNumber(frameNumber);
+            mapNode->accept(*updateVisitor);
+
+            pager->updateSceneGraph(*frameStamp);
+
+            sceneView->setFrameStamp(frameStamp.get());
+            sceneView->cull();
+
+            pager->signalEndFrame();
+
+            FrameStats frame(counters.get(), osg::Timer::instance()->delta_s(vpStart, osg::Timer::instance()->tick()));
+            stats.add(frame);
+
+            if ( csv.is_open() )
+            {
+                csv << v << "," << frameNumber << "," << frame._seconds << ","
+                    << frame._loaded << "," << frame._merged << "," << frame._unloaded << ","
+                    << frame._tiles << "," << frame._requests << "," << frame._mergeQueue << "\n";
+            }
+
+            // Fully loaded once the engine has had nothing to do for a while.
+            idleFrames = frame.idle() ? idleFrames+1 : 0;
+            if ( idleFrames >= settleFrames && stats._frames > settleFrames )
+            {
+                stats._settled = true;
+                stats._secondsToFullRes = frame._seconds;
+            }
+
+            ++frameNumber;
+
+            double elapsed = osg::Timer::instance()->delta_s(frameStart, osg::Timer::instance()->tick());
+            if ( elapsed < frameTime )
+            {
+                OpenThreads::Thread::microSleep((unsigned)(1e6 * (frameTime - elapsed)));
+            }
+        }
+
+        peakTiles = osg::maximum(peakTiles, stats._peakTiles);
+        peakRequests = osg::maximum(peakRequests, stats._peakRequests);
+        results.push_back(stats);
+
+        std::ostringstream time;
+        if ( stats._settled )
+            time << std::fixed << std::setprecision(2) << stats._secondsToFullRes << "s";
+        else
+            time << "TIMEOUT";
+
+        std::cout
+            << std::setw(4) << v << "  " << std::setw(24) << std::left << stats._name.substr(0, 24) << std::right
+            << "  " << std::setw(8) << time.str()
+            << "  frames=" << stats._frames
+            << "  loaded=" << stats._loaded
+            << "  merged=" << stats._merged
+            << "  unloaded=" << stats._unloaded
+            << "  peak tiles=" << stats._peakTiles
+            << "  peak queue=" << stats._peakRequests
+            << std::endl;
+    }
+
+    pager->cancel();
+
+    // summary
+    double totalTime = 0.0;
+    unsigned settled = 0, loaded = 0, merged = 0, unloaded = 0;
+    for (unsigned i = 0; i < results.size(); ++i)
+    {
+        if ( results[i]._settled )
+        {
+            totalTime += results[i]._secondsToFullRes;
+            ++settled;
+        }
+        loaded   += results[i]._loaded;
+        merged   += results[i]._merged;
+        unloaded += results[i]._unloaded;
+    }
+
+    std::cout
+        << "\nViewpoints:               " << results.size() << " (" << (results.size()-settled) << " timed out)"
+        << "\nFrames:                   " << frameNumber
+        << "\nMean time to full res:    " << std::fixed << std::setprecision(3) << (settled > 0 ? totalTime/(double)settled : 0.0) << "s"
+        << "\nTiles loaded/merged/unloaded: " << loaded << " / " << merged << " / " << unloaded
+        << "\nPeak tile registry size:  " << peakTiles
+        << "\nPeak loader queue depth:  " << peakRequests
+        << std::endl;
+
+    Metrics::setMetricsBackend(0L);
+
+    return settled == results.size() ? 0 : 1;
+}
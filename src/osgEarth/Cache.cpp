@@ -165,6 +165,14 @@ Cache::makeCacheKey(const std::string& key, const std::string& prefix)
     return out.str();
 }
 
+std::string
+Cache::makeContentHash(const std::string& data)
+{
+    char hex[SHA1_HEX_SIZE];
+    sha1("").add(data.data(), (uint32_t)data.size()).finalize().print_hex(hex);
+    return std::string(hex);
+}
+
 //------------------------------------------------------------------------
 
 #undef  LC
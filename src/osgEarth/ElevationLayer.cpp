@@ -547,6 +547,10 @@ ElevationLayer::createHeightField(const TileKey&    key,
 
         if ( cacheBin && policy.isCacheReadable() )
         {
+            METRIC_SCOPED_EX("ElevationLayer::readCache", 2,
+                             "key", key.str().c_str(),
+                             "name", getName().c_str());
+
             ReadResult r = cacheBin->readObject(cacheKey, 0L);
             if ( r.succeeded() )
             {            
@@ -574,23 +578,29 @@ ElevationLayer::createHeightField(const TileKey&    key,
             if ( !isKeyInLegalRange(key) )
                 return GeoHeightField::INVALID;
 
-            // If no tile source is expected, create a height field by calling
-            // the raw inheritable method.
-            if (!isTileSourceExpected())
             {
-                createImplementation(key, hf, normalMap, progress);
-                //hf = createHeightFieldImplementation(key, progress);
-            }
+                METRIC_SCOPED_EX("ElevationLayer::createImplementation", 2,
+                                 "key", key.str().c_str(),
+                                 "name", getName().c_str());
 
-            else
-            {
-                // bad tilesource? fail
-                if ( !getTileSource() || !getTileSource()->isOK() )
-                    return GeoHeightField::INVALID;
+                // If no tile source is expected, create a height field by calling
+                // the raw inheritable method.
+                if (!isTileSourceExpected())
+                {
+                    createImplementation(key, hf, normalMap, progress);
+                    //hf = createHeightFieldImplementation(key, progress);
+                }
 
-                // build a HF from the TileSource.
-                //hf = createHeightFieldImplementation( key, progress );
-                createImplementation(key, hf, normalMap, progress);
+                else
+                {
+                    // bad tilesource? fail
+                    if ( !getTileSource() || !getTileSource()->isOK() )
+                        return GeoHeightField::INVALID;
+
+                    // build a HF from the TileSource.
+                    //hf = createHeightFieldImplementation( key, progress );
+                    createImplementation(key, hf, normalMap, progress);
+                }
             }
 
             // Check for cancelation before writing to a cache
@@ -718,40 +728,6 @@ namespace
     //typedef std::pair<RefElevationLayer, TileKey> LayerAndKey;
     typedef std::vector<LayerData>              LayerDataVector;
 
-    //! Gets the normal vector for elevation data at column s, row t.
-    osg::Vec3 getNormal(const GeoExtent& extent, const osg::HeightField* hf, int s, int t)
-    {
-        int w = hf->getNumColumns();
-        int h = hf->getNumRows();
-
-        osg::Vec2d res(
-            extent.width() / (double)(w-1),
-            extent.height() / (double)(h-1));
-
-        float e = hf->getHeight(s, t);
-
-        double dx = res.x(), dy = res.y();
-
-        if (extent.getSRS()->isGeographic())
-        {
-            double R = extent.getSRS()->getEllipsoid()->getRadiusEquator();
-            double mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
-            dy = dy * mPerDegAtEquator;
-            double lat = extent.yMin() + res.y()*(double)t;
-            dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
-        }
-        
-        osg::Vec3d west(0, 0, e), east(0, 0, e), south(0, 0, e), north(0, 0, e);
-
-        if (s > 0)     west.set (-dx, 0, hf->getHeight(s-1, t));
-        if (s < w - 1) east.set ( dx, 0, hf->getHeight(s+1, t));
-        if (t > 0)     south.set(0, -dy, hf->getHeight(s, t-1));
-        if (t < h - 1) north.set(0,  dy, hf->getHeight(s, t+1));
-
-        osg::Vec3d normal = (east - west) ^ (north - south);
-        return normal;
-    }
-
     //! Creates a normal map for heightfield "hf" and stores it in the
     //! pre-allocated NormalMap.
     //!
@@ -771,6 +747,43 @@ namespace
         int w = hf->getNumColumns();
         int h = hf->getNumRows();
 
+        // Central-difference normal (not normalized) at every post, one row at a time:
+        std::vector<osg::Vec3f> normals(w*h);
+        {
+            osg::Vec2d res(
+                extent.width() / (double)(w-1),
+                extent.height() / (double)(h-1));
+
+            double dy = res.y();
+            double mPerDegAtEquator = 0.0;
+            if (extent.getSRS()->isGeographic())
+            {
+                double R = extent.getSRS()->getEllipsoid()->getRadiusEquator();
+                mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
+                dy = dy * mPerDegAtEquator;
+            }
+
+            const float* heights = &hf->getHeightList().front();
+
+            for (int t = 0; t < h; ++t)
+            {
+                double dx = res.x();
+                if (extent.getSRS()->isGeographic())
+                {
+                    double lat = extent.yMin() + res.y()*(double)t;
+                    dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
+                }
+
+                const float* row = heights + t*w;
+                HeightFieldUtils::createNormalRow(
+                    t > 0 ? row - w : row,
+                    row,
+                    t < h - 1 ? row + w : row,
+                    w, (float)dx, (float)dy,
+                    &normals[t*w], 0L);
+            }
+        }
+
         for (int t = 0; t < (int)hf->getNumRows(); ++t)
         {
             for (int s = 0; s<(int)hf->getNumColumns(); ++s)
@@ -785,7 +798,7 @@ namespace
                 if (step == 1)
                 {
                     // Same LOD, simple query
-                    normal = getNormal(extent, hf, s, t);
+                    normal = normals[t*w + s];
                 }
                 else
                 {
@@ -797,29 +810,29 @@ namespace
                     if (s0 == s1 && t0 == t1)
                     {
                         // on-pixel, simple query
-                        normal = getNormal(extent, hf, s0, t0);
+                        normal = normals[t0*w + s0];
                     }
                     else if (s0 == s1)
                     {
                         // same column; linear interpolate along row
-                        osg::Vec3 S = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 N = getNormal(extent, hf, s0, t1);
+                        osg::Vec3 S = normals[t0*w + s0];
+                        osg::Vec3 N = normals[t1*w + s0];
                         normal = S*(double)(t1 - t) + N*(double)(t - t0);
                     }
                     else if (t0 == t1)
                     {
                         // same row; linear interpolate along column
-                        osg::Vec3 W = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 E = getNormal(extent, hf, s1, t0);
+                        osg::Vec3 W = normals[t0*w + s0];
+                        osg::Vec3 E = normals[t0*w + s1];
                         normal = W*(double)(s1 - s) + E*(double)(s - s0);
                     }
                     else
                     {
                         // bilinear interpolate
-                        osg::Vec3 SW = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 SE = getNormal(extent, hf, s1, t0);
-                        osg::Vec3 NW = getNormal(extent, hf, s0, t1);
-                        osg::Vec3 NE = getNormal(extent, hf, s1, t1);
+                        osg::Vec3 SW = normals[t0*w + s0];
+                        osg::Vec3 SE = normals[t0*w + s1];
+                        osg::Vec3 NW = normals[t1*w + s0];
+                        osg::Vec3 NE = normals[t1*w + s1];
 
                         osg::Vec3 S = SW*(double)(s1 - s) + SE*(double)(s - s0);
                         osg::Vec3 N = NW*(double)(s1 - s) + NE*(double)(s - s0);
@@ -19,6 +19,8 @@
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <osgEarth/HeightFieldUtils>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -28,23 +30,10 @@ using namespace osgEarth;
 
 
 ElevationPool::ElevationPool() :
-_entries(0u),
 _maxEntries( 128u ),
 _tileSize( 257u )
 {
-    //nop
-    //_opQueue = Registry::instance()->getAsyncOperationQueue();
-    if (!_opQueue.valid())
-    {
-        _opQueue = new osg::OperationQueue();
-        for (unsigned i=0; i<2; ++i)
-        {
-            osg::OperationThread* thread = new osg::OperationThread();
-            thread->setOperationQueue(_opQueue.get());
-            thread->start();
-            _opThreads.push_back(thread);
-        }
-    }
+    _taskService = new TaskService("ElevationPool", 2);
 }
 
 ElevationPool::~ElevationPool()
@@ -70,10 +59,7 @@ ElevationPool::clear()
 void
 ElevationPool::stopThreading()
 {
-    _opQueue->releaseAllOperations();
-    
-    for (unsigned i = 0; i<_opThreads.size(); ++i)
-    _opThreads[i]->setDone(true);
+    _taskService->cancelAll();
 }
 
 void
@@ -97,7 +83,7 @@ ElevationPool::getElevation(const GeoPoint& point, unsigned lod)
 {
     GetElevationOp* op = new GetElevationOp(this, point, lod);
     Future<ElevationSample> result = op->_promise.getFuture();
-    _opQueue->add(op);
+    _taskService->add(op);
     return result;
 }
 
@@ -108,10 +94,10 @@ _pool(pool), _point(point), _lod(lod)
 }
 
 void
-ElevationPool::GetElevationOp::operator()(osg::Object*)
+ElevationPool::GetElevationOp::operator()(ProgressCallback* progress)
 {
     osg::ref_ptr<ElevationPool> pool;
-    if (!_promise.isAbandoned() && _pool.lock(pool))
+    if (!_promise.isAbandoned() && _pool.lock(pool) && !(progress && progress->isCanceled()))
     {
         osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(_point.getSRS(), _lod);
         std::pair<float, float> r = env->getElevationAndResolution(_point.x(), _point.y());
@@ -159,65 +145,86 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
     return tile->_hf.valid();
 }
 
-void
-ElevationPool::popMRU()
+ElevationPool::Shard&
+ElevationPool::getShard(const TileKey& key)
 {
-    // first rememeber the key of the item we're about the pop:
-    TileKey key = _mru.back()->_key;
+    unsigned h = key.getLOD();
+    h = h*31u + key.getTileX();
+    h = h*31u + key.getTileY();
+    return _shards[h % NUM_SHARDS];
+}
 
-    // establish a temporary observer on the item:
-    osg::observer_ptr<Tile> temp = _mru.back().get();
+void
+ElevationPool::evict(Shard& shard, const Tile* keep)
+{
+    // Each shard keeps a few tiles no matter how small the total, or a
+    // query that needs two tiles from one shard would evict one to load
+    // the other, over and over.
+    unsigned maxEntries = osg::maximum((unsigned)MIN_TILES_PER_SHARD, (_maxEntries + NUM_SHARDS - 1u) / NUM_SHARDS);
+
+    // Sweep the CLOCK hand around the shard. Tiles that were used since the
+    // last pass get a second chance; tiles still loading are skipped, and so
+    // is "keep", the tile the caller is about to use (a new one would be
+    // EMPTY and unreferenced after one pass). Give up after two full
+    // revolutions so we never spin if everything is pinned.
+    unsigned budget = 2u * shard._tiles.size();
+
+    while (shard._tiles.size() > maxEntries && budget-- > 0u)
+    {
+        if (shard._hand == shard._tiles.end())
+            shard._hand = shard._tiles.begin();
 
-    // pop the Tile from the MRU:
-    _mru.pop_back();
+        Tile* tile = shard._hand->second.get();
 
-    // if our observer went to NULL, we know there are no more pointers
-    // to that Tile in the MRU, and we can remove it from the main list:
-    if (!temp.valid())
-    {
-        _tiles.erase(key);
+        if (tile == keep || tile->_status == STATUS_IN_PROGRESS || tile->_referenced.exchange(0u) != 0u)
+        {
+            ++shard._hand;
+        }
+        else
+        {
+            // Envelopes may still hold a reference to the tile in their QuerySets;
+            // that's fine, it just leaves the cache.
+            Tiles::iterator victim = shard._hand++;
+            shard._tiles.erase(victim);
+            ++_evictions;
+        }
     }
 }
 
 bool
 ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<Tile>& out)
 {
+    Shard& shard = getShard(key);
+
     // first see whether the tile is available
-    _tilesMutex.lock();
+    shard._mutex.lock();
 
     // locate the tile in the local tile cache:
-    osg::observer_ptr<Tile>& tile_obs = _tiles[key];
-
-    osg::ref_ptr<Tile> tile;
+    osg::ref_ptr<Tile>& tile_ref = shard._tiles[key];
 
-    // Get a safe pointer to it. If this is NULL, we need to create and
-    // fetch a new tile from the Map.
-    if (!tile_obs.lock(tile))
+    // If this is NULL, we need to create and fetch a new tile from the Map.
+    if (!tile_ref.valid())
     {
         // a new tile; status -> EMPTY
-        tile = new Tile();
-        tile->_key = key;
+        tile_ref = new Tile();
+        tile_ref->_key = key;
+        ++_misses;
+    }
 
-        // update the LRU:
-        _mru.push_front(tile.get());
+    osg::ref_ptr<Tile> tile = tile_ref.get();
 
-        // prune the MRU if necessary:
-        if (++_entries > _maxEntries )
-        {
-            popMRU();
-            --_entries;
-        }
+    // Mark this tile as recently used:
+    tile->_referenced.exchange(1u);
 
-        // add to the main cache (after putting it on the LRU).
-        tile_obs = tile;
-    }
+    // make room if necessary, keeping the tile we're about to use in the cache
+    evict(shard, tile.get());
        
     // This means the tile object exists but has yet to be populated:
     if ( tile->_status == STATUS_EMPTY )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
         tile->_status.exchange(STATUS_IN_PROGRESS);
-        _tilesMutex.unlock();
+        shard._mutex.unlock();
 
         bool ok = fetchTileFromMap(key, layers, tile.get());
         tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
@@ -230,19 +237,9 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
     else if ( tile->_status == STATUS_AVAILABLE )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> available\n";
+        ++_hits;
+        shard._mutex.unlock();
         out = tile.get();
-
-        // Mark this tile as recently used:
-        _mru.push_front(tile.get());
-
-        // prune the MRU if necessary
-        if (++_entries > _maxEntries)
-        {
-            popMRU();
-            --_entries;
-        }
-
-        _tilesMutex.unlock();
         return true;
     }
 
@@ -250,7 +247,7 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
     else if ( tile->_status == STATUS_FAIL )
     {
         OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
-        _tilesMutex.unlock();
+        shard._mutex.unlock();
         out = 0L;
         return false;
     }
@@ -260,7 +257,7 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
     else //if ( tile->_status == STATUS_IN_PROGRESS )
     {
         OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
-        _tilesMutex.unlock();
+        shard._mutex.unlock();
         out = 0L;
         return true;            // out:NULL => check back later please.
     }
@@ -269,10 +266,20 @@ ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, o
 void
 ElevationPool::clearImpl()
 {
-    // assumes the tiles lock is taken.
-    _tiles.clear();
-    _mru.clear();
-    _entries = 0u;
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock(_shards[i]._mutex);
+        _shards[i]._tiles.clear();
+        _shards[i]._hand = _shards[i]._tiles.end();
+    }
+}
+
+void
+ElevationPool::resetStats()
+{
+    _hits.exchange(0u);
+    _misses.exchange(0u);
+    _evictions.exchange(0u);
 }
 
 bool
@@ -433,6 +440,32 @@ ElevationEnvelope::getElevationAndResolution(double x, double y)
     return std::make_pair(elevation, resolution);
 }
 
+ElevationPool::Tile*
+ElevationEnvelope::findTile(double x, double y)
+{
+    // same search order as sample(): highest resolution first.
+    for(ElevationPool::QuerySet::const_iterator tile_ref = _tiles.begin();
+        tile_ref != _tiles.end();
+        ++tile_ref)
+    {
+        if ((*tile_ref)->_bounds.contains(x, y))
+            return tile_ref->get();
+    }
+
+    // Not in the query set yet; ask the pool for it.
+    TileKey key = _mapProfile->createTileKey(x, y, _lod);
+    osg::ref_ptr<ElevationPool::Tile> tile;
+    osg::ref_ptr<ElevationPool> pool;
+
+    if (_pool.lock(pool) && pool->getTile(key, _layers, tile))
+    {
+        _tiles.insert(tile.get());
+        return tile.get();
+    }
+
+    return 0L;
+}
+
 unsigned
 ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
                                  std::vector<float>& output)
@@ -441,6 +474,101 @@ ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
 
     unsigned count = 0u;
 
+    output.clear();
+
+    if (input.empty())
+        return 0u;
+
+    // Transform all the points into the map SRS in one call instead of
+    // one GeoPoint transformation per sample:
+    std::vector<osg::Vec3d> points(input);
+    for (unsigned i = 0; i < points.size(); ++i)
+        points[i].z() = 0.0;
+
+    if (!_inputSRS.valid() || !_mapProfile.valid() ||
+        !_inputSRS->transform(points, _mapProfile->getSRS()))
+    {
+        // at least one point failed to transform; fall back on per-point sampling.
+        return getElevationsPerPoint(input, output);
+    }
+
+    output.assign(input.size(), NO_DATA_VALUE);
+
+    // Resolve the tile covering each point, and bin the point indices by tile
+    // so we can sample each heightfield over a contiguous span of points.
+    std::vector<ElevationPool::Tile*> bins;
+    std::vector< std::vector<unsigned> > binIndices;
+    unsigned lastBin = 0u;
+
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        ElevationPool::Tile* tile = findTile(points[i].x(), points[i].y());
+        if (!tile)
+            continue;
+
+        // points tend to be spatially coherent, so check the last bin first.
+        if (bins.empty() || bins[lastBin] != tile)
+        {
+            lastBin = std::find(bins.begin(), bins.end(), tile) - bins.begin();
+            if (lastBin == bins.size())
+            {
+                bins.push_back(tile);
+                binIndices.push_back(std::vector<unsigned>());
+            }
+        }
+
+        binIndices[lastBin].push_back(i);
+    }
+
+    // Sample each tile's span. This replicates GeoHeightField::getElevation
+    // exactly (same intervals and interpolator) so the results are identical
+    // to the per-point path.
+    for (unsigned b = 0; b < bins.size(); ++b)
+    {
+        const GeoHeightField& geohf = bins[b]->_hf;
+        const osg::HeightField* hf = geohf.getHeightField();
+        const GeoExtent& extent = geohf.getExtent();
+        const double xMin = extent.xMin();
+        const double yMin = extent.yMin();
+        const double xInterval = extent.width() / (double)(hf->getNumColumns() - 1);
+        const double yInterval = extent.height() / (double)(hf->getNumRows() - 1);
+
+        const std::vector<unsigned>& span = binIndices[b];
+        for (unsigned k = 0; k < span.size(); ++k)
+        {
+            unsigned i = span[k];
+            const osg::Vec3d& p = points[i];
+
+            if (extent.contains(p.x(), p.y()))
+            {
+                output[i] = HeightFieldUtils::getHeightAtLocation(
+                    hf, p.x(), p.y(), xMin, yMin, xInterval, yInterval, INTERP_BILINEAR);
+            }
+            else
+            {
+                // bounds and extent disagree (e.g. at the antimeridian); let the
+                // per-point path sort it out.
+                float resolution;
+                sample(input[i].x(), input[i].y(), output[i], resolution);
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < output.size(); ++i)
+    {
+        if (output[i] != NO_DATA_VALUE)
+            ++count;
+    }
+
+    return count;
+}
+
+unsigned
+ElevationEnvelope::getElevationsPerPoint(const std::vector<osg::Vec3d>& input,
+                                         std::vector<float>& output)
+{
+    unsigned count = 0u;
+
     output.reserve(input.size());
     output.clear();
 
@@ -2152,6 +2152,206 @@ namespace
 
         return result;
     }
+
+
+    // Keys cubic convolution weight (a = -0.5), as used by GDAL's cubic resampler.
+    inline double cubicWeight(double x)
+    {
+        x = fabs(x);
+        if (x <= 1.0)
+            return ((1.5*x - 2.5)*x)*x + 1.0;
+        else if (x < 2.0)
+            return ((-0.5*x + 2.5)*x - 4.0)*x + 2.0;
+        return 0.0;
+    }
+
+    /**
+     * Warps an image from one extent/SRS to another without GDAL.
+     *
+     * Instead of transforming every output pixel, we transform a coarse grid of
+     * output pixel centers into the source SRS and interpolate the source
+     * coordinates linearly within each grid cell. The source pixels are then
+     * resampled a whole output row at a time. Pixel-is-area conventions match
+     * GDAL's so that the results are comparable with reprojectImage().
+     *
+     * Nothing here touches the GDAL lock, so it's safe to call from any number
+     * of threads at once. Returns NULL if the grid cannot be transformed.
+     */
+    osg::Image* nativeReproject(
+        const osg::Image*      image,
+        const GeoExtent&       src_extent,
+        const GeoExtent&       dest_extent,
+        ElevationInterpolation interp,
+        unsigned int           width = 0,
+        unsigned int           height = 0)
+    {
+        // spacing, in output pixels, of the transformation grid
+        const unsigned step = 16u;
+
+        if (width == 0 || height == 0)
+        {
+            width = osg::minimum(image->s(), image->t());
+            height = osg::minimum(image->s(), image->t());
+        }
+
+        const double dx = dest_extent.width() / (double)width;
+        const double dy = dest_extent.height() / (double)height;
+
+        // Grid node positions in output pixel space. The last node always lands
+        // on the last pixel so we never transform points outside the extent.
+        std::vector<unsigned> gridCols, gridRows;
+        for (unsigned c = 0; c < width-1; c += step) gridCols.push_back(c);
+        gridCols.push_back(width-1);
+        for (unsigned r = 0; r < height-1; r += step) gridRows.push_back(r);
+        gridRows.push_back(height-1);
+
+        const unsigned nx = gridCols.size();
+        const unsigned ny = gridRows.size();
+
+        std::vector<osg::Vec3d> grid;
+        grid.reserve(nx*ny);
+        for (unsigned j = 0; j < ny; ++j)
+        {
+            double y = dest_extent.yMin() + ((double)gridRows[j] + 0.5) * dy;
+            for (unsigned i = 0; i < nx; ++i)
+            {
+                double x = dest_extent.xMin() + ((double)gridCols[i] + 0.5) * dx;
+                grid.push_back(osg::Vec3d(x, y, 0.0));
+            }
+        }
+
+        if (!dest_extent.getSRS()->transform(grid, src_extent.getSRS()))
+        {
+            return 0L;
+        }
+
+        // convert the grid to (pixel-is-area) source pixel coordinates.
+        const double sfac = (double)image->s() / src_extent.width();
+        const double tfac = (double)image->t() / src_extent.height();
+        for (unsigned k = 0; k < grid.size(); ++k)
+        {
+            grid[k].x() = (grid[k].x() - src_extent.xMin()) * sfac - 0.5;
+            grid[k].y() = (grid[k].y() - src_extent.yMin()) * tfac - 0.5;
+        }
+
+        osg::Image* result = new osg::Image();
+        result->allocateImage(width, height, 1, image->getPixelFormat(), image->getDataType());
+        result->setInternalTextureFormat(image->getInternalTextureFormat());
+        ImageUtils::markAsUnNormalized(result, ImageUtils::isUnNormalized(image));
+        memset(result->data(), 0, result->getImageSizeInBytes());
+
+        ImageUtils::PixelReader read(image);
+        ImageUtils::PixelWriter write(result);
+
+        const int smax = image->s() - 1;
+        const int tmax = image->t() - 1;
+
+        std::vector<double> rowU(width), rowV(width);
+
+        unsigned gj = 0;
+        for (unsigned r = 0; r < height; ++r)
+        {
+            // locate the grid row interval containing this output row:
+            while (gj+2 < ny && gridRows[gj+1] < r) ++gj;
+            unsigned gj1 = osg::minimum(gj+1, ny-1);
+            double ty = gj1 > gj ? (double)(r - gridRows[gj]) / (double)(gridRows[gj1] - gridRows[gj]) : 0.0;
+
+            // interpolate the source coordinates for the entire row:
+            unsigned gi = 0;
+            for (unsigned c = 0; c < width; ++c)
+            {
+                while (gi+2 < nx && gridCols[gi+1] < c) ++gi;
+                unsigned gi1 = osg::minimum(gi+1, nx-1);
+                double tx = gi1 > gi ? (double)(c - gridCols[gi]) / (double)(gridCols[gi1] - gridCols[gi]) : 0.0;
+
+                const osg::Vec3d& p00 = grid[gj*nx + gi];
+                const osg::Vec3d& p10 = grid[gj*nx + gi1];
+                const osg::Vec3d& p01 = grid[gj1*nx + gi];
+                const osg::Vec3d& p11 = grid[gj1*nx + gi1];
+
+                osg::Vec3d bottom = p00 + (p10 - p00) * tx;
+                osg::Vec3d top    = p01 + (p11 - p01) * tx;
+                osg::Vec3d p      = bottom + (top - bottom) * ty;
+
+                rowU[c] = p.x();
+                rowV[c] = p.y();
+            }
+
+            // resample the row:
+            for (unsigned c = 0; c < width; ++c)
+            {
+                const double u = rowU[c];
+                const double v = rowV[c];
+
+                // outside the source image; leave transparent.
+                if (u < -0.5 || v < -0.5 || u > (double)smax + 0.5 || v > (double)tmax + 0.5)
+                    continue;
+
+                osg::Vec4 color;
+
+                if (interp == INTERP_NEAREST)
+                {
+                    color = read(
+                        osg::clampBetween((int)floor(u + 0.5), 0, smax),
+                        osg::clampBetween((int)floor(v + 0.5), 0, tmax));
+                }
+
+                else if (interp == INTERP_CUBIC)
+                {
+                    const int u0 = (int)floor(u);
+                    const int v0 = (int)floor(v);
+                    double wu[4], wv[4];
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        wu[k] = cubicWeight(u - (double)(u0 - 1 + k));
+                        wv[k] = cubicWeight(v - (double)(v0 - 1 + k));
+                    }
+
+                    osg::Vec4d sum;
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        int t = osg::clampBetween(v0 - 1 + j, 0, tmax);
+                        osg::Vec4d rowSum;
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            int s = osg::clampBetween(u0 - 1 + i, 0, smax);
+                            rowSum += osg::Vec4d(read(s, t)) * wu[i];
+                        }
+                        sum += rowSum * wv[j];
+                    }
+
+                    color = sum;
+
+                    // cubic can overshoot; keep normalized data in range.
+                    if (!ImageUtils::isUnNormalized(image))
+                    {
+                        for (unsigned k = 0; k < 4; ++k)
+                            color[k] = osg::clampBetween(color[k], 0.0f, 1.0f);
+                    }
+                }
+
+                else // INTERP_BILINEAR and everything else
+                {
+                    const int u0 = (int)floor(u);
+                    const int v0 = (int)floor(v);
+                    const float fu = (float)(u - (double)u0);
+                    const float fv = (float)(v - (double)v0);
+                    const int s0 = osg::clampBetween(u0, 0, smax);
+                    const int s1 = osg::clampBetween(u0 + 1, 0, smax);
+                    const int t0 = osg::clampBetween(v0, 0, tmax);
+                    const int t1 = osg::clampBetween(v0 + 1, 0, tmax);
+
+                    osg::Vec4 bottom = read(s0, t0) * (1.0f - fu) + read(s1, t0) * fu;
+                    osg::Vec4 top    = read(s0, t1) * (1.0f - fu) + read(s1, t1) * fu;
+                    color = bottom * (1.0f - fv) + top * fv;
+                }
+
+                write(color, c, r);
+            }
+        }
+
+        return result;
+    }
 }
 
 GeoImage
@@ -2195,6 +2395,27 @@ GeoImage::reproject(const SpatialReference* to_srs, const GeoExtent* to_extent,
     return GeoImage(resultImage, destExtent);
 }
 
+GeoImage
+GeoImage::reprojectNative(const SpatialReference* to_srs, const GeoExtent* to_extent, unsigned int width, unsigned int height, ElevationInterpolation interp) const
+{
+    GeoExtent destExtent = to_extent ? *to_extent : getExtent().transform(to_srs);
+
+    // interpolating non-normalized (e.g. coverage) data makes no sense.
+    if ( !ImageUtils::isNormalized(getImage()) )
+        interp = INTERP_NEAREST;
+
+    osg::Image* resultImage = nativeReproject(getImage(), getExtent(), destExtent, interp, width, height);
+
+    // The coarse grid could not be transformed (e.g. part of the output lies outside
+    // the source projection's domain). Fall back on per-pixel transformation.
+    if ( !resultImage )
+    {
+        resultImage = manualReproject(getImage(), getExtent(), destExtent, interp != INTERP_NEAREST, width, height);
+    }
+
+    return GeoImage(resultImage, destExtent);
+}
+
 void
 GeoImage::applyAlphaMask(const GeoExtent& maskingExtent)
 {
@@ -2615,22 +2836,37 @@ GeoHeightField::createSubSample( const GeoExtent& destEx, unsigned int width, un
     dest->setXInterval( dx );
     dest->setYInterval( dy );
 
-    double x, y;
-    int col, row;
-
     double x0 = (destEx.xMin()-_extent.xMin())/_extent.width();
     double y0 = (destEx.yMin()-_extent.yMin())/_extent.height();
 
     double xstep = div / (double)(width-1);
     double ystep = div / (double)(height-1);
-    
-    for( x = x0, col = 0; col < (int)width; x += xstep, col++ )
+
+    if ( interpolation == INTERP_BILINEAR )
     {
-        for( y = y0, row = 0; row < (int)height; y += ystep, row++ )
+        // normalized locations scale to pixels by the number of cells:
+        double xcells = (double)(_heightField->getNumColumns()-1);
+        double ycells = (double)(_heightField->getNumRows()-1);
+
+        HeightFieldUtils::getHeightsAtPixels(
+            _heightField.get(),
+            x0*xcells, xstep*xcells, width,
+            y0*ycells, ystep*ycells, height,
+            &dest->getHeightList().front() );
+    }
+    else
+    {
+        double x, y;
+        int col, row;
+
+        for( x = x0, col = 0; col < (int)width; x += xstep, col++ )
         {
-            float height = HeightFieldUtils::getHeightAtNormalizedLocation(
-                _heightField.get(), x, y, interpolation );
-            dest->setHeight( col, row, height );
+            for( y = y0, row = 0; row < (int)height; y += ystep, row++ )
+            {
+                float height = HeightFieldUtils::getHeightAtNormalizedLocation(
+                    _heightField.get(), x, y, interpolation );
+                dest->setHeight( col, row, height );
+            }
         }
     }
 
@@ -21,8 +21,38 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/CullingUtils>
 
+// SSE2 is part of the x86-64 baseline, so no extra compiler flags are needed.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define OSGEARTH_HFU_SSE2 1
+#   include <emmintrin.h>
+#endif
+
 using namespace osgEarth;
 
+namespace
+{
+    // Normal and curvature at one post; ax and by are the spans of the
+    // east-west and north-south differences (zero-length on a missing side).
+    inline void normalAndCurvature(float h, float hW, float hE, float hS, float hN,
+                                   float ax, float by, float kx, float ky,
+                                   osg::Vec3f* out_normal, float* out_curvature)
+    {
+        float az = hE - hW;
+        float bz = hN - hS;
+
+        // (east-west) ^ (north-south)
+        if (out_normal)
+            out_normal->set(-az*by, -ax*bz, ax*by);
+
+        if (out_curvature)
+        {
+            float D = (0.5f*(hW + hE) - h) * kx;
+            float E = (0.5f*(hS + hN) - h) * ky;
+            *out_curvature = osg::clampBetween(-2.0f*(D + E)*100.0f, -1.0f, 1.0f);
+        }
+    }
+}
+
 
 bool
 HeightFieldUtils::validateSamples(float &a, float &b, float &c, float &d)
@@ -434,15 +464,26 @@ HeightFieldUtils::createSubSample(const osg::HeightField* input,
     // copy over the skirt height, adjusting it for relative tile size.
     dest->setSkirtHeight( input->getSkirtHeight() * div );
 
-    double x, y;
-    int col, row;
-
-    for( x = outputEx.xMin(), col=0; col < numCols; x += dx, col++ )
+    if ( interpolation == INTERP_BILINEAR )
     {
-        for( y = outputEx.yMin(), row=0; row < numRows; y += dy, row++ )
+        getHeightsAtPixels(
+            input,
+            (outputEx.xMin() - inputEx.xMin()) / xInterval, dx / xInterval, numCols,
+            (outputEx.yMin() - inputEx.yMin()) / yInterval, dy / yInterval, numRows,
+            &dest->getHeightList().front() );
+    }
+    else
+    {
+        double x, y;
+        int col, row;
+
+        for( x = outputEx.xMin(), col=0; col < numCols; x += dx, col++ )
         {
-            float height = HeightFieldUtils::getHeightAtLocation( input, x, y, inputEx.xMin(), inputEx.yMin(), xInterval, yInterval, interpolation);
-            dest->setHeight( col, row, height );
+            for( y = outputEx.yMin(), row=0; row < numRows; y += dy, row++ )
+            {
+                float height = HeightFieldUtils::getHeightAtLocation( input, x, y, inputEx.xMin(), inputEx.yMin(), xInterval, yInterval, interpolation);
+                dest->setHeight( col, row, height );
+            }
         }
     }
 
@@ -478,21 +519,121 @@ HeightFieldUtils::resampleHeightField(osg::HeightField*      input,
     output->setXInterval( stepX );
     output->setYInterval( stepY );
     output->setOrigin( origin );
-    
-    for( int y = 0; y < newRows; ++y )
+
+    if ( interp == INTERP_BILINEAR )
     {
-        for( int x = 0; x < newColumns; ++x )
+        double dc = newColumns > 1 ? (double)(input->getNumColumns()-1) / (double)(newColumns-1) : 0.0;
+        double dr = newRows > 1    ? (double)(input->getNumRows()-1)    / (double)(newRows-1)    : 0.0;
+        getHeightsAtPixels( input, 0.0, dc, newColumns, 0.0, dr, newRows, &output->getHeightList().front() );
+    }
+    else
+    {
+        for( int y = 0; y < newRows; ++y )
         {
-            double nx = (double)x / (double)(newColumns-1);
-            double ny = (double)y / (double)(newRows-1);
-            float h = getHeightAtNormalizedLocation( input, nx, ny, interp );
-            output->setHeight( x, y, h );
+            for( int x = 0; x < newColumns; ++x )
+            {
+                double nx = (double)x / (double)(newColumns-1);
+                double ny = (double)y / (double)(newRows-1);
+                float h = getHeightAtNormalizedLocation( input, nx, ny, interp );
+                output->setHeight( x, y, h );
+            }
         }
     }
 
     return output;
 }
 
+void
+HeightFieldUtils::getHeightsAtPixels(const osg::HeightField* hf,
+                                     double c0, double dc, unsigned numCols,
+                                     double r0, double dr, unsigned numRows,
+                                     float* out)
+{
+    if ( !hf || !out || numCols == 0 || numRows == 0 || hf->getHeightList().empty() )
+        return;
+
+    const int cols = (int)hf->getNumColumns();
+    const int rows = (int)hf->getNumRows();
+    const float* heights = &hf->getHeightList().front();
+
+    // Every row samples the same columns, so resolve them once.
+    std::vector<double> px(numCols);
+    std::vector<int>    col0(numCols), col1(numCols);
+    std::vector<float>  fx(numCols);
+    for (unsigned i = 0; i < numCols; ++i)
+    {
+        double c = osg::clampBetween(c0 + dc*(double)i, 0.0, (double)(cols-1));
+        int ci = (int)floor(c);
+        px[i] = c;
+        col0[i] = ci;
+        col1[i] = osg::minimum(ci+1, cols-1);
+        fx[i] = (float)(c - (double)ci);
+    }
+
+    for (unsigned j = 0; j < numRows; ++j)
+    {
+        double r = osg::clampBetween(r0 + dr*(double)j, 0.0, (double)(rows-1));
+        int ri = (int)floor(r);
+        float fy = (float)(r - (double)ri);
+
+        const float* south = heights + ri*cols;
+        const float* north = heights + osg::minimum(ri+1, rows-1)*cols;
+        float* dest = out + j*numCols;
+
+        unsigned i = 0;
+
+#ifdef OSGEARTH_HFU_SSE2
+        const __m128 vfy = _mm_set1_ps(fy);
+        const __m128 noData = _mm_set1_ps(NO_DATA_VALUE);
+
+        for (; i + 4 <= numCols; i += 4)
+        {
+            const int* k0 = &col0[i];
+            const int* k1 = &col1[i];
+
+            __m128 sw = _mm_setr_ps(south[k0[0]], south[k0[1]], south[k0[2]], south[k0[3]]);
+            __m128 se = _mm_setr_ps(south[k1[0]], south[k1[1]], south[k1[2]], south[k1[3]]);
+            __m128 nw = _mm_setr_ps(north[k0[0]], north[k0[1]], north[k0[2]], north[k0[3]]);
+            __m128 ne = _mm_setr_ps(north[k1[0]], north[k1[1]], north[k1[2]], north[k1[3]]);
+
+            __m128 vfx = _mm_loadu_ps(&fx[i]);
+            __m128 s = _mm_add_ps(sw, _mm_mul_ps(vfx, _mm_sub_ps(se, sw)));
+            __m128 n = _mm_add_ps(nw, _mm_mul_ps(vfx, _mm_sub_ps(ne, nw)));
+            _mm_storeu_ps(dest + i, _mm_add_ps(s, _mm_mul_ps(vfy, _mm_sub_ps(n, s))));
+
+            // NO_DATA samples need the substitution rules of getHeightAtPixel.
+            int mask = _mm_movemask_ps(_mm_or_ps(
+                _mm_or_ps(_mm_cmpeq_ps(sw, noData), _mm_cmpeq_ps(se, noData)),
+                _mm_or_ps(_mm_cmpeq_ps(nw, noData), _mm_cmpeq_ps(ne, noData))));
+
+            if (mask != 0)
+            {
+                for (unsigned k = 0; k < 4; ++k)
+                    if (mask & (1 << k))
+                        dest[i+k] = getHeightAtPixel(hf, px[i+k], r, INTERP_BILINEAR);
+            }
+        }
+#endif
+
+        for (; i < numCols; ++i)
+        {
+            float sw = south[col0[i]], se = south[col1[i]];
+            float nw = north[col0[i]], ne = north[col1[i]];
+
+            if (sw == NO_DATA_VALUE || se == NO_DATA_VALUE || nw == NO_DATA_VALUE || ne == NO_DATA_VALUE)
+            {
+                dest[i] = getHeightAtPixel(hf, px[i], r, INTERP_BILINEAR);
+            }
+            else
+            {
+                float s = sw + fx[i]*(se - sw);
+                float n = nw + fx[i]*(ne - nw);
+                dest[i] = s + fy*(n - s);
+            }
+        }
+    }
+}
+
 
 osg::HeightField*
 HeightFieldUtils::createReferenceHeightField(const GeoExtent& ex,
@@ -771,8 +912,8 @@ HeightFieldUtils::createNormalMap(const osg::Image* elevation,
                                   const GeoExtent& extent)
 {   
     ImageUtils::PixelReader readElevation(elevation);
-    //ImageUtils::PixelWriter writeNormal(normalMap);
 
+    int w = (int)elevation->s();
     int sMax = (int)elevation->s()-1;
     int tMax = (int)elevation->t()-1;
         
@@ -784,39 +925,119 @@ HeightFieldUtils::createNormalMap(const osg::Image* elevation,
     double mPerDegAtEquator = (srs->getEllipsoid()->getRadiusEquator() * 2.0 * osg::PI) / 360.0;
     double dy = srs->isGeographic() ? yInterval * mPerDegAtEquator : yInterval;
 
+    // read each post once, instead of once per neighbor:
+    std::vector<float> heights(w * (int)elevation->t());
+    for (int t = 0; t<(int)elevation->t(); ++t)
+        for (int s = 0; s<w; ++s)
+            heights[t*w + s] = readElevation(s, t).r();
+
+    std::vector<osg::Vec3f> normals(w);
+    std::vector<float> curvatures(w);
+
     for (int t = 0; t<(int)elevation->t(); ++t)
     {
         double lat = extent.yMin() + yInterval*(double)t;
         double dx = srs->isGeographic() ? xInterval * mPerDegAtEquator * cos(osg::DegreesToRadians(lat)) : xInterval;
 
-        for(int s=0; s<(int)elevation->s(); ++s)
-        {
-            float h = readElevation(s, t).r();
-
-            osg::Vec3f west ( s > 0 ? -dx : 0, 0, h );
-            osg::Vec3f east ( s < sMax ?  dx : 0, 0, h );
-            osg::Vec3f south( 0, t > 0 ? -dy : 0, h );
-            osg::Vec3f north( 0, t < tMax ? dy : 0, h );
+        const float* row = &heights[t*w];
+        createNormalRow(
+            t > 0 ? row - w : row,
+            row,
+            t < tMax ? row + w : row,
+            w, (float)dx, (float)dy,
+            &normals[0], &curvatures[0]);
 
-            west.z() = readElevation(osg::maximum(0, s - 1), t).r();
-            east.z() = readElevation(osg::minimum(sMax, s + 1), t).r();
-            south.z() = readElevation(s, osg::maximum(0, t - 1)).r();
-            north.z() = readElevation(s, osg::minimum(tMax, t + 1)).r();
-
-            osg::Vec3f n = (east-west) ^ (north-south);
-            n.normalize();
+        for(int s=0; s<w; ++s)
+        {
+            normals[s].normalize();
+            normalMap->set(s, t, normals[s], curvatures[s]);
+        }
+    }
+}
 
-            // calculate and encode curvature (2nd derivative of elevation)
-            float D = (0.5*(west.z()+east.z()) - h) / (dx*dx);
-            float E = (0.5*(south.z()+north.z()) - h) / (dy*dy);
-            float curvature = osg::clampBetween(-2.0f*(D+E)*100.0f, -1.0f, 1.0f);
+void
+HeightFieldUtils::createNormalRow(const float* south,
+                                  const float* center,
+                                  const float* north,
+                                  unsigned     count,
+                                  float        dx,
+                                  float        dy,
+                                  osg::Vec3f*  out_normals,
+                                  float*       out_curvatures)
+{
+    if (count == 0)
+        return;
+
+    // a missing neighbor row contributes a zero-length difference
+    const float by = (south != center ? dy : 0.0f) + (north != center ? dy : 0.0f);
+    const float kx = 1.0f / (dx*dx);
+    const float ky = 1.0f / (dy*dy);
+    const unsigned last = count-1;
+
+    // west edge:
+    normalAndCurvature(
+        center[0], center[0], center[osg::minimum(1u, last)], south[0], north[0],
+        last > 0 ? dx : 0.0f, by, kx, ky,
+        out_normals, out_curvatures);
+
+    if (last == 0)
+        return;
+
+    // interior posts have neighbors on both sides:
+    const float ax = 2.0f*dx;
+    unsigned s = 1;
+
+#ifdef OSGEARTH_HFU_SSE2
+    const __m128 negAx = _mm_set1_ps(-ax);
+    const __m128 negBy = _mm_set1_ps(-by);
+    const __m128 half  = _mm_set1_ps(0.5f);
+    const __m128 vkx   = _mm_set1_ps(kx);
+    const __m128 vky   = _mm_set1_ps(ky);
+    const __m128 scale = _mm_set1_ps(-200.0f);
+    const __m128 lo    = _mm_set1_ps(-1.0f);
+    const __m128 hi    = _mm_set1_ps(1.0f);
+    const float nz = ax*by;
+
+    for (; s + 4 <= last; s += 4)
+    {
+        __m128 h  = _mm_loadu_ps(center + s);
+        __m128 hW = _mm_loadu_ps(center + s - 1);
+        __m128 hE = _mm_loadu_ps(center + s + 1);
+        __m128 hS = _mm_loadu_ps(south + s);
+        __m128 hN = _mm_loadu_ps(north + s);
 
-            // encode for RGBA [0..1]
-            //osg::Vec4f NC( n.x(), n.y(), n.z(), curvature );
-            //NC = (NC + osg::Vec4f(1.0,1.0,1.0,1.0))*0.5;
+        if (out_normals)
+        {
+            float nx[4], ny[4];
+            _mm_storeu_ps(nx, _mm_mul_ps(_mm_sub_ps(hE, hW), negBy));
+            _mm_storeu_ps(ny, _mm_mul_ps(_mm_sub_ps(hN, hS), negAx));
+            for (unsigned k = 0; k < 4; ++k)
+                out_normals[s+k].set(nx[k], ny[k], nz);
+        }
 
-            normalMap->set(s, t, n, curvature);
-            //writeNormal(NC, s, t);
+        if (out_curvatures)
+        {
+            __m128 D = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(hW, hE)), h), vkx);
+            __m128 E = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(hS, hN)), h), vky);
+            __m128 c = _mm_mul_ps(scale, _mm_add_ps(D, E));
+            _mm_storeu_ps(out_curvatures + s, _mm_min_ps(_mm_max_ps(c, lo), hi));
         }
     }
+#endif
+
+    for (; s < last; ++s)
+    {
+        normalAndCurvature(
+            center[s], center[s-1], center[s+1], south[s], north[s],
+            ax, by, kx, ky,
+            out_normals ? out_normals + s : 0L,
+            out_curvatures ? out_curvatures + s : 0L);
+    }
+
+    // east edge:
+    normalAndCurvature(
+        center[last], center[last-1], center[last], south[last], north[last],
+        dx, by, kx, ky,
+        out_normals ? out_normals + last : 0L,
+        out_curvatures ? out_curvatures + last : 0L);
 }
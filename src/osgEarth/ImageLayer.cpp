@@ -340,9 +340,18 @@ ImageLayer::open()
         setTileSourceExpected(false);
     }
 
+    clearChildImages();
+
     return TerrainLayer::open();
 }
 
+void
+ImageLayer::close()
+{
+    clearChildImages();
+    TerrainLayer::close();
+}
+
 void
 ImageLayer::init()
 {
@@ -350,6 +359,10 @@ ImageLayer::init()
 
     _useCreateTexture = false;
 
+    // holds images read for sibling tiles until their own requests arrive
+    _childImages.setMaxSize(64u);
+    _childImagesSourceTime = 0;
+
     // image layers render as a terrain texture.
     setRenderType(RENDERTYPE_TERRAIN_SURFACE);
 
@@ -634,6 +647,10 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
     // map profile, we can try this first.
     if ( cacheBin && policy.isCacheReadable() )
     {
+        METRIC_SCOPED_EX("ImageLayer::readCache", 2,
+                         "key", key.str().c_str(),
+                         "name", getName().c_str());
+
         ReadResult r = cacheBin->readImage(cacheKey, 0L);
         if ( r.succeeded() )
         {
@@ -668,7 +685,15 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
     
     if (key.getProfile()->isHorizEquivalentTo(getProfile()))
     {
-        result = createImageImplementation(key, progress);
+        // Use the result of a sibling batch read if there is one.
+        if ( !takeChildImage(key, result) )
+        {
+            METRIC_SCOPED_EX("ImageLayer::createImageImplementation", 2,
+                             "key", key.str().c_str(),
+                             "name", getName().c_str());
+
+            result = createImageImplementation(key, progress);
+        }
     }
     else
     {
@@ -729,6 +754,121 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
 
 
 
+bool
+ImageLayer::prefetchChildImages(const TileKey&    key,
+                                ProgressCallback* progress)
+{
+    if ( !getEnabled() || getStatus().isError() || useCreateTexture() )
+        return false;
+
+    // Only layers that read straight from a tile source in the key's profile
+    // can split a batch read; everything else goes through createImage.
+    TileSource* source = getTileSource();
+    if ( !source || !isTileSourceExpected() || !getProfile() ||
+         !key.getProfile()->isHorizEquivalentTo(getProfile()) )
+    {
+        return false;
+    }
+
+    const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
+    if ( policy.isCacheOnly() )
+        return false;
+
+    CacheBin* cacheBin = getCacheBin( key.getProfile() );
+
+    // Skip the read unless at least one child actually needs it.
+    bool needed = false;
+    for(unsigned q = 0; q < 4 && !needed; ++q)
+    {
+        TileKey child = key.createChildKey(q);
+
+        if ( !isKeyInLegalRange(child) || !mayHaveData(child) || source->getBlacklist()->contains(child) )
+            continue;
+
+        if ( cacheBin && policy.isCacheReadable() )
+        {
+            std::string cacheKey = Cache::makeCacheKey(
+                Stringify() << child.str() << "-" << child.getProfile()->getHorizSignature(),
+                "image");
+
+            if ( cacheBin->getRecordStatus(cacheKey) == CacheBin::STATUS_OK )
+                continue;
+        }
+
+        needed = true;
+    }
+
+    if ( !needed )
+        return false;
+
+    osg::ref_ptr<TileSource::ImageOperation> op = getOrCreatePreCacheOp();
+
+    osg::ref_ptr<osg::Image> images[4];
+    if ( !source->createChildImages(key, images, op.get(), progress) )
+        return false;
+
+    if (progress && progress->isCanceled())
+        return false;
+
+    // Hold the results for the children's own createImage calls. Children
+    // without data are not stored, so they take the normal path (and get
+    // blacklisted there if the source really has nothing).
+    Threading::ScopedMutexLock lock(_childImagesMutex);
+
+    // images read before the source last changed are stale.
+    TimeStamp sourceTime = source->getLastModifiedTime();
+    if ( sourceTime != _childImagesSourceTime )
+    {
+        _childImages.clear();
+        _childImagesSourceTime = sourceTime;
+    }
+
+    for(unsigned q = 0; q < 4; ++q)
+    {
+        if ( images[q].valid() )
+        {
+            if ( options().featherPixels() == true )
+            {
+                ImageUtils::featherAlphaRegions( images[q].get() );
+            }
+
+            TileKey child = key.createChildKey(q);
+            _childImages.insert( child, GeoImage(images[q].get(), child.getExtent()) );
+        }
+    }
+
+    return true;
+}
+
+bool
+ImageLayer::takeChildImage(const TileKey& key, GeoImage& out_image)
+{
+    Threading::ScopedMutexLock lock(_childImagesMutex);
+
+    TileSource* source = getTileSource();
+    if ( source && source->getLastModifiedTime() != _childImagesSourceTime )
+    {
+        _childImages.clear();
+        return false;
+    }
+
+    LRUCache<TileKey, GeoImage>::Record rec;
+    if ( _childImages.get(key, rec) )
+    {
+        out_image = rec.value();
+        _childImages.erase(key);
+        return true;
+    }
+    return false;
+}
+
+void
+ImageLayer::clearChildImages()
+{
+    Threading::ScopedMutexLock lock(_childImagesMutex);
+    _childImages.clear();
+}
+
 GeoImage
 ImageLayer::createImageFromTileSource(const TileKey&    key,
                                       ProgressCallback* progress)
@@ -958,11 +1098,28 @@ ImageLayer::assembleImage(const TileKey& key, ProgressCallback* progress)
         // same (even though extents are different), then this operation is technically not a
         // reprojection but merely a resampling.
 
-        result = mosaicedImage.reproject( 
-            key.getProfile()->getSRS(),
-            &key.getExtent(), 
-            getTileSize(), getTileSize(),
-            options().driver()->bilinearReprojection().get());
+        const TileSourceOptions& driver = options().driver().get();
+
+        if ( driver.nativeReprojection() == true )
+        {
+            ElevationInterpolation interp = driver.reprojectionInterpolation().isSet() ?
+                driver.reprojectionInterpolation().get() :
+                driver.bilinearReprojection() == true ? INTERP_BILINEAR : INTERP_NEAREST;
+
+            result = mosaicedImage.reprojectNative(
+                key.getProfile()->getSRS(),
+                &key.getExtent(),
+                getTileSize(), getTileSize(),
+                interp);
+        }
+        else
+        {
+            result = mosaicedImage.reproject( 
+                key.getProfile()->getSRS(),
+                &key.getExtent(), 
+                getTileSize(), getTileSize(),
+                driver.bilinearReprojection().get());
+        }
     }
 
     // Process images with full alpha to properly support MP blending.
@@ -17,45 +17,198 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osgEarth/StringUtils>
+#include <osg/Image>
+#include <osg/Shape>
+#include <algorithm>
+#include <climits>
+#include <list>
+#include <map>
+#include <vector>
 
 using namespace osgEarth;
 
 #define LC "[MemCacheBin] "
 
+// maximum number of shards per bin
+#define MAX_SHARDS 8
+
+// fewest entries a shard should hold; small bins use fewer shards
+// so that their LRU order stays meaningful.
+#define MIN_ENTRIES_PER_SHARD 8
+
 //------------------------------------------------------------------------
 
 namespace
 {
-    typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
-    typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
+    /** Approximate memory held by a cached object */
+    size_t getObjectSizeInBytes(const osg::Object* object)
+    {
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if ( image )
+            return sizeof(osg::Image) + image->getTotalSizeInBytesIncludingMipmaps();
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if ( hf )
+            return sizeof(osg::HeightField) + hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+
+        const StringObject* str = dynamic_cast<const StringObject*>(object);
+        if ( str )
+            return sizeof(StringObject) + str->getString().size();
+
+        // unknown; count something so the budget isn't blind to it.
+        return 1024u;
+    }
+
+    unsigned hashString(const std::string& key)
+    {
+        unsigned hash = 2166136261u;
+        for (std::string::const_iterator i = key.begin(); i != key.end(); ++i)
+        {
+            hash ^= (unsigned char)*i;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    struct MemCacheBin;
+
+    /**
+     * Memory budget shared by every MemCacheBin in the process.
+     */
+    struct GlobalBudget
+    {
+        GlobalBudget() : _size(0u), _maxSize(0u), _next(0u)
+        {
+            const char* value = ::getenv("OSGEARTH_L2_CACHE_MAX_SIZE_MB");
+            if ( value )
+            {
+                _maxSize = (size_t)as<unsigned>(std::string(value), 0u) * 1048576u;
+            }
+        }
+
+        void add(size_t bytes)
+        {
+            Threading::ScopedMutexLock lock(_sizeMutex);
+            _size += bytes;
+        }
+
+        void subtract(size_t bytes)
+        {
+            Threading::ScopedMutexLock lock(_sizeMutex);
+            _size -= osg::minimum(bytes, _size);
+        }
+
+        bool isOverBudget() const
+        {
+            Threading::ScopedMutexLock lock(_sizeMutex);
+            return _maxSize > 0u && _size > _maxSize;
+        }
+
+        void registerBin(MemCacheBin* bin)
+        {
+            Threading::ScopedMutexLock lock(_binsMutex);
+            _bins.push_back(bin);
+        }
+
+        void unregisterBin(MemCacheBin* bin)
+        {
+            Threading::ScopedMutexLock lock(_binsMutex);
+            _bins.erase(std::remove(_bins.begin(), _bins.end(), bin), _bins.end());
+        }
+
+        void reclaim(MemCacheBin* origin);
+
+        size_t getSize(const MemCache* owner);
+
+        size_t                    _size;      // protected by _sizeMutex
+        size_t                    _maxSize;
+        mutable Threading::Mutex  _sizeMutex; // leaf lock; never acquire another lock while holding it
+        std::vector<MemCacheBin*> _bins;      // protected by _binsMutex
+        unsigned                  _next;      // protected by _binsMutex
+        Threading::Mutex          _binsMutex; // acquire before any shard lock
+    };
+
+    // never destroyed, since bins may outlive other statics at exit.
+    GlobalBudget& s_budget = *(new GlobalBudget());
 
     struct MemCacheBin : public CacheBin
     {
-        MemCacheBin( const std::string& id, unsigned maxSize )
-            : CacheBin( id ),
-              _lru    ( true /* MT-safe */, maxSize )
+        struct Entry
+        {
+            std::string                     _key;
+            osg::ref_ptr<const osg::Object> _object;
+            Config                          _meta;
+            size_t                          _size;
+        };
+        typedef std::list<Entry> LRUList;
+        typedef std::map<std::string, LRUList::iterator> EntryMap;
+        typedef std::vector< osg::ref_ptr<const osg::Object> > Garbage;
+
+        struct Shard
+        {
+            Shard() : _bytes(0u) { }
+            LRUList                  _lru;      // most recently used first
+            EntryMap                 _entries;
+            size_t                   _bytes;
+            mutable Threading::Mutex _mutex;
+        };
+
+        MemCacheBin( const std::string& id, const MemCache* owner, unsigned maxSize, size_t maxSizeBytes )
+            : CacheBin ( id ),
+              _owner   ( owner ),
+              _maxSize ( maxSize ),
+              _maxBytes( maxSizeBytes )
         {
-            //nop
+            _numShards = 1u;
+            while ( _numShards < MAX_SHARDS && _maxSize / (_numShards*2u) >= MIN_ENTRIES_PER_SHARD )
+                _numShards *= 2u;
+
+            _maxShardSize  = (_maxSize + _numShards - 1u) / _numShards;
+            _maxShardBytes = _maxBytes / _numShards;
+
+            s_budget.registerBin(this);
         }
 
-        ReadResult readObject(const std::string& key, const osgDB::Options*)
+        virtual ~MemCacheBin()
+        {
+            s_budget.unregisterBin(this);
+            purge();
+        }
+
+        Shard& getShard(const std::string& key)
         {
-            MemCacheLRU::Record rec;
-            _lru.get(key, rec);
+            return _shards[hashString(key) & (_numShards-1u)];
+        }
 
-            // clone required since the cache is in memory
+        ReadResult readObject(const std::string& key, const osgDB::Options*)
+        {
+            osg::ref_ptr<const osg::Object> object;
+            Config meta;
+            {
+                Shard& shard = getShard(key);
+                Threading::ScopedMutexLock lock(shard._mutex);
+                EntryMap::iterator i = shard._entries.find(key);
+                if ( i != shard._entries.end() )
+                {
+                    shard._lru.splice(shard._lru.begin(), shard._lru, i->second);
+                    object = i->second->_object.get();
+                    meta = i->second->_meta;
+                }
+            }
 
-            if ( rec.valid() )
+            if ( object.valid() )
             {
-                //OE_INFO << LC << "hits: " << _lru.getStats()._hitRatio*100.0f << "%" << std::endl;
+                ++_hits;
 
-                return ReadResult( 
-                   osg::clone(rec.value().first.get(), osg::CopyOp::DEEP_COPY_ALL),
-                   rec.value().second );
+                // clone required since the cache is in memory
+                return ReadResult(
+                   osg::clone(object.get(), osg::CopyOp::DEEP_COPY_ALL),
+                   meta );
             }
             else
             {
-                //OE_INFO << LC << "hits: " << _lru.getStats()._hitRatio*100.0f << "%" << std::endl;
+                ++_misses;
                 return ReadResult();
             }
         }
@@ -72,49 +225,234 @@ namespace
 
         bool write( const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
         {
-            if ( object ) 
+            if ( !object )
+                return false;
+
+            // clone and measure outside the lock.
+            osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
+            size_t size = getObjectSizeInBytes(cloned.get()) + key.size();
+
+            // evicted objects are released after the lock is dropped.
+            Garbage garbage;
             {
-                osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
-                _lru.insert( key, std::make_pair(cloned.get(), meta) );
-                return true;
+                Shard& shard = getShard(key);
+                Threading::ScopedMutexLock lock(shard._mutex);
+
+                EntryMap::iterator i = shard._entries.find(key);
+                if ( i != shard._entries.end() )
+                {
+                    Entry& entry = *i->second;
+                    garbage.push_back(entry._object.get());
+                    shard._bytes -= entry._size;
+                    s_budget.subtract(entry._size);
+                    entry._object = cloned.get();
+                    entry._meta = meta;
+                    entry._size = size;
+                    shard._lru.splice(shard._lru.begin(), shard._lru, i->second);
+                }
+                else
+                {
+                    shard._lru.push_front(Entry());
+                    Entry& entry = shard._lru.front();
+                    entry._key = key;
+                    entry._object = cloned.get();
+                    entry._meta = meta;
+                    entry._size = size;
+                    shard._entries[key] = shard._lru.begin();
+                }
+
+                shard._bytes += size;
+                s_budget.add(size);
+
+                // enforce this bin's limits, never evicting the new entry itself.
+                while ( shard._lru.size() > 1u &&
+                        (shard._lru.size() > _maxShardSize || (_maxShardBytes > 0u && shard._bytes > _maxShardBytes)) )
+                {
+                    evictOldest(shard, garbage);
+                }
             }
-            else
-                return false;
+
+            if ( s_budget.isOverBudget() )
+            {
+                s_budget.reclaim(this);
+            }
+
+            return true;
+        }
+
+        // call with the shard locked
+        void evictOldest(Shard& shard, Garbage& garbage)
+        {
+            Entry& entry = shard._lru.back();
+            garbage.push_back(entry._object.get());
+            shard._bytes -= entry._size;
+            s_budget.subtract(entry._size);
+            shard._entries.erase(entry._key);
+            shard._lru.pop_back();
+        }
+
+        /** Evicts the least recently used entry of one shard, cycling through
+         *  the shards; returns false if the bin is empty. */
+        bool evictOne()
+        {
+            Garbage garbage;
+            for (unsigned n = 0; n < _numShards; ++n)
+            {
+                Shard& shard = _shards[(unsigned)(++_evictCursor) & (_numShards-1u)];
+                Threading::ScopedMutexLock lock(shard._mutex);
+                if ( !shard._lru.empty() )
+                {
+                    evictOldest(shard, garbage);
+                    return true;
+                }
+            }
+            return false;
         }
 
         bool remove(const std::string& key)
         {
-            _lru.erase(key);
+            Garbage garbage;
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            EntryMap::iterator i = shard._entries.find(key);
+            if ( i != shard._entries.end() )
+            {
+                Entry& entry = *i->second;
+                garbage.push_back(entry._object.get());
+                shard._bytes -= entry._size;
+                s_budget.subtract(entry._size);
+                shard._lru.erase(i->second);
+                shard._entries.erase(i);
+            }
             return true;
         }
 
         bool touch(const std::string& key)
         {
-            // just doing a get will put it at the front of the LRU list
-            MemCacheLRU::Record dummy;
-            return _lru.get(key, dummy);
+            // moves it to the front of the LRU list
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            EntryMap::iterator i = shard._entries.find(key);
+            if ( i != shard._entries.end() )
+            {
+                shard._lru.splice(shard._lru.begin(), shard._lru, i->second);
+                return true;
+            }
+            return false;
         }
 
         RecordStatus getRecordStatus( const std::string& key )
         {
             // ignore minTime; MemCache does not support expiration
-            return _lru.has(key) ? STATUS_OK : STATUS_NOT_FOUND;
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            return shard._entries.find(key) != shard._entries.end() ? STATUS_OK : STATUS_NOT_FOUND;
         }
 
         bool purge()
         {
-            _lru.clear();
+            for (unsigned s = 0; s < _numShards; ++s)
+            {
+                LRUList doomed;
+                {
+                    Shard& shard = _shards[s];
+                    Threading::ScopedMutexLock lock(shard._mutex);
+                    doomed.swap(shard._lru);
+                    shard._entries.clear();
+                    s_budget.subtract(shard._bytes);
+                    shard._bytes = 0u;
+                }
+            }
             return true;
         }
 
+        bool clear()
+        {
+            return purge();
+        }
+
+        unsigned getStorageSize()
+        {
+            size_t bytes = getSizeInBytes();
+            return bytes > (size_t)UINT_MAX ? UINT_MAX : (unsigned)bytes;
+        }
+
         std::string getHashedKey(const std::string& key) const
         {
             return key;
         }
 
-        MemCacheLRU _lru;
+        size_t getSizeInBytes() const
+        {
+            size_t bytes = 0u;
+            for (unsigned s = 0; s < _numShards; ++s)
+            {
+                Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                bytes += _shards[s]._bytes;
+            }
+            return bytes;
+        }
+
+        CacheStats getStats() const
+        {
+            unsigned entries = 0u;
+            for (unsigned s = 0; s < _numShards; ++s)
+            {
+                Threading::ScopedMutexLock lock(_shards[s]._mutex);
+                entries += _shards[s]._entries.size();
+            }
+
+            unsigned hits = _hits, misses = _misses;
+            unsigned queries = hits + misses;
+            return CacheStats(
+                entries, _maxSize, queries, queries > 0u ? (float)hits/(float)queries : 0.0f,
+                hits, misses, getSizeInBytes(), _maxBytes );
+        }
+
+        const MemCache*     _owner;
+        unsigned            _maxSize;
+        size_t              _maxBytes;
+        unsigned            _numShards;
+        unsigned            _maxShardSize;
+        size_t              _maxShardBytes;
+        Shard               _shards[MAX_SHARDS];
+        OpenThreads::Atomic _evictCursor;
+        OpenThreads::Atomic _hits;
+        OpenThreads::Atomic _misses;
     };
-    
+
+    void GlobalBudget::reclaim(MemCacheBin* origin)
+    {
+        Threading::ScopedMutexLock lock(_binsMutex);
+
+        // the bin that pushed us over budget pays first,
+        if ( origin )
+        {
+            while ( isOverBudget() && origin->evictOne() );
+        }
+
+        // then everyone else, round-robin until a full pass frees nothing.
+        for (unsigned n = 0; n < _bins.size() && isOverBudget(); )
+        {
+            MemCacheBin* bin = _bins[_next++ % _bins.size()];
+            if ( bin != origin && bin->evictOne() )
+                n = 0;
+            else
+                ++n;
+        }
+    }
+
+    size_t GlobalBudget::getSize(const MemCache* owner)
+    {
+        Threading::ScopedMutexLock lock(_binsMutex);
+        size_t size = 0u;
+        for (unsigned i = 0; i < _bins.size(); ++i)
+        {
+            if ( _bins[i]->_owner == owner )
+                size += _bins[i]->getSizeInBytes();
+        }
+        return size;
+    }
 
     static Threading::Mutex s_defaultBinMutex;
 }
@@ -122,7 +460,8 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( osg::maximum(maxBinSize, 1u) )
+_maxBinSize     ( osg::maximum(maxBinSize, 1u) ),
+_maxBinSizeBytes( 0u )
 {
     //nop
 }
@@ -130,7 +469,7 @@ _maxBinSize( osg::maximum(maxBinSize, 1u) )
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, new MemCacheBin(binID, this, _maxBinSize, _maxBinSizeBytes) );
 }
 
 CacheBin*
@@ -151,18 +490,61 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = new MemCacheBin("__default", this, _maxBinSize, _maxBinSizeBytes);
         }
     }
 
     return _defaultBin.get();
 }
 
+off_t
+MemCache::getApproximateSize() const
+{
+    return (off_t)s_budget.getSize(this);
+}
+
+CacheStats
+MemCache::getStats(const std::string& binID)
+{
+    MemCacheBin* bin = static_cast<MemCacheBin*>(
+        binID.empty() ? _defaultBin.get() : getBin(binID));
+
+    return bin ? bin->getStats() : CacheStats(0u, _maxBinSize, 0u, 0.0f);
+}
 
 void
 MemCache::dumpStats(const std::string& binID)
 {
-    MemCacheBin* bin = static_cast<MemCacheBin*>(getBin(binID));
-    CacheStats stats = bin->_lru.getStats();
-    OE_INFO << LC << "hit ratio = " << stats._hitRatio << std::endl;
+    CacheStats stats = getStats(binID);
+    OE_INFO << LC << "hit ratio = " << stats._hitRatio
+        << ", entries = " << stats._entries
+        << ", size = " << (stats._bytes/1024u) << " KB" << std::endl;
+}
+
+void
+MemCache::setGlobalMaxSizeBytes(size_t value)
+{
+    {
+        Threading::ScopedMutexLock lock(s_budget._sizeMutex);
+        s_budget._maxSize = value;
+    }
+
+    if ( s_budget.isOverBudget() )
+    {
+        s_budget.reclaim(0L);
+    }
+}
+
+size_t
+MemCache::getGlobalMaxSizeBytes()
+{
+    Threading::ScopedMutexLock lock(s_budget._sizeMutex);
+    return s_budget._maxSize;
+}
+
+size_t
+MemCache::getGlobalSizeBytes()
+{
+    Threading::ScopedMutexLock lock(s_budget._sizeMutex);
+    return s_budget._size;
 }
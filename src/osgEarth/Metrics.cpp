@@ -170,6 +170,19 @@ void Metrics::counter(const std::string& graph,const std::string& name0, double
     }
 }
 
+void Metrics::async(const std::string& name, unsigned id,
+                    osg::Timer_t start, osg::Timer_t end,
+                    const Config& args)
+{
+    if (s_metrics_backend.valid())
+    {
+        s_metrics_backend->async(name, id, start, end, args);
+
+        if (s_metrics_debug)
+            OE_INFO << LC << "async: " << name << " (" << id << ") " << osg::Timer::instance()->delta_m(start, end) << " ms  " << (args.empty() ? "" : args.toJSON(false)) << std::endl;
+    }
+}
+
 MetricsBackend* Metrics::getMetricsBackend()
 {
     return s_metrics_backend.get();
@@ -453,6 +466,56 @@ void ChromeMetricsBackend::counter(const std::string& graph,
 }
 
 
+void ChromeMetricsBackend::async(const std::string& name, unsigned id,
+                                 osg::Timer_t start, osg::Timer_t end,
+                                 const Config& args)
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_mutex);
+
+    // An async begin/end pair; chrome://tracing draws events that share
+    // an id on one track.
+    for (int e = 0; e < 2; ++e)
+    {
+        if (_firstEvent)
+        {
+            _firstEvent = false;
+        }
+        else
+        {
+            _metricsFile << "," << std::endl;
+        }
+
+        _metricsFile << "{"
+            << "\"cat\": \"" << "async" << "\","
+            << "\"pid\": \"" << 0 << "\","
+            << "\"id\": \"" << id << "\","
+            << "\"ts\": \""  << std::setprecision(9) << osg::Timer::instance()->delta_u(_startTime, e == 0 ? start : end) << "\","
+            << "\"ph\": \"" << (e == 0 ? "b" : "e") << "\","
+            << "\"name\": \""  << name << "\"";
+
+        if (e == 0 && !args.empty())
+        {
+            _metricsFile << "," << std::endl << " \"args\": {";
+            bool first = true;
+            for( ConfigSet::const_iterator i = args.children().begin(); i != args.children().end(); ++i ) {
+                if (first)
+                {
+                    first = !first;
+                }
+                else
+                {
+                    _metricsFile << "," << std::endl;
+                }
+                _metricsFile << "\"" << i->key() << "\" : \"" << i->value() << "\"";
+            }
+            _metricsFile << "}";
+        }
+
+        _metricsFile << "}";
+    }
+}
+
+
 
 ScopedMetric::ScopedMetric(const std::string& name) :
 _name(name)
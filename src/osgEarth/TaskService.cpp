@@ -23,6 +23,19 @@ using namespace OpenThreads;
 
 #define LC "[TaskService] "
 
+namespace
+{
+    // Finishes a request that will never run, so that anything waiting on
+    // its progress callback's onCompleted() is released.
+    void discard(TaskRequest* request)
+    {
+        request->cancel();
+        request->setState( TaskRequest::STATE_COMPLETED );
+        if ( request->getProgressCallback() )
+            request->getProgressCallback()->onCompleted();
+    }
+}
+
 //------------------------------------------------------------------------
 
 TaskRequest::TaskRequest( float priority ) :
@@ -67,120 +80,218 @@ TaskRequest::wasCanceled() const
 
 //------------------------------------------------------------------------
 
-TaskRequestQueue::TaskRequestQueue(unsigned int maxSize) :
+TaskRequestQueue::TaskRequestQueue(unsigned int maxSize, unsigned int numShards) :
 osg::Referenced( true ),
+_nextShard( 0u ),
+_size( 0u ),
+_available( 0u ),
+_numWaiting( 0u ),
 _done( false ),
 _maxSize( maxSize ),
 _stamp(0)
 {
-    //nop
+    if ( numShards == 0u )
+        numShards = osg::maximum( 1, OpenThreads::GetNumberOfProcessors() );
+
+    _shards.resize( numShards );
+    for(unsigned i=0; i<numShards; ++i)
+        _shards[i] = new Shard();
 }
 
 void
 TaskRequestQueue::clear()
 {
-    ScopedLock<Mutex> lock(_mutex);
-    _requests.clear();
+    cancel();
 }
 
 void
 TaskRequestQueue::cancel()
 {
-    ScopedLock<Mutex> lock(_mutex);
-    for (TaskRequestPriorityMap::iterator it = _requests.begin(); it != _requests.end(); ++it)
-        (*it).second->cancel();
+    TaskRequestVector dropped;
+
+    for(unsigned i=0; i<_shards.size(); ++i)
+    {
+        Shard* shard = _shards[i].get();
+        ScopedLock<Mutex> lock(shard->_mutex);
+        for (TaskRequestPriorityMap::iterator it = shard->_requests.begin(); it != shard->_requests.end(); ++it)
+        {
+            dropped.push_back( (*it).second.get() );
+            --_available;
+            --_size;
+        }
+        shard->_requests.clear();
+    }
 
-    _requests.clear();
+    // complete them outside the shard locks, since onCompleted() may wake
+    // a thread that adds more requests.
+    for(unsigned i=0; i<dropped.size(); ++i)
+        discard( dropped[i].get() );
+
+    ScopedLock<Mutex> lock(_waitMutex);
+    _notFull.broadcast();
 }
 
 bool
 TaskRequestQueue::isFull() const
 {
-    return _maxSize > 0 && (_maxSize == _requests.size());
+    return _maxSize > 0 && (unsigned)_size >= _maxSize;
 }
 
 bool
 TaskRequestQueue::isEmpty() const
 {
-    return !_done && _requests.empty();
+    return !_done && (unsigned)_available == 0u;
 }
 
 unsigned int
 TaskRequestQueue::getNumRequests() const
 {
-    ScopedLock<Mutex> lock(const_cast<TaskRequestQueue*>(this)->_mutex);
-    return _requests.size();
+    return _size;
 }
 
 void 
 TaskRequestQueue::add( TaskRequest* request )
 {
-    request->setState( TaskRequest::STATE_PENDING );
-
     // install a progress callback if one isn't already installed
     if ( !request->getProgressCallback() )
         request->setProgressCallback( new ProgressCallback() );
 
+    // no thread will ever service a request added after shutdown.
+    if ( _done )
     {
-        // Lock on the add mutex so no one else can add.
-        ScopedLock<Mutex> lock( _mutex );
+        discard( request );
+        return;
+    }
 
-        while(isFull())
-        {
-            _notFull.wait(&_mutex);
-        }
+    request->setState( TaskRequest::STATE_PENDING );
 
-        // Check to make sure the bounded queue is working correctly.
-        if (_maxSize > 0 && _requests.size() > _maxSize)
+    // Reserve a slot before inserting, so the count never falls behind the
+    // shards (pop() decrements as soon as it removes an entry) and concurrent
+    // producers can't overfill a bounded queue. The wait mutex is only
+    // touched when the queue is actually full. Consumers go by _available
+    // instead, which only counts requests that are already in a shard.
+    unsigned size = ++_size;
+    while( _maxSize > 0 && size > _maxSize && !_done )
+    {
+        --_size;
         {
-            OE_NOTICE << "ERROR:  TaskRequestQueue requests " << getNumRequests() << " > max size of " << _maxSize << std::endl;
+            ScopedLock<Mutex> lock( _waitMutex );
+            while( isFull() && !_done )
+            {
+                _notFull.wait( &_waitMutex );
+            }
         }
+        size = ++_size;
+    }
 
-        // insert by priority.
-        _requests.insert( std::pair<float,TaskRequest*>(request->getPriority(), request) );
+    // Check to make sure the bounded queue is working correctly.
+    if ( _maxSize > 0 && size > _maxSize )
+    {
+        OE_NOTICE << LC << "ERROR:  TaskRequestQueue requests " << size << " > max size of " << _maxSize << std::endl;
     }
 
-    //OE_NOTICE << "There are now " << _requests.size() << " tasks" << std::endl;
+    // distribute requests round-robin so that no single shard lock
+    // becomes the bottleneck:
+    Shard* shard = _shards[ (++_nextShard) % _shards.size() ].get();
+    {
+        ScopedLock<Mutex> lock( shard->_mutex );
+
+        // insert by priority, and only then publish it to the consumers.
+        shard->_requests.insert( std::pair<float,TaskRequest*>(request->getPriority(), request) );
+        ++_available;
+    }
 
     // since there is data in the queue, wake up one waiting task thread.
-    _notEmpty.signal(); 
+    // (_numWaiting is incremented under the wait mutex before the waiter
+    // re-checks _available, so either it sees our request or we see it waiting.)
+    if ( (unsigned)_numWaiting > 0u )
+    {
+        ScopedLock<Mutex> lock( _waitMutex );
+        _notEmpty.signal();
+    }
 }
 
-TaskRequest* 
-TaskRequestQueue::get()
+TaskRequest*
+TaskRequestQueue::pop(Shard* shard, bool block)
 {
-    
     osg::ref_ptr<TaskRequest> next;
+
+    if ( block )
+    {
+        shard->_mutex.lock();
+    }
+    else if ( shard->_mutex.trylock() != 0 )
     {
-        ScopedLock<Mutex> lock(_mutex);
+        return 0L;
+    }
 
-        while ( isEmpty() )
-        {                
-            _notEmpty.wait( &_mutex );        
+    if ( !shard->_requests.empty() )
+    {
+        next = shard->_requests.begin()->second.get();
+        shard->_requests.erase( shard->_requests.begin() );
+        --_available;
+    }
+
+    shard->_mutex.unlock();
+
+    if ( next.valid() )
+    {
+        --_size;
+
+        // I'm done, someone else take a turn:
+        if ( _maxSize > 0 )
+        {
+            ScopedLock<Mutex> lock( _waitMutex );
+            _notFull.signal();
         }
+    }
 
-        if ( _done )
+    return next.release();
+}
+
+TaskRequest* 
+TaskRequestQueue::get(unsigned int home)
+{
+    const unsigned numShards = _shards.size();
+    home = home % numShards;
+
+    while( !_done )
+    {
+        // Our own shard first:
+        TaskRequest* next = pop( _shards[home].get(), true );
+        if ( next )
+            return next;
+
+        // Then try to steal from the other shards, skipping any that are busy,
+        // and finally take the locks if there's still work to be had.
+        for(unsigned pass=0; pass<2 && (unsigned)_available > 0u; ++pass)
         {
-            return 0L;
+            for(unsigned i=1; i<numShards; ++i)
+            {
+                next = pop( _shards[(home+i)%numShards].get(), pass == 1 );
+                if ( next )
+                    return next;
+            }
         }
 
-        next = _requests.begin()->second.get(); //_requests.front();
-        _requests.erase( _requests.begin() ); //_requests.pop_front();
+        // Nothing anywhere; park until something arrives.
+        ScopedLock<Mutex> lock( _waitMutex );
+        ++_numWaiting;
+        while ( isEmpty() )
+        {
+            _notEmpty.wait( &_waitMutex );
+        }
+        --_numWaiting;
     }
 
-    // I'm done, someone else take a turn:
-    // (technically this shouldn't be necessary since add() bumps the semaphore once
-    // for each request in the queue)    
-    _notFull.signal();    
-
-    return next.release();
+    return 0L;
 }
 
 void
 TaskRequestQueue::setDone()
 {
     // we need to obtain the mutex since we're using the Condition
-    ScopedLock<Mutex> lock(_mutex);
+    ScopedLock<Mutex> lock(_waitMutex);
 
     _done = true;
 
@@ -196,8 +307,9 @@ TaskRequestQueue::setDone()
 
 //------------------------------------------------------------------------
 
-TaskThread::TaskThread( TaskRequestQueue* queue ) :
+TaskThread::TaskThread( TaskRequestQueue* queue, unsigned int home ) :
 _queue( queue ),
+_home( home ),
 _done( false )
 {
     //nop
@@ -208,10 +320,9 @@ TaskThread::run()
 {
     while( !_done )
     {
-        _request = _queue->get();
-
-        if ( _done )
-            break;
+        // A thread told to stop while it waits still finishes the request
+        // it took, so that the request isn't stranded.
+        _request = _queue->get( _home );
 
         if (_request.valid())
         { 
@@ -285,7 +396,8 @@ TaskService::TaskService( const std::string& name, int numThreads, unsigned int
 osg::Referenced( true ),
 _lastRemoveFinishedThreadsStamp(0),
 _name(name),
-_numThreads( 0 )
+_numThreads( 0 ),
+_nextHome( 0u )
 {
     _queue = new TaskRequestQueue( maxSize );
     setNumThreads( numThreads );
@@ -301,6 +413,14 @@ void
 TaskService::add( TaskRequest* request )
 {   
     //OE_INFO << LC << "TS [" << _name << "] adding request [" << request->getName() << "]" << std::endl;
+
+    // after cancelAll() there are no threads left to run it.
+    if ( _numThreads == 0 )
+    {
+        discard( request );
+        return;
+    }
+
     _queue->add( request );
 }
 
@@ -339,6 +459,9 @@ TaskService::~TaskService()
         (*i)->cancel();
         delete (*i);
     }
+
+    // complete whatever the threads left behind.
+    _queue->cancel();
 }
 
 int
@@ -393,7 +516,7 @@ TaskService::adjustThreadCount()
         //We need to add some threads
         for (int i = 0; i < diff; ++i)
         {
-            TaskThread* thread = new TaskThread( _queue.get() );
+            TaskThread* thread = new TaskThread( _queue.get(), _nextHome++ );
             _threads.push_back( thread );
             thread->start();
         }       
@@ -450,6 +573,9 @@ TaskService::cancelAll()
         _numThreads = 0;
         adjustThreadCount();
 
+        // the threads exit without running what is still queued:
+        _queue->cancel();
+
         OE_INFO << LC << "Cancelled all threads in TaskService [" << _name << "]" << std::endl;
     }
 }
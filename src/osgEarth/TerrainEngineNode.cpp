@@ -318,6 +318,38 @@ TerrainEngineNode::createTileModel(const Map*                   map,
     return model.release();
 }
 
+void
+TerrainEngineNode::createChildTileModels(const Map*                     map,
+                                         const TileKey&                 key,
+                                         const CreateTileModelFilter&   filter,
+                                         ProgressCallback*              progress,
+                                         osg::ref_ptr<TerrainTileModel> out_models[4])
+{
+    TerrainEngineRequirements* requirements = this;
+
+    _tileModelFactory->createChildTileModels(
+        map,
+        key,
+        filter,
+        requirements,
+        progress,
+        out_models);
+
+    Threading::ScopedReadLock sharedLock(_createTileModelCallbacksMutex);
+    for(unsigned q = 0; q < 4; ++q)
+    {
+        if ( out_models[q].valid() )
+        {
+            for(CreateTileModelCallbacks::iterator i = _createTileModelCallbacks.begin();
+                i != _createTileModelCallbacks.end();
+                ++i)
+            {
+                i->get()->onCreateTileModel(this, out_models[q].get());
+            }
+        }
+    }
+}
+
 void 
 TerrainEngineNode::addCreateTileModelCallback(CreateTileModelCallback* callback)
 {
@@ -44,7 +44,8 @@ _debug( false ),
 _binNumber( 0 ),
 _castShadows(true),
 _rangeMode(osg::LOD::DISTANCE_FROM_EYE_POINT),
-_tilePixelSize(256)
+_tilePixelSize(256),
+_concurrentLayerLoading(0u)
 {
     fromConfig( _conf );
 }
@@ -77,6 +78,7 @@ TerrainOptions::getConfig() const
     conf.set( "min_expiry_frames", _minExpiryFrames);
     conf.set( "cast_shadows", _castShadows);
     conf.set( "tile_pixel_size", _tilePixelSize);
+    conf.set( "concurrent_layer_loading", _concurrentLayerLoading);
     conf.set( "range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.set( "range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
 
@@ -108,6 +110,7 @@ TerrainOptions::fromConfig( const Config& conf )
     conf.get( "min_expiry_frames", _minExpiryFrames);
     conf.get( "cast_shadows", _castShadows);
     conf.get( "tile_pixel_size", _tilePixelSize);
+    conf.get( "concurrent_layer_loading", _concurrentLayerLoading);
     conf.get( "range_mode", "PIXEL_SIZE_ON_SCREEN", _rangeMode, osg::LOD::PIXEL_SIZE_ON_SCREEN);
     conf.get( "range_mode", "DISTANCE_FROM_EYE_POINT", _rangeMode, osg::LOD::DISTANCE_FROM_EYE_POINT);
 }
@@ -29,6 +29,99 @@ using namespace osgEarth;
 
 //.........................................................................
 
+namespace
+{
+    /**
+     * Progress callback for a layer fetch running on a worker thread.
+     * It shares cancelation with the tile's own progress callback, but keeps
+     * separate stats because ProgressCallback stats are not thread-safe.
+     */
+    class LayerProgress : public ProgressCallback
+    {
+    public:
+        LayerProgress(ProgressCallback* parent, Threading::MultiEvent* done) :
+            _parent(parent), _done(done)
+        {
+            if (parent)
+                collectStats() = parent->collectStats();
+        }
+
+        bool isCanceled() {
+            return _canceled || (_parent.valid() && _parent->isCanceled());
+        }
+
+        // canceling one layer (e.g., on a recoverable HTTP error) cancels the tile,
+        // just as it would when the layers load one after the other.
+        void cancel() {
+            _canceled = true;
+            if (_parent.valid())
+                _parent->cancel();
+        }
+
+        void onCompleted() {
+            _done->set();
+        }
+
+        // call from the parent's thread after the fetch completes
+        void mergeStats() {
+            if (_parent.valid() && _parent->collectStats()) {
+                Stats& out = _parent->stats();
+                for (Stats::const_iterator i = _stats.begin(); i != _stats.end(); ++i)
+                {
+                    if (i->first != "hfcache_hit_rate")
+                        out[i->first] += i->second;
+                }
+                if (out.find("hfcache_hit_count") != out.end())
+                    out["hfcache_hit_rate"] = out["hfcache_hit_count"]/out["hfcache_try_count"];
+            }
+        }
+
+    private:
+        osg::ref_ptr<ProgressCallback> _parent;
+        Threading::MultiEvent*         _done;
+    };
+}
+
+struct TerrainTileModelFactory::ImageLayerTask : public TaskRequest
+{
+    ImageLayerTask(TerrainTileModelFactory* factory, ImageLayer* layer, const TileKey& key) :
+        _factory(factory), _layer(layer), _key(key) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        if (!progress || !progress->isCanceled())
+            _texture = _factory->createImageLayerTexture(_layer.get(), _key, _matrix, progress);
+    }
+
+    TerrainTileModelFactory*   _factory;
+    osg::ref_ptr<ImageLayer>   _layer;
+    TileKey                    _key;
+    osg::ref_ptr<osg::Texture> _texture;
+    osg::Matrixf               _matrix;
+};
+
+struct TerrainTileModelFactory::ElevationTask : public TaskRequest
+{
+    ElevationTask(TerrainTileModelFactory* factory, TerrainTileModel* model, const Map* map,
+                  const TileKey& key, const CreateTileModelFilter& filter, unsigned border) :
+        _factory(factory), _model(model), _map(map), _key(key), _filter(filter), _border(border) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        if (!progress || !progress->isCanceled())
+            _factory->addElevation(_model.get(), _map.get(), _key, _filter, _border, progress);
+    }
+
+    TerrainTileModelFactory*        _factory;
+    osg::ref_ptr<TerrainTileModel>  _model;
+    osg::ref_ptr<const Map>         _map;
+    TileKey                         _key;
+    CreateTileModelFilter           _filter;
+    unsigned                        _border;
+};
+
+//.........................................................................
+
 TerrainTileModelFactory::TerrainTileModelFactory(const TerrainOptions& options) :
 _options         ( options ),
 _heightFieldCache( true, 128 )
@@ -37,6 +130,12 @@ _heightFieldCache( true, 128 )
 
     // Create an empty texture that we can use as a placeholder
     _emptyTexture = new osg::Texture2D(ImageUtils::createEmptyImage());
+
+    if (_options.concurrentLayerLoading().get() > 0u)
+    {
+        _layerTaskService = new TaskService("TerrainTileModelFactory", _options.concurrentLayerLoading().get());
+        OE_INFO << LC << "Loading tile layers concurrently on " << _options.concurrentLayerLoading().get() << " threads" << std::endl;
+    }
 }
 
 TerrainTileModel*
@@ -51,15 +150,35 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
         key,
         map->getDataModelRevision() );
 
+    bool addElevationLayer = (requirements == 0L || requirements->elevationTexturesRequired());
+    unsigned border = (requirements && requirements->elevationBorderRequired()) ? 1u : 0u;
+
+    // When loading concurrently, fetch the elevation data on a worker while
+    // this thread fetches the color layers (which fan out themselves).
+    osg::ref_ptr<ElevationTask> elevationTask;
+    osg::ref_ptr<LayerProgress> elevationProgress;
+    Threading::MultiEvent elevationDone(1);
+
+    if (addElevationLayer && _layerTaskService.valid())
+    {
+        elevationTask = new ElevationTask(this, model.get(), map, key, filter, border);
+        elevationProgress = new LayerProgress(progress, &elevationDone);
+        elevationTask->setProgressCallback(elevationProgress.get());
+        _layerTaskService->add(elevationTask.get());
+    }
+
     // assemble all the components:
     addColorLayers(model.get(), map, requirements, key, filter, progress);
 
     addPatchLayers(model.get(), map, key, filter, progress);
 
-    if ( requirements == 0L || requirements->elevationTexturesRequired() )
+    if (elevationTask.valid())
+    {
+        elevationDone.wait();
+        elevationProgress->mergeStats();
+    }
+    else if (addElevationLayer)
     {
-        unsigned border = requirements->elevationBorderRequired() ? 1u : 0u;
-
         addElevation( model.get(), map, key, filter, border, progress );
     }
 
@@ -67,6 +186,49 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
     return model.release();
 }
 
+void
+TerrainTileModelFactory::createChildTileModels(const Map*                       map,
+                                               const TileKey&                   key,
+                                               const CreateTileModelFilter&     filter,
+                                               const TerrainEngineRequirements* requirements,
+                                               ProgressCallback*                progress,
+                                               osg::ref_ptr<TerrainTileModel>   out_models[4])
+{
+    OE_START_TIMER(prefetch_child_images);
+
+    // Let each image layer read the whole quad at once. The layer holds on
+    // to the results, and createTileModel picks them up for each child.
+    ImageLayerVector imageLayers;
+    map->getLayers(imageLayers);
+
+    for (ImageLayerVector::const_iterator i = imageLayers.begin(); i != imageLayers.end(); ++i)
+    {
+        ImageLayer* layer = i->get();
+
+        if (layer->getRenderType() != layer->RENDERTYPE_TERRAIN_SURFACE)
+            continue;
+
+        if (!layer->getEnabled() || !filter.accept(layer))
+            continue;
+
+        if (progress && progress->isCanceled())
+            return;
+
+        layer->prefetchChildImages(key, progress);
+    }
+
+    if (progress)
+        progress->stats()["prefetch_child_images_time"] += OE_STOP_TIMER(prefetch_child_images);
+
+    for (unsigned q = 0; q < 4; ++q)
+    {
+        if (progress && progress->isCanceled())
+            return;
+
+        out_models[q] = createTileModel(map, key.createChildKey(q), filter, requirements, progress);
+    }
+}
+
 void
 TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
                                         const Map* map,
@@ -77,11 +239,14 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
 {
     OE_START_TIMER(fetch_image_layers);
 
-    int order = 0;
-
     LayerVector layers;
     map->getLayers(layers);
 
+    // Collect the layers to add, in order, and start fetching their data.
+    std::vector< osg::ref_ptr<Layer> > tileLayers;
+    std::vector< osg::ref_ptr<ImageLayerTask> > tasks;
+    std::vector< osg::ref_ptr<LayerProgress> > taskProgress;
+
     for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
     {
         Layer* layer = i->get();
@@ -95,32 +260,61 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
         if (!filter.accept(layer))
             continue;
 
+        tileLayers.push_back(layer);
+        tasks.push_back(0L);
+
         ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
-        if (imageLayer)
+        if (imageLayer && imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveData(key))
         {
-            osg::Texture* tex = 0L;
-            osg::Matrixf textureMatrix;
+            tasks.back() = new ImageLayerTask(this, imageLayer, key);
+        }
+    }
 
-            if (imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveData(key))
-            {
-                if (imageLayer->useCreateTexture())
-                {
-                    tex = imageLayer->createTexture( key, progress, textureMatrix );
-                }
+    // Run the fetches: on the worker pool if there's more than one, otherwise right here.
+    unsigned numTasks = 0u;
+    for (unsigned i = 0; i < tasks.size(); ++i)
+        if (tasks[i].valid()) ++numTasks;
 
-                else
-                {
-                    GeoImage geoImage = imageLayer->createImage( key, progress );
-           
-                    if ( geoImage.valid() )
-                    {
-                        if ( imageLayer->isCoverage() )
-                            tex = createCoverageTexture(geoImage.getImage(), imageLayer);
-                        else
-                            tex = createImageTexture(geoImage.getImage(), imageLayer);
-                    }
-                }
+    if (_layerTaskService.valid() && numTasks > 1u)
+    {
+        Threading::MultiEvent done(numTasks);
+        for (unsigned i = 0; i < tasks.size(); ++i)
+        {
+            if (tasks[i].valid())
+            {
+                taskProgress.push_back(new LayerProgress(progress, &done));
+                tasks[i]->setProgressCallback(taskProgress.back().get());
+                _layerTaskService->add(tasks[i].get());
             }
+        }
+
+        // Every task must finish (or notice the cancelation) before
+        // we return, since they refer to this tile. The service completes
+        // tasks that it drops without running, so this always returns.
+        done.wait();
+
+        for (unsigned i = 0; i < taskProgress.size(); ++i)
+            taskProgress[i]->mergeStats();
+    }
+    else
+    {
+        for (unsigned i = 0; i < tasks.size(); ++i)
+        {
+            if (tasks[i].valid())
+                (*tasks[i])(progress);
+        }
+    }
+
+    // Assemble the layer models in map order.
+    for (unsigned i = 0; i < tileLayers.size(); ++i)
+    {
+        Layer* layer = tileLayers[i].get();
+
+        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
+        if (imageLayer)
+        {
+            osg::Texture* tex = tasks[i].valid() ? tasks[i]->_texture.get() : 0L;
+            osg::Matrixf textureMatrix = tasks[i].valid() ? tasks[i]->_matrix : osg::Matrixf();
         
             // if this is the first LOD, and the engine requires that the first LOD
             // be populated, make an empty texture if we didn't get one.
@@ -168,6 +362,39 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
         progress->stats()["fetch_imagery_time"] += OE_STOP_TIMER(fetch_image_layers);
 }
 
+osg::Texture*
+TerrainTileModelFactory::createImageLayerTexture(ImageLayer*       imageLayer,
+                                                 const TileKey&    key,
+                                                 osg::Matrixf&     textureMatrix,
+                                                 ProgressCallback* progress)
+{
+    METRIC_SCOPED_EX("TerrainTileModelFactory::createImageLayerTexture", 2,
+                     "key", key.str().c_str(),
+                     "name", imageLayer->getName().c_str());
+
+    osg::Texture* tex = 0L;
+
+    if (imageLayer->useCreateTexture())
+    {
+        tex = imageLayer->createTexture( key, progress, textureMatrix );
+    }
+
+    else
+    {
+        GeoImage geoImage = imageLayer->createImage( key, progress );
+           
+        if ( geoImage.valid() )
+        {
+            if ( imageLayer->isCoverage() )
+                tex = createCoverageTexture(geoImage.getImage(), imageLayer);
+            else
+                tex = createImageTexture(geoImage.getImage(), imageLayer);
+        }
+    }
+
+    return tex;
+}
+
 
 void
 TerrainTileModelFactory::addPatchLayers(TerrainTileModel* model,
@@ -221,6 +448,9 @@ TerrainTileModelFactory::addElevation(TerrainTileModel*            model,
                                       unsigned                     border,
                                       ProgressCallback*            progress)
 {
+    METRIC_SCOPED_EX("TerrainTileModelFactory::addElevation", 1,
+                     "key", key.str().c_str());
+
     // make an elevation layer.
     OE_START_TIMER(fetch_elevation);
 
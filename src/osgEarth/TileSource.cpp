@@ -139,6 +139,7 @@ TileSourceOptions::TileSourceOptions( const ConfigOptions& options ) :
 DriverConfigOptions   ( options ),
 _L2CacheSize          ( 16 ),
 _bilinearReprojection ( true ),
+_nativeReprojection   ( false ),
 _coverage             ( false )
 {
     fromConfig( _conf );
@@ -152,6 +153,10 @@ TileSourceOptions::getConfig() const
     conf.set( "blacklist_filename", _blacklistFilename);
     conf.set( "l2_cache_size", _L2CacheSize );
     conf.set( "bilinear_reprojection", _bilinearReprojection );
+    conf.set( "native_reprojection", _nativeReprojection );
+    conf.set( "reprojection_interpolation", "nearest",  _reprojectionInterpolation, INTERP_NEAREST );
+    conf.set( "reprojection_interpolation", "bilinear", _reprojectionInterpolation, INTERP_BILINEAR );
+    conf.set( "reprojection_interpolation", "cubic",    _reprojectionInterpolation, INTERP_CUBIC );
     conf.set( "coverage", _coverage );
     conf.set( "osg_option_string", _osgOptionString );
     conf.set( "profile", _profileOptions );
@@ -173,6 +178,10 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.get( "blacklist_filename", _blacklistFilename);
     conf.get( "l2_cache_size", _L2CacheSize );
     conf.get( "bilinear_reprojection", _bilinearReprojection );
+    conf.get( "native_reprojection", _nativeReprojection );
+    conf.get( "reprojection_interpolation", "nearest",  _reprojectionInterpolation, INTERP_NEAREST );
+    conf.get( "reprojection_interpolation", "bilinear", _reprojectionInterpolation, INTERP_BILINEAR );
+    conf.get( "reprojection_interpolation", "cubic",    _reprojectionInterpolation, INTERP_CUBIC );
     conf.get( "coverage", _coverage );
     conf.get( "osg_option_string", _osgOptionString );
     conf.get( "profile", _profileOptions );
@@ -348,6 +357,62 @@ TileSource::createImage(const TileKey&        key,
     return newImage.release();
 }
 
+bool
+TileSource::createChildImages(const TileKey&           key,
+                              osg::ref_ptr<osg::Image> out_images[4],
+                              ImageOperation*          prepOp,
+                              ProgressCallback*        progress )
+{
+    if (getStatus().isError())
+        return false;
+
+    // If the L2 cache already holds all four children, we are done:
+    if (_memCache.valid())
+    {
+        unsigned found = 0u;
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            ReadResult r = _memCache->getOrCreateDefaultBin()->readImage(key.createChildKey(q).str(), 0L);
+            if ( r.succeeded() )
+            {
+                out_images[q] = r.releaseImage();
+                ++found;
+            }
+        }
+        if (found == 4u)
+            return true;
+    }
+
+    osg::ref_ptr<osg::Image> newImages[4];
+    if (!createChildImages(key, newImages, progress))
+        return false;
+
+    // Check for cancelation, as in createImage.
+    if (progress && progress->isCanceled())
+    {
+        return false;
+    }
+
+    for (unsigned q = 0; q < 4; ++q)
+    {
+        // keep anything we already found in the L2 cache
+        if (out_images[q].valid())
+            continue;
+
+        if ( prepOp )
+            (*prepOp)( newImages[q] );
+
+        if ( newImages[q].valid() && _memCache.valid() )
+        {
+            _memCache->getOrCreateDefaultBin()->write(key.createChildKey(q).str(), newImages[q].get(), 0L);
+        }
+
+        out_images[q] = newImages[q].get();
+    }
+
+    return true;
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               HeightFieldOperation* prepOp,
@@ -394,6 +459,14 @@ TileSource::createImage(const TileKey&    key,
     return 0L;
 }
 
+bool
+TileSource::createChildImages(const TileKey&           key,
+                              osg::ref_ptr<osg::Image> out_images[4],
+                              ProgressCallback*        progress)
+{
+    return false;
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               ProgressCallback*     progress)
@@ -28,6 +28,8 @@
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <fstream>
+#include <sstream>
+#include <cstdio>
 #include <sys/stat.h>
 
 using namespace osgEarth;
@@ -36,6 +38,8 @@ using namespace osgEarth::Threading;
 
 #ifndef _WIN32
 #   include <unistd.h>
+#else
+#   include <windows.h>
 #endif
 
 #define OSG_FORMAT "osgb"
@@ -71,6 +75,7 @@ namespace
         void init();
 
         std::string _rootPath;
+        bool        _deduplicate;
     };
 
     /** 
@@ -80,7 +85,9 @@ namespace
     class FileSystemCacheBin : public CacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath, bool deduplicate );
+
+        virtual ~FileSystemCacheBin();
 
     public: // CacheBin interface
 
@@ -115,6 +122,19 @@ namespace
 
         const osgDB::Options* mergeOptions(const osgDB::Options* in);
 
+        bool writeDeduplicated(const std::string& base, const osg::Object* object, const osgDB::Options* dbo, osgDB::ReaderWriter::WriteResult& r);
+
+        // path of the shared file holding the content with the given hash
+        std::string getBlobPath(const std::string& hash) const;
+
+        // deletes the record at "base" (path without extension) if it is a
+        // link to a shared file, and the shared file if nothing else links
+        // to it. Returns false if the record isn't shared. Hold the write lock.
+        bool releaseSharedRecord(const std::string& base);
+
+        // time the record at "base" was written or last touched
+        TimeStamp getRecordTime(const std::string& base) const;
+
         bool                              _ok;
         bool                              _binPathExists;
         std::string                       _metaPath;       // full path to the bin's metadata file
@@ -124,8 +144,47 @@ namespace
         osg::ref_ptr<osgDB::Options>      _zlibOptions;
         mutable Threading::ReadWriteMutex _mutex;
         bool                              _debug;
+        bool                              _deduplicate;
+        std::string                       _blobPath;       // full path to the bin's shared content folder
+        unsigned                          _numWrites;      // dedup stats (protected by _mutex)
+        unsigned                          _numSharedWrites;
+        double                            _bytesSaved;
     };
 
+    // Creates a hard link at "linkPath" that refers to the existing file "target".
+    bool makeHardLink( const std::string& target, const std::string& linkPath )
+    {
+#ifdef _WIN32
+        return ::CreateHardLinkA( linkPath.c_str(), target.c_str(), NULL ) != 0;
+#else
+        return ::link( target.c_str(), linkPath.c_str() ) == 0;
+#endif
+    }
+
+    // Deletes a file; returns true on success.
+    bool removeFile( const std::string& path )
+    {
+        return ::remove( path.c_str() ) == 0;
+    }
+
+    // Number of hard links to a file (0 if it doesn't exist).
+    unsigned getLinkCount( const std::string& path )
+    {
+#ifdef _WIN32
+        HANDLE h = ::CreateFileA( path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        if ( h == INVALID_HANDLE_VALUE )
+            return 0u;
+        BY_HANDLE_FILE_INFORMATION info;
+        unsigned count = ::GetFileInformationByHandle( h, &info ) ? (unsigned)info.nNumberOfLinks : 0u;
+        ::CloseHandle( h );
+        return count;
+#else
+        struct stat s;
+        return ::stat( path.c_str(), &s ) == 0 ? (unsigned)s.st_nlink : 0u;
+#endif
+    }
+
     void writeMeta( const std::string& fullPath, const Config& meta )
     {
         std::ofstream outmeta( fullPath.c_str() );
@@ -167,6 +226,7 @@ namespace
     Cache( options )
     {
         FileSystemCacheOptions fsco( options );
+        _deduplicate = fsco.deduplicate().get();
 
         // read the root path from ENV is necessary:
         if ( !fsco.rootPath().isSet())
@@ -189,7 +249,7 @@ namespace
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _deduplicate ) );
     }
 
     CacheBin*
@@ -201,7 +261,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _deduplicate );
             }
         }
         return _defaultBin.get();
@@ -270,13 +330,19 @@ namespace
     }
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
+                                           const std::string&   rootPath,
+                                           bool                 deduplicate) :
     CacheBin            ( binID ),
     _binPathExists      ( false ),
-    _ok( true )
+    _ok( true ),
+    _deduplicate        ( deduplicate ),
+    _numWrites          ( 0u ),
+    _numSharedWrites    ( 0u ),
+    _bytesSaved         ( 0.0 )
     {
         _binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
+        _blobPath = osgDB::concatPaths( _binPath, "_blobs" );
 
         _rw = osgDB::Registry::instance()->getReaderWriterForExtension(OSG_FORMAT);
 
@@ -299,6 +365,16 @@ namespace
         _debug = ::getenv("OSGEARTH_CACHE_DEBUG") != 0L;
     }
 
+    FileSystemCacheBin::~FileSystemCacheBin()
+    {
+        if ( _deduplicate && _numWrites > 0u )
+        {
+            OE_INFO << LC << "Bin [" << getID() << "]: " << _numSharedWrites << " of " << _numWrites
+                << " writes deduplicated (" << (100.0*(double)_numSharedWrites/(double)_numWrites) << "%, "
+                << (_bytesSaved/1048576.0) << " MB saved)" << std::endl;
+        }
+    }
+
     const osgDB::Options*
     FileSystemCacheBin::mergeOptions(const osgDB::Options* dbo)
     {
@@ -334,7 +410,7 @@ namespace
         if ( !osgDB::fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
-        osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);     
+        osgEarth::TimeStamp timeStamp = getRecordTime(fileURI.full());
 
         osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
 
@@ -375,7 +451,7 @@ namespace
         if ( !osgDB::fileExists(path) )
             return ReadResult( ReadResult::RESULT_NOT_FOUND );
 
-        osgEarth::TimeStamp timeStamp = osgEarth::getLastModifiedTime(path);
+        osgEarth::TimeStamp timeStamp = getRecordTime(fileURI.full());
 
         osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(readOptions);
 
@@ -449,7 +525,14 @@ namespace
 
             osg::ref_ptr<const osgDB::Options> dbo = mergeOptions(writeOptions);
 
-            if ( dynamic_cast<const osg::Image*>(object) )
+            // replacing a shared record releases the file it shared:
+            releaseSharedRecord( fileURI.full() );
+
+            if ( _deduplicate )
+            {
+                objWriteOK = writeDeduplicated( fileURI.full(), object, dbo.get(), r );
+            }
+            else if ( dynamic_cast<const osg::Image*>(object) )
             {
                 std::string filename = fileURI.full() + OSG_EXT;
                 r = _rw->writeImage( *static_cast<const osg::Image*>(object), filename, dbo.get() );
@@ -490,6 +573,122 @@ namespace
         return objWriteOK;
     }
 
+    bool
+    FileSystemCacheBin::writeDeduplicated(const std::string&                base,
+                                          const osg::Object*                object,
+                                          const osgDB::Options*             dbo,
+                                          osgDB::ReaderWriter::WriteResult& r)
+    {
+        // Encode to memory so we can hash the result. Must hold the write lock.
+        std::stringstream buf;
+        if ( dynamic_cast<const osg::Image*>(object) )
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, dbo );
+        else if ( dynamic_cast<const osg::Node*>(object) )
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, dbo );
+        else
+            r = _rw->writeObject( *object, buf, dbo );
+
+        if ( !r.success() )
+            return false;
+
+        std::string data = buf.str();
+
+        // Identical records share a single file, named for the hash of its contents.
+        std::string hash = Cache::makeContentHash( data );
+        std::string blob = getBlobPath( hash );
+
+        ++_numWrites;
+
+        if ( osgDB::fileExists(blob) )
+        {
+            ++_numSharedWrites;
+            _bytesSaved += (double)data.size();
+        }
+        else
+        {
+            osgEarth::makeDirectoryForFile( blob );
+            std::ofstream out( blob.c_str(), std::ios::out | std::ios::binary );
+            if ( !out.is_open() )
+                return false;
+            out.write( data.c_str(), data.size() );
+            out.close();
+            if ( out.fail() )
+                return false;
+        }
+
+        if ( _numWrites % 1000u == 0u )
+        {
+            OE_INFO << LC << "Bin [" << getID() << "]: dedup ratio "
+                << (100.0*(double)_numSharedWrites/(double)_numWrites) << "% (" << _numWrites << " writes)" << std::endl;
+        }
+
+        // replace any existing record with a link to the shared file:
+        std::string filename = base + OSG_EXT;
+        removeFile( filename );
+        if ( !makeHardLink(blob, filename) )
+        {
+            // file system doesn't support links; just write a copy.
+            std::ofstream out( filename.c_str(), std::ios::out | std::ios::binary );
+            if ( !out.is_open() )
+                return false;
+            out.write( data.c_str(), data.size() );
+            out.close();
+            if ( out.fail() )
+                return false;
+        }
+
+        // Linked records share one modification time, so each record gets a
+        // small reference file that names its blob and carries its own time.
+        std::ofstream ref( (base + ".ref").c_str(), std::ios::out );
+        if ( !ref.is_open() )
+            return false;
+        ref << hash;
+        ref.close();
+        return !ref.fail();
+    }
+
+    std::string
+    FileSystemCacheBin::getBlobPath(const std::string& hash) const
+    {
+        return osgDB::concatPaths( _blobPath, hash.substr(0, 2) + "/" + hash.substr(2) + OSG_EXT );
+    }
+
+    bool
+    FileSystemCacheBin::releaseSharedRecord(const std::string& base)
+    {
+        std::string ref = base + ".ref";
+        std::ifstream in( ref.c_str() );
+        if ( !in.is_open() )
+            return false;
+
+        std::string hash;
+        in >> hash;
+        in.close();
+
+        removeFile( base + OSG_EXT );
+        removeFile( ref );
+
+        // the blob's own entry in _blobs is the last link once no record uses it.
+        if ( hash.length() > 2u )
+        {
+            std::string blob = getBlobPath( hash );
+            if ( getLinkCount(blob) == 1u )
+                removeFile( blob );
+        }
+
+        return true;
+    }
+
+    TimeStamp
+    FileSystemCacheBin::getRecordTime(const std::string& base) const
+    {
+        std::string ref = base + ".ref";
+        if ( osgDB::fileExists(ref) )
+            return osgEarth::getLastModifiedTime( ref );
+        else
+            return osgEarth::getLastModifiedTime( base + OSG_EXT );
+    }
+
     CacheBin::RecordStatus
     FileSystemCacheBin::getRecordStatus(const std::string& key)
     {
@@ -512,7 +711,9 @@ namespace
         std::string path( fileURI.full() + OSG_EXT );
 
         ScopedWriteLock lock(_mutex);
-        return ::unlink( path.c_str() ) == 0;
+        if ( releaseSharedRecord(fileURI.full()) )
+            return true;
+        return removeFile( path );
     }
 
     bool
@@ -522,8 +723,11 @@ namespace
         URI fileURI( key, _metaPath );
         std::string path( fileURI.full() + OSG_EXT );
 
+        // touch only this record; a shared record's data file belongs to others too.
+        std::string ref( fileURI.full() + ".ref" );
+
         ScopedWriteLock lock(_mutex);
-        return osgEarth::touchFile( path );
+        return osgEarth::touchFile( osgDB::fileExists(ref) ? ref : path );
     }
 
     bool
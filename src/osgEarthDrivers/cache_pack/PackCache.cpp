@@ -0,0 +1,184 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCache"
+#include "PackCacheBin"
+#include <osgEarth/URI>
+#include <osgEarth/FileUtils>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/ObjectWrapper>
+
+#define LC "[PackCache] "
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+using namespace osgEarth::Drivers::PackCache;
+
+
+PackCacheImpl::PackCacheImpl( const CacheOptions& options ) :
+osgEarth::Cache( options ),
+_options       ( options )
+{
+    // Force OSG to initialize the image wrapper. Failure to do this can result
+    // in a race condition within OSG when the cache is accessed from multiple threads.
+    osgDB::ObjectWrapperManager* owm = osgDB::Registry::instance()->getObjectWrapperManager();
+    owm->findWrapper("osg::Image");
+    owm->findWrapper("osg::HeightField");
+
+    if ( _options.rootPath().isSet() )
+    {
+        _rootPath = URI( *_options.rootPath(), options.referrer() ).full();
+    }
+    else
+    {
+        // read the root path from ENV is necessary:
+        const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
+        if ( cachePath )
+        {
+            _rootPath = cachePath;
+            OE_INFO << LC << "Cache location set from environment: \""
+                << cachePath << "\"" << std::endl;
+        }
+    }
+
+    if ( _rootPath.empty() )
+    {
+        OE_WARN << LC << "Illegal: no root path set for cache!" << std::endl;
+    }
+    else if ( !osgDB::fileExists(_rootPath) && !osgEarth::makeDirectory(_rootPath) )
+    {
+        OE_WARN << LC << "Failed to create root cache folder \"" << _rootPath << "\"" << std::endl;
+        _rootPath.clear();
+    }
+    else
+    {
+        OE_INFO << LC << "Opened a cache at \"" << _rootPath << "\"" << std::endl;
+    }
+}
+
+PackCacheImpl::~PackCacheImpl()
+{
+    //nop
+}
+
+PackCacheBin*
+PackCacheImpl::createBin( const std::string& binID )
+{
+    // Each bin owns its index file, so never construct two bins for the same ID.
+    osg::ref_ptr<PackCacheBin> bin = new PackCacheBin( binID, _rootPath, _options );
+    if ( !bin->isOK() )
+        return 0L;
+
+    _allBins.push_back( bin.get() );
+    return bin.get();
+}
+
+CacheBin*
+PackCacheImpl::addBin( const std::string& binID )
+{
+    if ( _rootPath.empty() )
+        return 0L;
+
+    ScopedMutexLock lock( _binsMutex );
+
+    CacheBin* bin = _bins.get( binID );
+    if ( !bin )
+    {
+        bin = createBin( binID );
+        if ( bin )
+            _bins.getOrCreate( binID, bin );
+    }
+    return bin;
+}
+
+CacheBin*
+PackCacheImpl::getOrCreateDefaultBin()
+{
+    if ( _rootPath.empty() )
+        return 0L;
+
+    ScopedMutexLock lock( _binsMutex );
+
+    if ( !_defaultBin.valid() )
+    {
+        _defaultBin = createBin( "_default" );
+    }
+    return _defaultBin.get();
+}
+
+void
+PackCacheImpl::removeBin( CacheBin* bin )
+{
+    ScopedMutexLock lock( _binsMutex );
+
+    _bins.remove( bin );
+
+    for (std::vector< osg::ref_ptr<PackCacheBin> >::iterator i = _allBins.begin(); i != _allBins.end(); ++i)
+    {
+        if ( i->get() == bin )
+        {
+            _allBins.erase( i );
+            break;
+        }
+    }
+}
+
+off_t
+PackCacheImpl::getApproximateSize() const
+{
+    ScopedMutexLock lock( _binsMutex );
+
+    uint64_t size = 0u;
+    for (unsigned i = 0; i < _allBins.size(); ++i)
+        size += _allBins[i]->getStorageSize64();
+
+    return (off_t)size;
+}
+
+bool
+PackCacheImpl::compact()
+{
+    std::vector< osg::ref_ptr<PackCacheBin> > bins;
+    {
+        ScopedMutexLock lock( _binsMutex );
+        bins = _allBins;
+    }
+
+    bool ok = !bins.empty();
+    for (unsigned i = 0; i < bins.size(); ++i)
+        ok = bins[i]->compact() && ok;
+
+    return ok;
+}
+
+bool
+PackCacheImpl::clear()
+{
+    std::vector< osg::ref_ptr<PackCacheBin> > bins;
+    {
+        ScopedMutexLock lock( _binsMutex );
+        bins = _allBins;
+    }
+
+    bool ok = !bins.empty();
+    for (unsigned i = 0; i < bins.size(); ++i)
+        ok = bins[i]->clear() && ok;
+
+    return ok;
+}
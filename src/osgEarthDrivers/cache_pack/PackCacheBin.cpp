@@ -0,0 +1,977 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCacheBin"
+#include <osgEarth/Registry>
+#include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarth/DateTime>
+#include <osgDB/Registry>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Threading;
+using namespace osgEarth::Drivers::PackCache;
+
+#undef  LC
+#define LC "[PackCacheBin] "
+
+// rehash when the index is this full:
+#define MAX_LOAD_FACTOR 0.7
+
+// writes between checks for compaction candidates:
+#define COMPACTION_CHECK_PERIOD 64
+
+namespace
+{
+    uint64_t nextPowerOfTwo(uint64_t n)
+    {
+        uint64_t p = 1u;
+        while ( p < n ) p <<= 1;
+        return p;
+    }
+}
+
+//........................................................................
+
+void
+PackCacheBin::Compactor::run()
+{
+    _bin->compactPacks(false);
+    _bin->_compacting.exchange(0);
+}
+
+//........................................................................
+
+PackCacheBin::PackCacheBin(const std::string&      binID,
+                           const std::string&      rootPath,
+                           const PackCacheOptions& options) :
+osgEarth::CacheBin( binID ),
+_ok       ( false ),
+_debug    ( ::getenv("OSGEARTH_CACHE_DEBUG") != 0L ),
+_dirty    ( false ),
+_options  ( options ),
+_compactor( 0L )
+{
+    _binPath   = osgDB::concatPaths( rootPath, binID );
+    _indexPath = osgDB::concatPaths( _binPath, "index" );
+    _metaPath  = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
+    _packSize  = (uint64_t)osg::maximum(_options.packSizeMB().get(), 1u) * 1048576u;
+
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+
+    _ok = _rw.valid() && open();
+}
+
+PackCacheBin::~PackCacheBin()
+{
+    _closing.exchange(1);
+    {
+        ScopedMutexLock lock(_compactorMutex);
+        if ( _compactor )
+        {
+            _compactor->join();
+            delete _compactor;
+            _compactor = 0L;
+        }
+    }
+    close();
+}
+
+std::string
+PackCacheBin::packFilename(unsigned id) const
+{
+    return osgDB::concatPaths( _binPath, Stringify() << std::setw(8) << std::setfill('0') << id << ".pack" );
+}
+
+bool
+PackCacheBin::open()
+{
+    if ( !osgDB::fileExists(_binPath) )
+    {
+        osgEarth::makeDirectory( _binPath );
+    }
+
+    ScopedMutexLock writeLock( _writeMutex );
+    ScopedWriteLock indexLock( _indexMutex );
+
+    bool ok = openIndex() || rebuildIndex();
+    if ( !ok )
+    {
+        OE_WARN << LC << "Failed to open cache bin at " << _binPath << std::endl;
+        return false;
+    }
+
+    if ( !_packs.empty() )
+    {
+        _activePack = _packs.rbegin()->second.get();
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Opened bin " << getID() << ": " << _index.header()->count << " records in "
+            << _packs.size() << " pack(s)" << std::endl;
+    }
+
+    return true;
+}
+
+bool
+PackCacheBin::openIndex()
+{
+    if ( !_index.open(_indexPath) )
+        return false;
+
+    IndexHeader* header = _index.header();
+    if ( header->clean != 1u )
+    {
+        OE_WARN << LC << "Bin " << getID() << " was not closed cleanly" << std::endl;
+        _index.close();
+        return false;
+    }
+
+    for (unsigned i = 0; i < header->numPacks; ++i)
+    {
+        const PackEntry& entry = header->packs[i];
+        osg::ref_ptr<Pack> pack = Pack::open( packFilename(entry.id), entry.id, entry.tail );
+        if ( !pack.valid() )
+        {
+            _packs.clear();
+            _index.close();
+            return false;
+        }
+        _packs[entry.id] = pack.get();
+        _liveBytes[entry.id] = 0u;
+    }
+
+    // tally up the live bytes in each pack so we know when to compact.
+    const IndexSlot* slots = _index.slots();
+    for (uint64_t i = 0; i < header->capacity; ++i)
+    {
+        if ( slots[i].state == SLOT_LIVE )
+            _liveBytes[slots[i].pack] += slots[i].length;
+    }
+
+    return true;
+}
+
+bool
+PackCacheBin::rebuildIndex()
+{
+    OE_WARN << LC << "Rebuilding index for bin " << getID() << " from its pack files" << std::endl;
+
+    _index.close();
+    _packs.clear();
+    _liveBytes.clear();
+
+    uint64_t capacity = nextPowerOfTwo( osg::maximum(_options.indexCapacity().get(), 16u) );
+    if ( !_index.create(_indexPath, capacity) )
+        return false;
+
+    // find the pack files and replay them in order.
+    std::vector<unsigned> ids;
+    osgDB::DirectoryContents files = osgDB::getDirectoryContents( _binPath );
+    for (osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        if ( osgDB::getLowerCaseFileExtension(*f) == "pack" )
+        {
+            ids.push_back( as<unsigned>(osgDB::getNameLessExtension(*f), 0u) );
+        }
+    }
+    std::sort( ids.begin(), ids.end() );
+
+    IndexHeader* header = _index.header();
+    header->clean = 0u;
+
+    unsigned numRecords = 0u;
+    for (unsigned i = 0; i < ids.size(); ++i)
+    {
+        unsigned id = ids[i];
+        osg::ref_ptr<Pack> pack = Pack::open( packFilename(id), id, ~(uint64_t)0 );
+        if ( !pack.valid() )
+            continue;
+
+        pack->recover();
+        _packs[id] = pack.get();
+        _liveBytes[id] = 0u;
+        addPackEntry( id );
+        setPackTail( id, pack->getTail() );
+        header = _index.header();
+        header->nextPackID = id + 1u;
+
+        Record record;
+        for (uint64_t offset = 0; offset < pack->getTail(); offset += record.length)
+        {
+            if ( !pack->getRecord(offset, record) )
+                break;
+            applyRecord( pack.get(), offset, record );
+            ++numRecords;
+        }
+    }
+
+    header = _index.header();
+    header->clean = 1u;
+    _index.sync();
+
+    OE_WARN << LC << "Rebuilt index for bin " << getID() << ": " << header->count << " records ("
+        << numRecords << " replayed) in " << _packs.size() << " pack(s)" << std::endl;
+
+    return true;
+}
+
+void
+PackCacheBin::close()
+{
+    ScopedMutexLock writeLock( _writeMutex );
+    ScopedWriteLock indexLock( _indexMutex );
+
+    if ( !_index.valid() )
+        return;
+
+    // make sure every record the index refers to is on disk before
+    // declaring the index clean.
+    bool synced = true;
+    for (Packs::iterator i = _packs.begin(); i != _packs.end(); ++i)
+    {
+        synced = i->second->sync() && synced;
+        setPackTail( i->first, i->second->getTail() );
+    }
+
+    if ( _dirty && synced )
+    {
+        _index.sync();
+        _index.header()->clean = 1u;
+    }
+    _index.sync();
+    _index.close();
+
+    _activePack = 0L;
+    _packs.clear();
+}
+
+//........................................................................
+
+IndexSlot*
+PackCacheBin::findSlot(const std::string& key, uint64_t hash) const
+{
+    const uint64_t capacity = _index.capacity();
+    const uint64_t mask = capacity - 1u;
+    IndexSlot* slots = _index.slots();
+
+    for (uint64_t i = 0, p = hash & mask; i < capacity; ++i, p = (p + 1u) & mask)
+    {
+        IndexSlot& slot = slots[p];
+
+        if ( slot.state == SLOT_EMPTY )
+            return 0L;
+
+        if ( slot.state == SLOT_LIVE && slot.keyHash == hash )
+        {
+            // confirm it's not a hash collision by checking the key in the record itself.
+            Packs::const_iterator pack = _packs.find( slot.pack );
+            Record record;
+            if ( pack != _packs.end() &&
+                 pack->second->getRecord(slot.offset, record) &&
+                 record.header->keyLength == key.length() &&
+                 memcmp(record.key, key.data(), key.length()) == 0 )
+            {
+                return &slot;
+            }
+        }
+    }
+    return 0L;
+}
+
+IndexSlot*
+PackCacheBin::insertSlot(uint64_t hash)
+{
+    IndexHeader* header = _index.header();
+    if ( (double)(header->used + 1u) > MAX_LOAD_FACTOR * (double)header->capacity )
+    {
+        // grow, unless clearing out deleted slots would make enough room.
+        uint64_t capacity = header->capacity;
+        while ( (double)(header->count + 1u) > 0.5 * (double)capacity )
+            capacity *= 2u;
+
+        if ( !rehash(capacity) )
+            return 0L;
+
+        header = _index.header();
+    }
+
+    const uint64_t capacity = header->capacity;
+    const uint64_t mask = capacity - 1u;
+    IndexSlot* slots = _index.slots();
+
+    for (uint64_t i = 0, p = hash & mask; i < capacity; ++i, p = (p + 1u) & mask)
+    {
+        IndexSlot& slot = slots[p];
+        if ( slot.state != SLOT_LIVE )
+        {
+            if ( slot.state == SLOT_EMPTY )
+                ++header->used;
+            ++header->count;
+            slot.keyHash = hash;
+            slot.state = SLOT_LIVE;
+            return &slot;
+        }
+    }
+    return 0L;
+}
+
+bool
+PackCacheBin::rehash(uint64_t capacity)
+{
+    std::string tempPath = _indexPath + ".tmp";
+
+    PackIndex fresh;
+    if ( !fresh.create(tempPath, capacity) )
+    {
+        OE_WARN << LC << "Failed to grow index for bin " << getID() << std::endl;
+        return false;
+    }
+
+    const IndexHeader* oldHeader = _index.header();
+    IndexHeader* newHeader = fresh.header();
+    newHeader->clean      = oldHeader->clean;
+    newHeader->numPacks   = oldHeader->numPacks;
+    newHeader->nextPackID = oldHeader->nextPackID;
+    memcpy( newHeader->packs, oldHeader->packs, sizeof(oldHeader->packs) );
+
+    const uint64_t mask = capacity - 1u;
+    const IndexSlot* oldSlots = _index.slots();
+    IndexSlot* newSlots = fresh.slots();
+
+    for (uint64_t i = 0; i < oldHeader->capacity; ++i)
+    {
+        if ( oldSlots[i].state != SLOT_LIVE )
+            continue;
+
+        uint64_t p = oldSlots[i].keyHash & mask;
+        while ( newSlots[p].state != SLOT_EMPTY )
+            p = (p + 1u) & mask;
+
+        newSlots[p] = oldSlots[i];
+        ++newHeader->count;
+        ++newHeader->used;
+    }
+
+    fresh.sync();
+    fresh.close();
+    _index.close();
+
+    ::remove( _indexPath.c_str() );
+    if ( ::rename(tempPath.c_str(), _indexPath.c_str()) != 0 || !_index.open(_indexPath) )
+    {
+        OE_WARN << LC << "Failed to replace index for bin " << getID() << std::endl;
+        _ok = false;
+        return false;
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": index grown to " << capacity << " slots" << std::endl;
+    }
+
+    return true;
+}
+
+void
+PackCacheBin::applyRecord(Pack* pack, uint64_t offset, const Record& record)
+{
+    std::string key( record.key, record.header->keyLength );
+    uint64_t hash = hashKey( key );
+
+    IndexSlot* slot = findSlot( key, hash );
+
+    switch( record.header->type )
+    {
+    case RECORD_DATA:
+        if ( slot )
+            _liveBytes[slot->pack] -= slot->length;
+        else
+            slot = insertSlot( hash );
+
+        if ( slot )
+        {
+            slot->pack      = pack->getID();
+            slot->offset    = offset;
+            slot->length    = record.length;
+            slot->timestamp = record.header->timestamp;
+            _liveBytes[slot->pack] += slot->length;
+        }
+        break;
+
+    case RECORD_TOMBSTONE:
+        if ( slot )
+        {
+            _liveBytes[slot->pack] -= slot->length;
+            slot->state = SLOT_DELETED;
+            --_index.header()->count;
+        }
+        break;
+
+    case RECORD_TOUCH:
+        if ( slot )
+            slot->timestamp = record.header->timestamp;
+        break;
+    }
+}
+
+void
+PackCacheBin::addPackEntry(unsigned id)
+{
+    IndexHeader* header = _index.header();
+    PackEntry& entry = header->packs[header->numPacks++];
+    entry.id = id;
+    entry.reserved = 0u;
+    entry.tail = 0u;
+}
+
+void
+PackCacheBin::removePackEntry(unsigned id)
+{
+    IndexHeader* header = _index.header();
+    for (unsigned i = 0; i < header->numPacks; ++i)
+    {
+        if ( header->packs[i].id == id )
+        {
+            for (unsigned j = i+1; j < header->numPacks; ++j)
+                header->packs[j-1] = header->packs[j];
+            --header->numPacks;
+            return;
+        }
+    }
+}
+
+void
+PackCacheBin::setPackTail(unsigned id, uint64_t tail)
+{
+    // the active pack is usually last, so search backwards.
+    IndexHeader* header = _index.header();
+    for (int i = (int)header->numPacks - 1; i >= 0; --i)
+    {
+        if ( header->packs[i].id == id )
+        {
+            header->packs[i].tail = tail;
+            return;
+        }
+    }
+}
+
+//........................................................................
+
+void
+PackCacheBin::markDirty()
+{
+    if ( !_dirty )
+    {
+        ScopedWriteLock indexLock( _indexMutex );
+        _index.header()->clean = 0u;
+        _index.sync();
+        _dirty = true;
+    }
+}
+
+Pack*
+PackCacheBin::getActivePack(uint32_t length)
+{
+    if ( _activePack.valid() && _activePack->hasRoom(length) )
+        return _activePack.get();
+
+    ScopedWriteLock indexLock( _indexMutex );
+
+    IndexHeader* header = _index.header();
+    if ( header->numPacks >= PACK_INDEX_MAX_PACKS )
+    {
+        OE_WARN << LC << "Bin " << getID() << " has reached its limit of " << PACK_INDEX_MAX_PACKS << " pack files" << std::endl;
+        return 0L;
+    }
+
+    // seal the old pack; its records must be durable before compaction can
+    // ever delete the source of a copied record.
+    if ( _activePack.valid() )
+    {
+        _activePack->sync();
+    }
+
+    unsigned id = header->nextPackID++;
+    osg::ref_ptr<Pack> pack = Pack::create( packFilename(id), id, osg::maximum(_packSize, (uint64_t)length) );
+    if ( !pack.valid() )
+        return 0L;
+
+    _packs[id] = pack.get();
+    _liveBytes[id] = 0u;
+    addPackEntry( id );
+    _activePack = pack.get();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": started pack " << pack->getFilename() << std::endl;
+    }
+
+    return _activePack.get();
+}
+
+bool
+PackCacheBin::appendRecord(RecordType type, const std::string& key, const std::string& meta, const std::string& data, int64_t timestamp)
+{
+    Pack* pack = getActivePack( Pack::recordLength(key, meta, data) );
+    if ( !pack )
+        return false;
+
+    uint64_t offset;
+    uint32_t length;
+    if ( !pack->append(type, key, meta, data, timestamp, offset, length) )
+        return false;
+
+    // publish the record in the index.
+    ScopedWriteLock indexLock( _indexMutex );
+    setPackTail( pack->getID(), pack->getTail() );
+
+    Record record;
+    if ( !pack->getRecord(offset, record) )
+        return false;
+
+    applyRecord( pack, offset, record );
+    return true;
+}
+
+//........................................................................
+
+ReadResult
+PackCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
+{
+    return read(key, ImageReader(_rw.get(), readOptions));
+}
+
+ReadResult
+PackCacheBin::readObject(const std::string& key, const osgDB::Options* readOptions)
+{
+    return read(key, ObjectReader(_rw.get(), readOptions));
+}
+
+ReadResult
+PackCacheBin::readString(const std::string& key, const osgDB::Options* readOptions)
+{
+    ReadResult r = readObject(key, readOptions);
+    if ( r.succeeded() )
+    {
+        if ( r.get<StringObject>() )
+            return r;
+        else
+            return ReadResult();
+    }
+    else
+    {
+        return r;
+    }
+}
+
+ReadResult
+PackCacheBin::read(const std::string& key, const Reader& reader)
+{
+    if ( !_ok )
+        return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+    // Find the record; holding a reference to its pack keeps the mapping
+    // alive even if compaction retires the pack while we're decoding.
+    osg::ref_ptr<Pack> pack;
+    uint64_t offset;
+    int64_t timestamp;
+    {
+        ScopedReadLock indexLock( _indexMutex );
+        const IndexSlot* slot = findSlot( key, hashKey(key) );
+        if ( !slot )
+            return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+        Packs::const_iterator i = _packs.find( slot->pack );
+        if ( i != _packs.end() )
+            pack = i->second.get();
+        offset = slot->offset;
+        timestamp = slot->timestamp;
+    }
+
+    Record record;
+    if ( !pack.valid() || !pack->getRecord(offset, record) )
+        return ReadResult(ReadResult::RESULT_READER_ERROR);
+
+    // decode straight out of the mapped pack file.
+    MemoryStreamBuf buf( record.data, record.header->dataLength );
+    std::istream datastream( &buf );
+    osgDB::ReaderWriter::ReadResult r = reader.read( datastream );
+    if ( !r.success() )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": failed to decode (" << key << "): " << r.message() << std::endl;
+        return ReadResult(ReadResult::RESULT_READER_ERROR);
+    }
+
+    Config metadata;
+    if ( record.header->metaLength > 0u )
+    {
+        metadata.fromJSON( std::string(record.meta, record.header->metaLength) );
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": read (" << key << ")" << std::endl;
+    }
+
+    ReadResult rr( r.getObject(), metadata );
+    rr.setLastModifiedTime( (TimeStamp)timestamp );
+    return rr;
+}
+
+bool
+PackCacheBin::write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+{
+    if ( !_ok || !object )
+        return false;
+
+    osgDB::ReaderWriter::WriteResult r;
+    std::stringstream datastream;
+
+    if ( dynamic_cast<const osg::Image*>(object) )
+        r = _rw->writeImage( *static_cast<const osg::Image*>(object), datastream, writeOptions );
+    else if ( dynamic_cast<const osg::Node*>(object) )
+        r = _rw->writeNode( *static_cast<const osg::Node*>(object), datastream, writeOptions );
+    else
+        r = _rw->writeObject( *object, datastream, writeOptions );
+
+    bool ok = r.success();
+    if ( ok )
+    {
+        std::string metastring = meta.empty() ? std::string() : meta.toJSON(false);
+
+        ScopedMutexLock writeLock( _writeMutex );
+        markDirty();
+        ok = appendRecord( RECORD_DATA, key, metastring, datastream.str(), (int64_t)DateTime().asTimeStamp() );
+    }
+
+    if ( !ok )
+    {
+        OE_WARN << LC << "Bin " << getID() << ": FAILED to write (" << key << "); msg = \""
+            << r.message() << "\"" << std::endl;
+        return false;
+    }
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": wrote (" << key << ")" << std::endl;
+    }
+
+    if ( (++_writes % COMPACTION_CHECK_PERIOD) == 0u && _options.backgroundCompaction() == true )
+    {
+        startBackgroundCompaction();
+    }
+
+    return true;
+}
+
+CacheBin::RecordStatus
+PackCacheBin::getRecordStatus(const std::string& key)
+{
+    if ( !_ok )
+        return STATUS_NOT_FOUND;
+
+    ScopedReadLock indexLock( _indexMutex );
+    return findSlot(key, hashKey(key)) ? STATUS_OK : STATUS_NOT_FOUND;
+}
+
+bool
+PackCacheBin::remove(const std::string& key)
+{
+    if ( getRecordStatus(key) != STATUS_OK )
+        return false;
+
+    // a tombstone makes the removal survive an index rebuild.
+    ScopedMutexLock writeLock( _writeMutex );
+    markDirty();
+    return appendRecord( RECORD_TOMBSTONE, key, std::string(), std::string(), (int64_t)DateTime().asTimeStamp() );
+}
+
+bool
+PackCacheBin::touch(const std::string& key)
+{
+    if ( getRecordStatus(key) != STATUS_OK )
+        return false;
+
+    ScopedMutexLock writeLock( _writeMutex );
+    markDirty();
+    return appendRecord( RECORD_TOUCH, key, std::string(), std::string(), (int64_t)DateTime().asTimeStamp() );
+}
+
+bool
+PackCacheBin::clear()
+{
+    if ( !_ok )
+        return false;
+
+    ScopedMutexLock writeLock( _writeMutex );
+    ScopedWriteLock indexLock( _indexMutex );
+
+    // packs are deleted as soon as any in-progress reads let go of them,
+    // so keep counting pack IDs from where we were to avoid reusing a name.
+    unsigned nextPackID = _index.header()->nextPackID;
+
+    for (Packs::iterator i = _packs.begin(); i != _packs.end(); ++i)
+    {
+        i->second->setObsolete();
+    }
+    _packs.clear();
+    _liveBytes.clear();
+    _activePack = 0L;
+
+    uint64_t capacity = nextPowerOfTwo( osg::maximum(_options.indexCapacity().get(), 16u) );
+    _ok = _index.create( _indexPath, capacity );
+    if ( _ok )
+    {
+        _index.header()->nextPackID = nextPackID;
+        _index.sync();
+    }
+    _dirty = false;
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Cleared bin " << getID() << std::endl;
+    }
+
+    return _ok;
+}
+
+//........................................................................
+
+bool
+PackCacheBin::hasCompactionCandidates(bool all) const
+{
+    ScopedReadLock indexLock( _indexMutex );
+
+    float threshold = osg::clampBetween( _options.compactionThreshold().get(), 0.0f, 1.0f );
+
+    // never compact the newest pack; it's still being written.
+    for (Packs::const_iterator i = _packs.begin(); i != _packs.end() && i->first != _packs.rbegin()->first; ++i)
+    {
+        LiveBytes::const_iterator live = _liveBytes.find( i->first );
+        uint64_t dead = i->second->getTail() - (live != _liveBytes.end() ? live->second : 0u);
+        if ( dead > 0u && (all || (double)dead >= (double)threshold * (double)i->second->getCapacity()) )
+            return true;
+    }
+    return false;
+}
+
+void
+PackCacheBin::startBackgroundCompaction()
+{
+    if ( _compacting.exchange(1) != 0 )
+        return;
+
+    if ( _closing != 0 || !hasCompactionCandidates(false) )
+    {
+        _compacting.exchange(0);
+        return;
+    }
+
+    ScopedMutexLock lock( _compactorMutex );
+    if ( _compactor )
+    {
+        _compactor->join();
+        delete _compactor;
+    }
+    _compactor = new Compactor( this );
+    _compactor->start();
+}
+
+bool
+PackCacheBin::compact()
+{
+    if ( !_ok )
+        return false;
+
+    compactPacks( true );
+    return true;
+}
+
+void
+PackCacheBin::compactPacks(bool all)
+{
+    float threshold = osg::clampBetween( _options.compactionThreshold().get(), 0.0f, 1.0f );
+
+    std::vector<unsigned> candidates;
+    {
+        ScopedReadLock indexLock( _indexMutex );
+        for (Packs::const_iterator i = _packs.begin(); i != _packs.end() && i->first != _packs.rbegin()->first; ++i)
+        {
+            LiveBytes::const_iterator live = _liveBytes.find( i->first );
+            uint64_t dead = i->second->getTail() - (live != _liveBytes.end() ? live->second : 0u);
+            if ( dead > 0u && (all || (double)dead >= (double)threshold * (double)i->second->getCapacity()) )
+                candidates.push_back( i->first );
+        }
+    }
+
+    // oldest first, so dropped tombstones can't expose older records.
+    for (unsigned i = 0; i < candidates.size() && _closing == 0; ++i)
+    {
+        compactPack( candidates[i] );
+    }
+}
+
+bool
+PackCacheBin::compactPack(unsigned id)
+{
+    ScopedMutexLock writeLock( _writeMutex );
+
+    osg::ref_ptr<Pack> pack;
+    bool oldest;
+    {
+        ScopedReadLock indexLock( _indexMutex );
+        Packs::iterator i = _packs.find( id );
+        if ( i == _packs.end() || i->second == _activePack )
+            return false;
+        pack = i->second.get();
+        oldest = (i == _packs.begin());
+    }
+
+    markDirty();
+
+    uint64_t before = getStorageSize64();
+    unsigned copied = 0u;
+
+    // copy the live records (and any still-needed tombstones) to the active pack.
+    Record record;
+    for (uint64_t offset = 0; offset < pack->getTail(); offset += record.length)
+    {
+        if ( !pack->getRecord(offset, record) )
+            break;
+
+        std::string key( record.key, record.header->keyLength );
+        uint64_t hash = hashKey( key );
+
+        bool copy = false;
+        int64_t timestamp = record.header->timestamp;
+        {
+            ScopedReadLock indexLock( _indexMutex );
+            const IndexSlot* slot = findSlot( key, hash );
+
+            if ( record.header->type == RECORD_DATA )
+            {
+                copy = slot && slot->pack == id && slot->offset == offset;
+                if ( copy )
+                    timestamp = slot->timestamp;
+            }
+            else if ( record.header->type == RECORD_TOMBSTONE )
+            {
+                // An older pack may still hold a record this tombstone hides.
+                // If the key has been written since, the tombstone is moot.
+                copy = !oldest && slot == 0L;
+            }
+        }
+
+        if ( copy )
+        {
+            std::string meta( record.meta, record.header->metaLength );
+            std::string data( record.data, record.header->dataLength );
+            if ( !appendRecord((RecordType)record.header->type, key, meta, data, timestamp) )
+            {
+                OE_WARN << LC << "Bin " << getID() << ": compaction of " << pack->getFilename() << " failed" << std::endl;
+                return false;
+            }
+            ++copied;
+        }
+    }
+
+    // the copies must be durable before the original goes away.
+    if ( _activePack.valid() )
+        _activePack->sync();
+
+    {
+        ScopedWriteLock indexLock( _indexMutex );
+        _packs.erase( id );
+        _liveBytes.erase( id );
+        removePackEntry( id );
+    }
+    pack->setObsolete();
+
+    if ( _debug )
+    {
+        OE_NOTICE << LC << "Bin " << getID() << ": compacted " << pack->getFilename() << " ("
+            << copied << " records kept, " << ((before - getStorageSize64())/1048576) << " MB reclaimed)" << std::endl;
+    }
+
+    return true;
+}
+
+//........................................................................
+
+uint64_t
+PackCacheBin::getStorageSize64() const
+{
+    ScopedReadLock indexLock( _indexMutex );
+    uint64_t size = 0u;
+    for (Packs::const_iterator i = _packs.begin(); i != _packs.end(); ++i)
+        size += i->second->getTail();
+    return size;
+}
+
+unsigned
+PackCacheBin::getStorageSize()
+{
+    uint64_t size = getStorageSize64();
+    return size > (uint64_t)UINT_MAX ? UINT_MAX : (unsigned)size;
+}
+
+Config
+PackCacheBin::readMetadata()
+{
+    ScopedMutexLock lock( _metaMutex );
+
+    Config conf;
+    std::ifstream input( _metaPath.c_str() );
+    if ( input.is_open() )
+    {
+        std::stringstream buf;
+        buf << input.rdbuf();
+        conf.fromJSON( buf.str() );
+    }
+    return conf;
+}
+
+bool
+PackCacheBin::writeMetadata(const Config& conf)
+{
+    if ( !_ok )
+        return false;
+
+    ScopedMutexLock lock( _metaMutex );
+
+    std::ofstream output( _metaPath.c_str() );
+    if ( output.is_open() )
+    {
+        output << conf.toJSON(true);
+        output.flush();
+        output.close();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,491 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2019 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackFile"
+#include <osgEarth/Notify>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#else
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#define LC "[PackCache] "
+
+#define RECORD_MAGIC  0x5250454fu  // "OEPR"
+#define INDEX_MAGIC   "OEPACKIX"
+#define INDEX_VERSION 1u
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers::PackCache;
+
+namespace
+{
+    bool seekFile(FILE* file, uint64_t offset)
+    {
+#ifdef _WIN32
+        return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    // Creates (or replaces) a zero-filled file of the given size. On most
+    // file systems the unwritten space is sparse.
+    bool createFile(const std::string& filename, uint64_t size)
+    {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if ( !file )
+            return false;
+
+        bool ok =
+            seekFile(file, size-1) &&
+            fputc(0, file) != EOF &&
+            fflush(file) == 0;
+
+        fclose(file);
+        return ok;
+    }
+
+    inline uint32_t fnv32(uint32_t hash, const char* data, uint32_t length)
+    {
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            hash ^= (uint8_t)data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    uint32_t checksum(const char* key, uint32_t keyLength, const char* meta, uint32_t metaLength, const char* data, uint32_t dataLength)
+    {
+        uint32_t hash = 2166136261u;
+        hash = fnv32(hash, key, keyLength);
+        hash = fnv32(hash, meta, metaLength);
+        hash = fnv32(hash, data, dataLength);
+        return hash;
+    }
+
+    inline uint64_t align8(uint64_t n)
+    {
+        return (n + 7u) & ~((uint64_t)7u);
+    }
+}
+
+//........................................................................
+
+uint64_t
+osgEarth::Drivers::PackCache::hashKey(const std::string& key)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned i = 0; i < key.length(); ++i)
+    {
+        hash ^= (uint8_t)key[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//........................................................................
+
+MappedFile::MappedFile() :
+_data(0L),
+_size(0u)
+#ifdef _WIN32
+,_file(0L),
+_mapping(0L)
+#else
+,_fd(-1)
+#endif
+{
+    //nop
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool
+MappedFile::open(const std::string& filename, bool writable)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(
+        filename.c_str(),
+        writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER size;
+    if ( !::GetFileSizeEx(file, &size) || size.QuadPart == 0 )
+    {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = ::CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+    if ( mapping == NULL )
+    {
+        ::CloseHandle(file);
+        return false;
+    }
+
+    void* data = ::MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if ( data == NULL )
+    {
+        ::CloseHandle(mapping);
+        ::CloseHandle(file);
+        return false;
+    }
+
+    _file = file;
+    _mapping = mapping;
+    _data = (char*)data;
+    _size = (uint64_t)size.QuadPart;
+#else
+    int fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+    if ( fd < 0 )
+        return false;
+
+    struct stat st;
+    if ( ::fstat(fd, &st) != 0 || st.st_size == 0 )
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = ::mmap(0L, (size_t)st.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if ( data == MAP_FAILED )
+    {
+        ::close(fd);
+        return false;
+    }
+
+    _fd = fd;
+    _data = (char*)data;
+    _size = (uint64_t)st.st_size;
+#endif
+
+    return true;
+}
+
+void
+MappedFile::close()
+{
+    if ( !_data )
+        return;
+
+#ifdef _WIN32
+    ::UnmapViewOfFile(_data);
+    ::CloseHandle((HANDLE)_mapping);
+    ::CloseHandle((HANDLE)_file);
+    _mapping = 0L;
+    _file = 0L;
+#else
+    ::munmap(_data, (size_t)_size);
+    ::close(_fd);
+    _fd = -1;
+#endif
+
+    _data = 0L;
+    _size = 0u;
+}
+
+bool
+MappedFile::sync()
+{
+    if ( !_data )
+        return false;
+
+#ifdef _WIN32
+    return ::FlushViewOfFile(_data, 0) && ::FlushFileBuffers((HANDLE)_file);
+#else
+    return ::msync(_data, (size_t)_size, MS_SYNC) == 0;
+#endif
+}
+
+//........................................................................
+
+MemoryStreamBuf::MemoryStreamBuf(const char* data, uint64_t size)
+{
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    char* target =
+        dir == std::ios_base::beg ? eback() + off :
+        dir == std::ios_base::cur ? gptr() + off :
+        egptr() + off;
+
+    if ( target < eback() || target > egptr() )
+        return pos_type(off_type(-1));
+
+    setg(eback(), target, egptr());
+    return pos_type(target - eback());
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+//........................................................................
+
+Pack::Pack(const std::string& filename, unsigned id) :
+_filename(filename),
+_id      (id),
+_file    (0L),
+_tail    (0u),
+_obsolete(false)
+{
+    //nop
+}
+
+Pack::~Pack()
+{
+    if ( _file )
+        fclose( _file );
+    _map.close();
+
+    if ( _obsolete )
+    {
+        if ( ::remove(_filename.c_str()) != 0 )
+        {
+            OE_WARN << LC << "Failed to delete obsolete pack file " << _filename << std::endl;
+        }
+    }
+}
+
+Pack*
+Pack::create(const std::string& filename, unsigned id, uint64_t capacity)
+{
+    if ( !createFile(filename, capacity) )
+    {
+        OE_WARN << LC << "Failed to create pack file " << filename << std::endl;
+        return 0L;
+    }
+
+    osg::ref_ptr<Pack> pack = new Pack(filename, id);
+    if ( !pack->openFiles() )
+        return 0L;
+
+    return pack.release();
+}
+
+Pack*
+Pack::open(const std::string& filename, unsigned id, uint64_t tail)
+{
+    osg::ref_ptr<Pack> pack = new Pack(filename, id);
+    if ( !pack->openFiles() )
+        return 0L;
+
+    pack->_tail = osg::minimum(tail, pack->getCapacity());
+    return pack.release();
+}
+
+bool
+Pack::openFiles()
+{
+    if ( !_map.open(_filename, false) )
+    {
+        OE_WARN << LC << "Failed to map pack file " << _filename << std::endl;
+        return false;
+    }
+
+    _file = fopen(_filename.c_str(), "r+b");
+    if ( !_file )
+    {
+        OE_WARN << LC << "Failed to open pack file " << _filename << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t
+Pack::recordLength(const std::string& key, const std::string& meta, const std::string& data)
+{
+    return (uint32_t)align8(sizeof(RecordHeader) + key.length() + meta.length() + data.length());
+}
+
+bool
+Pack::append(RecordType         type,
+             const std::string& key,
+             const std::string& meta,
+             const std::string& data,
+             int64_t            timestamp,
+             uint64_t&          out_offset,
+             uint32_t&          out_length)
+{
+    uint32_t length = recordLength(key, meta, data);
+    if ( !hasRoom(length) || !_file )
+        return false;
+
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.type = (uint32_t)type;
+    header.keyLength = key.length();
+    header.metaLength = meta.length();
+    header.dataLength = data.length();
+    header.checksum = checksum(key.data(), key.length(), meta.data(), meta.length(), data.data(), data.length());
+    header.timestamp = timestamp;
+
+    uint32_t padding = length - (sizeof(RecordHeader) + key.length() + meta.length() + data.length());
+    const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    bool ok =
+        seekFile(_file, _tail) &&
+        fwrite(&header, sizeof(RecordHeader), 1, _file) == 1 &&
+        (key.empty()  || fwrite(key.data(),  key.length(),  1, _file) == 1) &&
+        (meta.empty() || fwrite(meta.data(), meta.length(), 1, _file) == 1) &&
+        (data.empty() || fwrite(data.data(), data.length(), 1, _file) == 1) &&
+        (padding == 0 || fwrite(zeros, padding, 1, _file) == 1) &&
+        fflush(_file) == 0;
+
+    if ( !ok )
+    {
+        OE_WARN << LC << "Failed to write to pack file " << _filename << std::endl;
+        return false;
+    }
+
+    out_offset = _tail;
+    out_length = length;
+    _tail += length;
+    return true;
+}
+
+bool
+Pack::sync()
+{
+    if ( !_file || fflush(_file) != 0 )
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(_file)) == 0;
+#else
+    return fsync(fileno(_file)) == 0;
+#endif
+}
+
+bool
+Pack::getRecord(uint64_t offset, Record& out) const
+{
+    uint64_t capacity = getCapacity();
+    if ( offset + sizeof(RecordHeader) > capacity )
+        return false;
+
+    const RecordHeader* header = (const RecordHeader*)(_map.data() + offset);
+    if ( header->magic != RECORD_MAGIC )
+        return false;
+
+    uint64_t length = align8((uint64_t)sizeof(RecordHeader) + header->keyLength + header->metaLength + header->dataLength);
+    if ( offset + length > capacity )
+        return false;
+
+    out.header = header;
+    out.key    = (const char*)(header + 1);
+    out.meta   = out.key + header->keyLength;
+    out.data   = out.meta + header->metaLength;
+    out.length = (uint32_t)length;
+    return true;
+}
+
+bool
+Pack::getValidRecord(uint64_t offset, Record& out) const
+{
+    if ( !getRecord(offset, out) )
+        return false;
+
+    const RecordHeader* h = out.header;
+    if ( h->type < RECORD_DATA || h->type > RECORD_TOUCH )
+        return false;
+
+    return h->checksum == checksum(out.key, h->keyLength, out.meta, h->metaLength, out.data, h->dataLength);
+}
+
+uint64_t
+Pack::recover()
+{
+    uint64_t offset = 0u;
+    Record record;
+    while ( getValidRecord(offset, record) )
+    {
+        offset += record.length;
+    }
+    _tail = offset;
+    return _tail;
+}
+
+//........................................................................
+
+bool
+PackIndex::open(const std::string& filename)
+{
+    if ( !_map.open(filename, true) )
+        return false;
+
+    const IndexHeader* h = header();
+    if ( _map.size() < sizeof(IndexHeader) ||
+         memcmp(h->magic, INDEX_MAGIC, 8) != 0 ||
+         h->version != INDEX_VERSION ||
+         _map.size() != sizeof(IndexHeader) + h->capacity * sizeof(IndexSlot) )
+    {
+        OE_WARN << LC << "Index file " << filename << " is invalid" << std::endl;
+        _map.close();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+PackIndex::create(const std::string& filename, uint64_t capacity)
+{
+    _map.close();
+
+    if ( !createFile(filename, sizeof(IndexHeader) + capacity * sizeof(IndexSlot)) )
+        return false;
+
+    if ( !_map.open(filename, true) )
+        return false;
+
+    IndexHeader* h = header();
+    memcpy(h->magic, INDEX_MAGIC, 8);
+    h->version = INDEX_VERSION;
+    h->clean = 1u;
+    h->capacity = capacity;
+    h->count = 0u;
+    h->used = 0u;
+    h->numPacks = 0u;
+    h->nextPackID = 0u;
+    return _map.sync();
+}
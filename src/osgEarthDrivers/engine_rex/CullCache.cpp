@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "CullCache"
+#include "TileNode"
+
+using namespace osgEarth::Drivers::RexTerrainEngine;
+using namespace osgEarth;
+
+#define LC "[CullCache] "
+
+// Most cameras whose selections are kept per frame
+#define MAX_ENTRIES 8
+
+// Relative difference allowed between two projection matrix elements
+#define PROJECTION_EPSILON 1e-3
+
+CullCache::CullCache() :
+_eyeTolerance( 1.0 ),
+_frame       ( ~0u )
+{
+    setAngleTolerance( 0.5 );
+}
+
+void
+CullCache::setAngleTolerance(double degrees)
+{
+    _angleTolerance = degrees;
+    _minCosAngle = cos(osg::DegreesToRadians(degrees));
+}
+
+void
+CullCache::getView(osgUtil::CullVisitor* cv, View& out) const
+{
+    osg::Vec3d center;
+    cv->getModelViewMatrix()->getLookAt(out._eye, center, out._up);
+    out._look = center - out._eye;
+    out._look.normalize();
+    out._up.normalize();
+    out._projection = *cv->getProjectionMatrix();
+    out._viewportSize.set(cv->getViewport()->width(), cv->getViewport()->height());
+    out._lodScale = cv->getLODScale();
+
+    // Only a perspective frustum with side planes alone is a cone from the
+    // eye point, which is what contains() tests.
+    out._perspective = out._projection(3,3) == 0.0;
+    if (out._perspective)
+    {
+        osg::Matrixd inverseMVP;
+        inverseMVP.invert((*cv->getModelViewMatrix()) * out._projection);
+        for (int i = 0; i < 4; ++i)
+        {
+            double x = (i & 1) ? 1.0 : -1.0, y = (i & 2) ? 1.0 : -1.0;
+            out._edges[i] = osg::Vec3d(x, y, 0.0) * inverseMVP - osg::Vec3d(x, y, -1.0) * inverseMVP;
+            out._edges[i].normalize();
+        }
+    }
+}
+
+bool
+CullCache::agrees(const View& a, const View& b) const
+{
+    if (a._viewportSize != b._viewportSize || a._lodScale != b._lodScale)
+        return false;
+
+    // Compare the shape of the frustum, but not the depth terms, which
+    // OSG adjusts per camera when it computes the near and far planes.
+    for (int r = 0; r < 4; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            if (c == 2 && r >= 2)
+                continue;
+
+            double pa = a._projection(r, c), pb = b._projection(r, c);
+            if (fabs(pa - pb) > PROJECTION_EPSILON * osg::maximum(1.0, osg::maximum(fabs(pa), fabs(pb))))
+                return false;
+        }
+    }
+
+    return
+        (a._eye - b._eye).length() <= _eyeTolerance &&
+        a._look * b._look >= _minCosAngle &&
+        a._up * b._up >= _minCosAngle;
+}
+
+bool
+CullCache::contains(const osg::Polytope& frustum, const View& view) const
+{
+    if (!view._perspective)
+        return false;
+
+    // A cone lies inside a convex volume when its apex does, and each of
+    // its corner rays points inward through every plane. A near or far
+    // plane always fails this, so such frusta are never shared.
+    const osg::Polytope::PlaneList& planes = frustum.getPlaneList();
+    for (osg::Polytope::PlaneList::const_iterator p = planes.begin(); p != planes.end(); ++p)
+    {
+        double length = p->getNormal().length();
+        if (p->distance(view._eye) < -1e-6 * length)
+            return false;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (p->dotProductNormal(view._edges[i]) < -1e-9 * length)
+                return false;
+        }
+    }
+    return true;
+}
+
+void
+CullCache::expand(osgUtil::CullVisitor* cv, osg::Polytope& frustum) const
+{
+    View view;
+    getView(cv, view);
+
+    // side planes only; with near and far planes the frustum is never shared.
+    if (!view._perspective || frustum.getPlaneList().size() != 4)
+        return;
+
+    double sinAngle = sin(osg::DegreesToRadians(_angleTolerance));
+    double cosAngle = cos(osg::DegreesToRadians(_angleTolerance));
+
+    osg::Polytope::PlaneList& planes = frustum.getPlaneList();
+    for (osg::Polytope::PlaneList::iterator p = planes.begin(); p != planes.end(); ++p)
+    {
+        osg::Vec3d normal = p->getNormal();
+        normal.normalize();
+
+        // Tilt each side plane outward about the eye point, toward the view
+        // direction projected into the plane, to cover turning the camera...
+        osg::Vec3d forward = view._look - normal * (view._look * normal);
+        if (forward.normalize() > 0.0)
+        {
+            normal = normal * cosAngle + forward * sinAngle;
+            normal.normalize();
+        }
+
+        // ...and push it back to cover moving the eye point.
+        p->set(normal, -(normal * view._eye) + _eyeTolerance);
+    }
+}
+
+bool
+CullCache::get(osgUtil::CullVisitor* cv, osg::ref_ptr<const Selection>& out_selection)
+{
+    const osg::FrameStamp* fs = cv->getFrameStamp();
+    if (!fs)
+        return false;
+
+    View view;
+    getView(cv, view);
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_frame != fs->getFrameNumber())
+        return false;
+
+    for (unsigned i = 0; i < _entries.size(); ++i)
+    {
+        if (agrees(_entries[i]._view, view) && contains(_entries[i]._frustum, view))
+        {
+            out_selection = _entries[i]._selection.get();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+CullCache::put(osgUtil::CullVisitor* cv, const osg::Polytope& frustum, TileNodeVector& tiles)
+{
+    const osg::FrameStamp* fs = cv->getFrameStamp();
+    if (!fs)
+        return;
+
+    Selection* selection = new Selection();
+    selection->_tiles.swap(tiles);
+
+    Entry entry;
+    getView(cv, entry._view);
+    entry._frustum = frustum;
+    entry._selection = selection;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // selections only live for the frame that made them:
+    if (_frame != fs->getFrameNumber())
+    {
+        _entries.clear();
+        _frame = fs->getFrameNumber();
+    }
+
+    if (_entries.size() < MAX_ENTRIES)
+    {
+        _entries.push_back(entry);
+    }
+}
@@ -46,6 +46,7 @@ _map           ( map ),
 _terrainEngine ( terrainEngine ),
 _geometryPool  ( geometryPool ),
 _loader        ( loader ),
+_prefetcher    ( 0L ),
 _unloader      ( unloader ),
 _tileRasterizer( tileRasterizer ),
 _liveTiles     ( liveTiles ),
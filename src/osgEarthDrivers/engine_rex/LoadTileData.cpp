@@ -18,6 +18,7 @@
 */
 #include "LoadTileData"
 #include "SurfaceNode"
+#include "Prefetcher"
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/Terrain>
 #include <osg/NodeVisitor>
@@ -54,6 +55,15 @@ LoadTileData::invoke(ProgressCallback* progress)
     if (!_map.lock(map))
         return;
 
+    // Use the model the prefetcher built for this tile, if there is one.
+    // (Only for a full load; a filtered load wants just some layers.)
+    osg::ref_ptr<EngineContext> context;
+    if (_filter.empty() && _context.lock(context) && context->getPrefetcher() &&
+        context->getPrefetcher()->takeModel(tilenode->getKey(), map.get(), _dataModel))
+    {
+        return;
+    }
+
     // Assemble all the components necessary to display this tile
     _dataModel = engine->createTileModel(
         map.get(),
@@ -168,4 +178,132 @@ LoadTileData::createStateSet() const
     }
 
     return out.release();
-}
\ No newline at end of file
+}
+//........................................................................
+
+LoadChildTileData::LoadChildTileData(TileNode* parent, EngineContext* context) :
+_parent(parent),
+_context(context)
+{
+    this->setTileKey(parent->getKey());
+    this->setName(parent->getKey().str() + " children");
+    _map = context->getMap();
+    _engine = context->getEngine();
+}
+
+// invoke runs in the background pager thread.
+void
+LoadChildTileData::invoke(ProgressCallback* progress)
+{
+    osg::ref_ptr<TileNode> parent;
+    if (!_parent.lock(parent))
+        return;
+
+    osg::ref_ptr<TerrainEngineNode> engine;
+    if (!_engine.lock(engine))
+        return;
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return;
+
+    // Use the models the prefetcher built for the children, if it has all four.
+    osg::ref_ptr<EngineContext> context;
+    if (_context.lock(context) && context->getPrefetcher() &&
+        context->getPrefetcher()->takeChildModels(parent->getKey(), map.get(), _dataModels))
+    {
+        return;
+    }
+
+    // Assemble the components for all four children at once
+    engine->createChildTileModels(
+        map.get(),
+        parent->getKey(),
+        _filter,
+        progress,
+        _dataModels);
+
+    // if the operation was canceled, set the request to idle and delete the tile models.
+    if (progress && progress->isCanceled())
+    {
+        for (unsigned q = 0; q < 4; ++q)
+            _dataModels[q] = 0L;
+        setState(Request::IDLE);
+    }
+}
+
+// apply() runs in the update traversal and can safely alter the scene graph
+void
+LoadChildTileData::apply(const osg::FrameStamp* stamp)
+{
+    // Whatever happens here, the children load on their own from now on.
+    _applied.exchange(1u);
+
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return;
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return;
+
+    osg::ref_ptr<TileNode> parent;
+    if (!_parent.lock(parent) || parent->getNumChildren() < 4)
+    {
+        OE_DEBUG << LC << "LoadChildTileData failed; subtiles disappeared\n";
+    }
+    else
+    {
+        const RenderBindings& bindings = context->getRenderBindings();
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            TileNode* child = parent->getSubTile(q);
+            const TerrainTileModel* model = _dataModels[q].get();
+
+            // ensure it's in sync with the map revision (not out of date), and that
+            // the child is still waiting on its first load. A stale child stays dirty
+            // and loads with its own request.
+            if (model && child && child->isDirty() &&
+                model->getRevision() == map->getDataModelRevision() &&
+                model->getKey() == child->getKey())
+            {
+                child->merge(model, bindings);
+                child->setDirty( false );
+
+                OE_DEBUG << LC << "apply " << model->getKey().str() << "\n";
+            }
+        }
+    }
+
+    // Delete the models immediately
+    for (unsigned q = 0; q < 4; ++q)
+        _dataModels[q] = 0L;
+}
+
+osg::StateSet*
+LoadChildTileData::createStateSet() const
+{
+    osg::ref_ptr<osg::StateSet> out;
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map))
+        return NULL;
+
+    // One "fake" attribute per model, so the ICO GL-compiles all of them.
+    for (unsigned q = 0; q < 4; ++q)
+    {
+        if (_dataModels[q].valid() &&
+            _dataModels[q]->getRevision() == map->getDataModelRevision())
+        {
+            if (!out.valid())
+                out = new osg::StateSet();
+
+            ModelCompilingAttribute* mca = new ModelCompilingAttribute();
+            mca->_dataModel = _dataModels[q].get();
+            out->setTextureAttribute(q, mca, 1);
+        }
+    }
+
+    return out.release();
+}
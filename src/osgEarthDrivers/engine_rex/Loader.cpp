@@ -30,9 +30,16 @@
 #include <osgDB/ReaderWriter>
 
 #include <string>
+#include <typeinfo>
 
 #define REPORT_ACTIVITY true
 
+// Weight of the newest sample in the moving average of merge costs
+#define MERGE_COST_ALPHA 0.2
+
+// How far down the merge queue to look for a request that fits the remaining budget
+#define MERGE_BACKFILL_SCAN 16
+
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
 
@@ -42,8 +49,11 @@ Loader::Request::Request()
     _state = IDLE;
     _loadCount = 0;
     _priority = 0;
+    _mergeCost = 0.0f;
     _lastFrameSubmitted = 0;
     _lastTick = 0;
+    _queuedTick = 0;
+    _mergeQueuedTick = 0;
 }
 
 void
@@ -220,6 +230,10 @@ namespace
 PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    ( (osg::Timer_t)0 ),
 _mergesPerFrame( 0 ),
+_mergeTimeBudget( 0.0f ),
+_mergeTime     ( 0.0 ),
+_numLoaded     ( 0 ),
+_numMerged     ( 0 ),
 _frameNumber   ( 0 ),
 _numLODs       ( 20u )
 {
@@ -230,6 +244,8 @@ _numLODs       ( 20u )
 
     OptionsData<PagerLoader>::set(_dboptions.get(), "osgEarth.PagerLoader", this);
 
+    _mergeLatency[0] = _mergeLatency[1] = _mergeLatency[2] = 0u;
+
     // initialize the LOD priority scales and offsets
     for (unsigned i = 0; i < 64; ++i)
     {
@@ -253,6 +269,16 @@ PagerLoader::setMergesPerFrame(int value)
     
 }
 
+void
+PagerLoader::setMergeTimeBudget(float ms)
+{
+    _mergeTimeBudget = osg::maximum(ms, 0.0f);
+    if (_mergeTimeBudget > 0.0f)
+    {
+        OE_INFO << LC << "Merge time budget = " << _mergeTimeBudget << " ms" << std::endl;
+    }
+}
+
 void
 PagerLoader::setLODPriorityScale(unsigned lod, float priorityScale)
 {
@@ -305,6 +331,9 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
 
             // if this is the first load request since idle, we need to remember this request.
             addToRequestSet = (request->_loadCount == 1);
+
+            if ( addToRequestSet )
+                request->_queuedTick = request->_lastTick;
         }
         request->unlock();
 
@@ -351,6 +380,47 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
         }
 
         // process pending merges.
+        if ( _mergeTimeBudget > 0.0f )
+        {
+            METRIC_BEGIN("loader.merge");
+            double remaining = _mergeTimeBudget;
+            int count = 0;
+            while( !_mergeQueue.empty() )
+            {
+                MergeQueue::iterator next = _mergeQueue.begin();
+
+                // Always merge at least one request per frame so the queue can't stall.
+                // After that, if the top request won't fit in the remaining time,
+                // back-fill with the next one that will.
+                if ( count > 0 && (*next)->_mergeCost > remaining )
+                {
+                    bool found = false;
+                    ++next;
+                    for(int scan = 0; scan < MERGE_BACKFILL_SCAN && next != _mergeQueue.end(); ++scan, ++next)
+                    {
+                        if ( (*next)->_mergeCost <= remaining )
+                        {
+                            found = true;
+                            break;
+                        }
+                    }
+                    if ( !found )
+                        break;
+                }
+
+                Request* req = next->get();
+                if ( req && req->_lastTick >= _checkpoint )
+                {
+                    remaining -= merge(req);
+                    ++count;
+                }
+
+                _mergeQueue.erase( next );
+            }
+            METRIC_END("loader.merge");
+        }
+
+        else
         {
             METRIC_BEGIN("loader.merge");
             int count;
@@ -359,11 +429,7 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                 Request* req = _mergeQueue.begin()->get();
                 if ( req && req->_lastTick >= _checkpoint )
                 {
-                    OE_START_TIMER(req_apply);
-                    req->apply( getFrameStamp() );
-                    double s = OE_STOP_TIMER(req_apply);
-
-                    req->setState(Request::FINISHED);
+                    merge(req);
                 }
 
                 _mergeQueue.erase( _mergeQueue.begin() );
@@ -424,6 +490,18 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             }
 
             //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
+
+            if ( Metrics::enabled() )
+            {
+                Metrics::counter("RexLoader", "Loaded", _numLoaded, "Merged", _numMerged, "Requests", _requests.size());
+                Metrics::counter("RexLoaderQueue", "MergeQueue", _mergeQueue.size());
+                Metrics::counter("RexLoaderMergeTime", "ms", _mergeTime);
+                Metrics::counter("RexLoaderMergeLatency", "<1ms", _mergeLatency[0], "1-5ms", _mergeLatency[1], ">5ms", _mergeLatency[2]);
+            }
+            _numLoaded = 0;
+            _numMerged = 0;
+            _mergeTime = 0.0;
+            _mergeLatency[0] = _mergeLatency[1] = _mergeLatency[2] = 0u;
         }
     }
 
@@ -444,15 +522,19 @@ PagerLoader::addChild(osg::Node* node)
             // and running (i.e. has not been canceled along the way)
             if (req->_lastTick >= _checkpoint && req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                ++_numLoaded;
+
+                req->_mergeQueuedTick = osg::Timer::instance()->tick();
+
+                if ( _mergesPerFrame > 0 || _mergeTimeBudget > 0.0f )
                 {
+                    req->_mergeCost = getMergeCost(req);
                     _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
                 }
                 else
                 {
-                    req->apply( getFrameStamp() );
-                    req->setState( Request::FINISHED );
+                    merge(req);
                     if ( REPORT_ACTIVITY )
                         Registry::instance()->endActivity( req->getName() );
                 }
@@ -475,6 +557,51 @@ PagerLoader::addChild(osg::Node* node)
     return true;
 }
 
+double
+PagerLoader::merge(Loader::Request* req)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    METRIC_ASYNC("loader.mergeWait", req->getUID(), req->_mergeQueuedTick, start, getTraceArgs(req));
+
+    {
+        METRIC_SCOPED_EX("loader.apply", 2, "key", req->getTileKey().str().c_str(), "request", req->getName().c_str());
+        req->apply( getFrameStamp() );
+    }
+
+    double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+    req->setState(Request::FINISHED);
+    ++_numMerged;
+
+    // learn how long this kind of request takes to merge:
+    double& cost = _mergeCosts[typeid(*req).name()];
+    cost = cost > 0.0 ? cost + MERGE_COST_ALPHA*(ms - cost) : ms;
+
+    _mergeTime += ms;
+    if      ( ms < 1.0 ) ++_mergeLatency[0];
+    else if ( ms < 5.0 ) ++_mergeLatency[1];
+    else                 ++_mergeLatency[2];
+
+    return ms;
+}
+
+float
+PagerLoader::getMergeCost(Loader::Request* req) const
+{
+    MergeCosts::const_iterator i = _mergeCosts.find(typeid(*req).name());
+    return i != _mergeCosts.end() ? (float)i->second : 0.0f;
+}
+
+Config
+PagerLoader::getTraceArgs(Loader::Request* req) const
+{
+    Config args;
+    args.add("key", req->getTileKey().str());
+    args.add("request", req->getName());
+    return args;
+}
+
 TileKey
 PagerLoader::getTileKeyForRequest(UID requestUID) const
 {
@@ -506,6 +633,14 @@ PagerLoader::invokeAndRelease(UID requestUID)
         if ( REPORT_ACTIVITY )
             Registry::instance()->startActivity( request->getName() );
 
+        // time spent waiting for a pager thread:
+        if ( request->_queuedTick != 0 )
+        {
+            METRIC_ASYNC("loader.queued", request->getUID(), request->_queuedTick, osg::Timer::instance()->tick(), getTraceArgs(request.get()));
+        }
+
+        METRIC_SCOPED_EX("loader.invoke", 2, "key", request->getTileKey().str().c_str(), "request", request->getName().c_str());
+
         osg::ref_ptr<ProgressCallback> prog = new RequestProgressCallback(request);
         request->invoke(prog.get());
     }
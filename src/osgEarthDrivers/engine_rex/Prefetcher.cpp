@@ -0,0 +1,411 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "Prefetcher"
+#include "EngineContext"
+#include "SelectionInfo"
+#include "TileNodeRegistry"
+
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Map>
+#include <osgEarth/Metrics>
+
+#include <OpenThreads/Atomic>
+
+using namespace osgEarth::Drivers::RexTerrainEngine;
+using namespace osgEarth;
+
+#define LC "[Prefetcher] "
+
+// Weight of the newest sample in the smoothed camera velocity
+#define VELOCITY_ALPHA 0.5
+
+// Forget a camera that hasn't been culled in this many seconds
+#define TRACK_EXPIRY_SECONDS 5.0
+
+// Ignore predicted motion shorter than this (meters)
+#define MIN_DISPLACEMENT 1.0
+
+// Upper bound on the tile keys examined in one prediction
+#define MAX_KEYS_VISITED 4096
+
+//........................................................................
+
+namespace osgEarth { namespace Drivers { namespace RexTerrainEngine
+{
+    /**
+     * Loader request that builds the data model for a tile that does not
+     * exist yet and hands it to the prefetcher, where the tile's own load
+     * request picks it up.
+     */
+    class PrefetchTileData : public Loader::Request
+    {
+    public:
+        PrefetchTileData(const TileKey& key, EngineContext* context, Prefetcher* prefetcher) :
+            _engine(context->getEngine()),
+            _map(context->getMap().get()),
+            _prefetcher(prefetcher)
+        {
+            setTileKey(key);
+            setName("prefetch " + key.str());
+        }
+
+        bool isDone() const { return _done > 0u; }
+
+    public: // Loader::Request
+
+        void invoke(ProgressCallback* progress)
+        {
+            osg::ref_ptr<TerrainEngineNode> engine;
+            if (!_engine.lock(engine))
+                return;
+
+            osg::ref_ptr<const Map> map;
+            if (!_map.lock(map))
+                return;
+
+            osg::ref_ptr<TerrainTileModel> model = engine->createTileModel(
+                map.get(),
+                getTileKey(),
+                _filter,
+                progress);
+
+            if (progress && progress->isCanceled())
+            {
+                setState(Request::IDLE);
+                return;
+            }
+
+            osg::ref_ptr<Prefetcher> prefetcher;
+            if (model.valid() && _prefetcher.lock(prefetcher))
+            {
+                prefetcher->storeModel(model.get());
+            }
+        }
+
+        void apply(const osg::FrameStamp*)
+        {
+            _done.exchange(1u);
+        }
+
+        osg::StateSet* createStateSet() const
+        {
+            return 0L;
+        }
+
+    protected:
+        osg::observer_ptr<TerrainEngineNode> _engine;
+        osg::observer_ptr<const Map>         _map;
+        osg::observer_ptr<Prefetcher>        _prefetcher;
+        CreateTileModelFilter                _filter;
+        OpenThreads::Atomic                  _done;
+
+        virtual ~PrefetchTileData() { }
+    };
+} } }
+
+//........................................................................
+
+Prefetcher::Prefetcher(EngineContext* context) :
+_context          ( context ),
+_lookahead        ( 2.0 ),
+_maxTilesPerPrediction( 32u ),
+_interval         ( 0.25 ),
+_maxModels        ( 64u ),
+_modelSeq         ( 0u ),
+_destinationTime  ( -1.0 ),
+_destinationExpiry( 0.0 )
+{
+    //nop
+}
+
+Prefetcher::~Prefetcher()
+{
+    //nop
+}
+
+void
+Prefetcher::setDestination(const osg::Vec3d& eyeWorld, double secondsToArrival)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _destination = eyeWorld;
+    _destinationTime = osg::maximum(secondsToArrival, 0.0);
+}
+
+void
+Prefetcher::cull(osgUtil::CullVisitor* cv)
+{
+    const osg::FrameStamp* fs = cv->getFrameStamp();
+    if (!fs || _lookahead <= 0.0 || !cv->getDatabaseRequestHandler())
+        return;
+
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return;
+
+    double   now   = fs->getReferenceTime();
+    unsigned frame = fs->getFrameNumber();
+    osg::Vec3d eye = cv->getEyeLocal();
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // update the motion of this camera:
+    Track& track = _tracks[cv->getCurrentCamera()];
+    double dt = now - track._time;
+    if (track._valid && dt > 0.0)
+    {
+        osg::Vec3d v = (eye - track._eye) / dt;
+        track._velocity = track._velocity*(1.0-VELOCITY_ALPHA) + v*VELOCITY_ALPHA;
+    }
+    if (dt > 0.0 || !track._valid)
+    {
+        track._eye = eye;
+        track._time = now;
+        track._valid = true;
+    }
+
+    // a newly announced destination starts counting down now:
+    if (_destinationTime >= 0.0)
+    {
+        _destinationExpiry = now + _destinationTime + 1.0;
+        _destinationTime = -1.0;
+    }
+
+    // periodically predict which tiles this camera will need:
+    std::vector<TileKey> keys;
+    if (now - track._lastPrediction >= _interval)
+    {
+        track._lastPrediction = now;
+
+        if (now < _destinationExpiry)
+        {
+            collectKeys(context.get(), _destination, eye, now, keys);
+        }
+
+        osg::Vec3d predicted = eye + track._velocity*_lookahead;
+        if ((predicted - eye).length() >= MIN_DISPLACEMENT)
+        {
+            collectKeys(context.get(), predicted, eye, now, keys);
+        }
+
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            Entry& entry = _requests[keys[i]];
+            if (!entry._request.valid())
+                entry._request = new PrefetchTileData(keys[i], context.get(), this);
+            entry._lastPredicted = now;
+        }
+    }
+
+    // Forget requests that are no longer predicted, and (re)submit the rest
+    // below every regular tile request. The loader drops requests that stop
+    // being resubmitted, and the pager services higher priorities first, so
+    // real requests always preempt these.
+    Loader* loader = context->getLoader();
+    unsigned submitted = 0u;
+    for (Requests::iterator i = _requests.begin(); i != _requests.end(); )
+    {
+        Entry& entry = i->second;
+        if (now - entry._lastPredicted > 2.0*_interval + 0.1)
+        {
+            _requests.erase(i++);
+        }
+        else
+        {
+            if (!entry._request->isDone() && entry._request->getLastFrameSubmitted() != frame)
+            {
+                float priority = -1.0f - (float)i->first.getLOD();
+                loader->load(entry._request.get(), priority, *cv);
+                ++submitted;
+            }
+            ++i;
+        }
+    }
+
+    // forget cameras that went away:
+    for (Tracks::iterator i = _tracks.begin(); i != _tracks.end(); )
+    {
+        if (now - i->second._time > TRACK_EXPIRY_SECONDS)
+            _tracks.erase(i++);
+        else
+            ++i;
+    }
+
+    if (Metrics::enabled())
+    {
+        Metrics::counter("RexPrefetch", "Predicted", keys.size(), "Submitted", submitted, "Tracked", _requests.size());
+    }
+}
+
+void
+Prefetcher::storeModel(TerrainTileModel* model)
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+
+    HeldModel& held = _models[model->getKey()];
+    held._model = model;
+    held._seq = _modelSeq++;
+
+    // drop the oldest models that no tile has come for:
+    while (_models.size() > _maxModels)
+    {
+        Models::iterator oldest = _models.begin();
+        for (Models::iterator i = _models.begin(); i != _models.end(); ++i)
+        {
+            if (i->second._seq < oldest->second._seq)
+                oldest = i;
+        }
+        _models.erase(oldest);
+    }
+}
+
+bool
+Prefetcher::takeModel(const TileKey& key, const Map* map, osg::ref_ptr<TerrainTileModel>& out)
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+
+    Models::iterator i = _models.find(key);
+    if (i == _models.end())
+        return false;
+
+    // a model built before the map changed is no use to anyone:
+    bool current = map && i->second._model->getRevision() == map->getDataModelRevision();
+    if (current)
+        out = i->second._model.get();
+    _models.erase(i);
+    return current;
+}
+
+bool
+Prefetcher::takeChildModels(const TileKey& parentKey, const Map* map, osg::ref_ptr<TerrainTileModel> out[4])
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+
+    bool all = map != 0L;
+    osg::ref_ptr<TerrainTileModel> models[4];
+    for (unsigned q = 0; q < 4; ++q)
+    {
+        Models::iterator i = _models.find(parentKey.createChildKey(q));
+        if (i != _models.end())
+        {
+            models[q] = i->second._model.get();
+            _models.erase(i);
+        }
+        if (!models[q].valid() || !map || models[q]->getRevision() != map->getDataModelRevision())
+            all = false;
+    }
+
+    if (all)
+    {
+        for (unsigned q = 0; q < 4; ++q)
+            out[q] = models[q].get();
+    }
+    return all;
+}
+
+void
+Prefetcher::clearModels()
+{
+    Threading::ScopedMutexLock lock(_modelsMutex);
+    _models.clear();
+}
+
+void
+Prefetcher::collectKeys(EngineContext*        context,
+                        const osg::Vec3d&     eye,
+                        const osg::Vec3d&     current,
+                        double                now,
+                        std::vector<TileKey>& keys)
+{
+    osg::ref_ptr<const Map> map = context->getMap();
+    if (!map.valid())
+        return;
+
+    const SelectionInfo& si = context->getSelectionInfo();
+    TileNodeRegistry* liveTiles = context->liveTiles();
+
+    // Walk the tile hierarchy breadth-first (so lower LODs come first)
+    // following the same distance test the engine uses to select tiles.
+    std::vector<TileKey> level;
+    map->getProfile()->getAllKeysAtLOD(context->getOptions().firstLOD().get(), level);
+
+    unsigned visited = 0u;
+    unsigned maxKeys = keys.size() + _maxTilesPerPrediction;
+
+    while (!level.empty() && keys.size() < maxKeys && visited < MAX_KEYS_VISITED)
+    {
+        std::vector<TileKey> next;
+
+        for (unsigned k = 0; k < level.size() && keys.size() < maxKeys && visited < MAX_KEYS_VISITED; ++k, ++visited)
+        {
+            const TileKey& key = level[k];
+
+            float range, morphStart, morphEnd;
+            si.get(key, range, morphStart, morphEnd);
+            if (range <= 0.0f)
+                continue;
+
+            // approximate the tile with a sphere at sea level:
+            const GeoExtent& e = key.getExtent();
+            osg::Vec3d center, corner;
+            GeoPoint(e.getSRS(), 0.5*(e.xMin()+e.xMax()), 0.5*(e.yMin()+e.yMax()), 0.0, ALTMODE_ABSOLUTE).toWorld(center);
+            GeoPoint(e.getSRS(), e.xMin(), e.yMin(), 0.0, ALTMODE_ABSOLUTE).toWorld(corner);
+            double radius = (corner-center).length();
+            GeoPoint(e.getSRS(), e.xMax(), e.yMax(), 0.0, ALTMODE_ABSOLUTE).toWorld(corner);
+            radius = osg::maximum(radius, (corner-center).length());
+
+            // the engine won't select this tile from the predicted eye point:
+            if ((center-eye).length() - radius > range)
+                continue;
+
+            if (key.getLOD()+1 < si.getNumLODs())
+            {
+                for (unsigned q = 0; q < 4; ++q)
+                    next.push_back(key.createChildKey(q));
+            }
+
+            // needed now, so the engine is already loading it:
+            if ((center-current).length() - radius <= range)
+                continue;
+
+            // already in the scene graph:
+            osg::ref_ptr<TileNode> tile;
+            if (liveTiles->get(key, tile))
+                continue;
+
+            Requests::iterator r = _requests.find(key);
+            if (r != _requests.end() && r->second._request->isDone())
+            {
+                // fetched already; keep remembering it while it's predicted
+                r->second._lastPredicted = now;
+                continue;
+            }
+
+            // fetched by an earlier prediction and still waiting for its tile:
+            {
+                Threading::ScopedMutexLock lock(_modelsMutex);
+                if (_models.find(key) != _models.end())
+                    continue;
+            }
+
+            keys.push_back(key);
+        }
+
+        level.swap(next);
+    }
+}
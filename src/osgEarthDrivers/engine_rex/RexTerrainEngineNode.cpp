@@ -143,6 +143,15 @@ namespace
         }
     };
 
+    // Drops the sibling images the layers prefetched, so tiles that reload
+    // after a refresh or an invalidation read current data.
+    void clearChildImages(const Map* map)
+    {
+        ImageLayerVector imageLayers;
+        map->getLayers(imageLayers);
+        for (unsigned i = 0; i < imageLayers.size(); ++i)
+            imageLayers[i]->clearChildImages();
+    }
 }
 
 //------------------------------------------------------------------------
@@ -283,6 +292,14 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
         OE_INFO << LC << "Expiration threshold set by env var = " << _terrainOptions.expirationThreshold().get() << "\n";
     }
 
+    // likewise for the tile memory budget
+    val = ::getenv("OSGEARTH_TILE_MEMORY_BUDGET_MB");
+    if ( val )
+    {
+        _terrainOptions.tileMemoryBudget() = as<unsigned>(val, _terrainOptions.tileMemoryBudget().get());
+        OE_INFO << LC << "Tile memory budget set by env var = " << _terrainOptions.tileMemoryBudget().get() << " MB\n";
+    }
+
     // Check for normals debugging.
     if (::getenv("OSGEARTH_DEBUG_NORMALS"))
         getOrCreateStateSet()->setDefine("OE_DEBUG_NORMALS");
@@ -319,6 +336,7 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
     PagerLoader* loader = new PagerLoader( this );
     loader->setNumLODs(_terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD));
     loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
+    loader->setMergeTimeBudget( _terrainOptions.mergeTimeBudget().get() );
     for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = _terrainOptions.lods().begin(); i != _terrainOptions.lods().end(); ++i) {
         if (i->_lod.isSet()) {
             loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
@@ -332,6 +350,7 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
     // Make a tile unloader
     _unloader = new UnloaderGroup( _liveTiles.get() );
     _unloader->setThreshold( _terrainOptions.expirationThreshold().get() );
+    _unloader->setMemoryBudget( (size_t)_terrainOptions.tileMemoryBudget().get() * 1048576u );
     _unloader->setReleaser(_releaser.get());
     this->addChild( _unloader.get() );
 
@@ -368,6 +387,24 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
         _terrainOptions,
         _selectionInfo);
 
+    // Load terrain ahead of the moving camera if requested
+    if ( _terrainOptions.prefetchLookahead().get() > 0.0f )
+    {
+        _prefetcher = new Prefetcher( _engineContext.get() );
+        _prefetcher->setLookahead( _terrainOptions.prefetchLookahead().get() );
+        _engineContext->setPrefetcher( _prefetcher.get() );
+        OE_INFO << LC << "Prefetching " << _terrainOptions.prefetchLookahead().get() << " s ahead of the camera\n";
+    }
+
+    // Let cameras with nearly the same view share one tile selection
+    if ( _terrainOptions.shareCullResults() == true )
+    {
+        _cullCache = new CullCache();
+        _cullCache->setEyeTolerance( _terrainOptions.cullShareEyeTolerance().get() );
+        _cullCache->setAngleTolerance( _terrainOptions.cullShareAngleTolerance().get() );
+        OE_INFO << LC << "Sharing tile selection between cameras\n";
+    }
+
     // Calculate the LOD morphing parameters:
     unsigned maxLOD = _terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD);
 
@@ -386,6 +423,15 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
 }
 
 
+void
+RexTerrainEngineNode::notifyOfCameraDestination(const osg::Vec3d& eyeWorld, double seconds)
+{
+    if ( _prefetcher.valid() )
+    {
+        _prefetcher->setDestination( eyeWorld, seconds );
+    }
+}
+
 osg::BoundingSphere
 RexTerrainEngineNode::computeBound() const
 {
@@ -406,6 +452,10 @@ RexTerrainEngineNode::invalidateRegion(const GeoExtent& extent,
             extent.transform(this->getMap()->getSRS(), extentLocal);
         }
 
+        clearChildImages(getMap());
+        if ( _prefetcher.valid() )
+            _prefetcher->clearModels();
+
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel);
     }
 }
@@ -504,6 +554,11 @@ RexTerrainEngineNode::dirtyTerrain()
     // clear the loader:
     _loader->clear();
 
+    // and any data read ahead for tiles that no longer exist:
+    clearChildImages(getMap());
+    if ( _prefetcher.valid() )
+        _prefetcher->clearModels();
+
     // clear out the tile registry:
     if ( _liveTiles.valid() )
     {
@@ -648,8 +703,38 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
         osg::Timer_t s1 = osg::Timer::instance()->tick();
 #endif
 
-        // Assemble the terrain drawables:
-        _terrain->accept(culler);
+        // Assemble the terrain drawables. If another camera with nearly the same
+        // view culled the terrain already this frame, reuse its tile selection.
+        // Patch layers and spy cameras need the full traversal.
+        bool shareCull =
+            _cullCache.valid() &&
+            !culler._isSpy &&
+            culler._terrain.patchLayers().empty() &&
+            cv->getCurrentCamera()->getReferenceFrame() != osg::Camera::ABSOLUTE_RF_INHERIT_VIEWPOINT;
+
+        osg::ref_ptr<const CullCache::Selection> selection;
+        if (shareCull && _cullCache->get(cv, selection))
+        {
+            culler.replay(selection->_tiles);
+        }
+        else
+        {
+            // Cull tiles against a frustum wide enough for the cameras that
+            // may replay this selection. Surfaces are still culled to this
+            // camera's own frustum, so it draws nothing extra.
+            culler._recordSelection = shareCull;
+            if (shareCull)
+            {
+                _cullCache->expand(cv, culler.getCurrentCullingSet().getFrustum());
+            }
+
+            _terrain->accept(culler);
+
+            if (shareCull)
+            {
+                _cullCache->put(cv, culler.getCurrentCullingSet().getFrustum(), culler._selectedTiles);
+            }
+        }
 
         // If we're using geometry pooling, optimize the drawable for shared state
         // by sorting the draw commands.
@@ -784,6 +869,12 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
         // marks the end of the cull pass
         this->getEngineContext()->endCull( cv );
 
+        // start loading the tiles the camera is about to need
+        if ( _prefetcher.valid() )
+        {
+            _prefetcher->cull( cv );
+        }
+
         // If the culler found any orphaned data, we need to update the render model
         // during the next update cycle.
         if (culler._orphanedPassesDetected > 0u)
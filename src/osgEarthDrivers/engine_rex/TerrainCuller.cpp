@@ -32,6 +32,7 @@ _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
 _cv(cullVisitor),
+_recordSelection(false),
 _context(context)
 {
     setVisitorType(CULL_VISITOR);
@@ -191,6 +192,24 @@ TerrainCuller::isCulledToBBox(osg::Transform* node, const osg::BoundingBox& box)
     return culled;
 }
 
+void
+TerrainCuller::replay(const CullCache::TileNodeVector& tiles)
+{
+    for (CullCache::TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
+    {
+        TileNode* tile = i->get();
+        SurfaceNode* surface = tile->getSurfaceNode();
+
+        // horizon check, as in TileNode::cull:
+        if (!surface || !surface->isVisibleFrom(getViewPointLocal()))
+            continue;
+
+        _currentTileNode = tile;
+        _firstDrawCommandForTile = 0L;
+        apply(*surface);
+    }
+}
+
 void
 TerrainCuller::apply(TileNode& node)
 {
@@ -264,6 +283,15 @@ TerrainCuller::apply(SurfaceNode& node)
 {
     TileRenderModel& renderModel = _currentTileNode->renderModel();
 
+    // record the selection before culling the surface to this camera's
+    // frustum; cameras that replay it test the surfaces against their own.
+    // The tiles themselves were culled against the widened frustum from
+    // CullCache::expand, which covers every camera allowed to replay.
+    if (_recordSelection)
+    {
+        _selectedTiles.push_back(_currentTileNode);
+    }
+
     // push the surface matrix:
     osg::RefMatrix* matrix = createOrReuseMatrix(*getModelViewMatrix());
     node.computeLocalToWorldMatrix(*matrix,this);
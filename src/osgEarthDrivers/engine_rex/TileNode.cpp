@@ -78,7 +78,8 @@ _count(0),
 _stitchNormalMap(false),
 _empty(false),              // an "empty" node exists but has no geometry or children.,
 _isRootTile(false),
-_imageUpdatesActive(false)
+_imageUpdatesActive(false),
+_memoryFootprint(0u)
 {
     //nop
 }
@@ -237,6 +238,7 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     setDirty( true );
 
     // register me.
+    _memoryFootprint = computeMemoryFootprint();
     context->liveTiles()->add( this );
 
     // tell the world.
@@ -658,6 +660,12 @@ TileNode::createChildren(EngineContext* context)
         // Add to the scene graph.
         addChild( node );
     }
+
+    // Load the new children together the first time around:
+    if (context->getOptions().siblingBatchLoading() == true)
+    {
+        _loadChildrenRequest = new LoadChildTileData( this, context );
+    }
 }
 
 void
@@ -812,6 +820,8 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
         }
     }
 
+    updateMemoryFootprint();
+
     if (newElevationData)
     {
         _context->getEngine()->getTerrain()->notifyTileAdded(getKey(), this);
@@ -854,6 +864,8 @@ TileNode::refreshSharedSamplers(const RenderBindings& bindings)
             _renderModel._sharedSamplers[i]._texture = 0L;
         }
     }
+
+    updateMemoryFootprint();
 }
 
 void
@@ -1029,8 +1041,20 @@ TileNode::load(TerrainCuller* culler)
     // (because of the biggest range), and second by distance.
     float priority = lodPriority + distPriority;
 
-    // Submit to the loader.
-    _context->getLoader()->load( _loadRequest.get(), priority, *culler );
+    // Submit to the loader. A new tile's first load goes through its parent's
+    // request for all four siblings, if there is one.
+    Loader::Request* request = _loadRequest.get();
+
+    TileNode* parent = getParentTile();
+    if (parent &&
+        parent->_loadChildrenRequest.valid() &&
+        !parent->_loadChildrenRequest->isApplied() &&
+        _loadRequest->filter().empty())
+    {
+        request = parent->_loadChildrenRequest.get();
+    }
+
+    _context->getLoader()->load( request, priority, *culler );
 }
 
 void
@@ -1053,11 +1077,95 @@ TileNode::areSubTilesDormant(const osg::FrameStamp* fs) const
         getSubTile(3)->isDormant( fs );
 }
 
+namespace
+{
+    void collectImages(const Samplers& samplers, std::set<const osg::Image*>& images)
+    {
+        for (unsigned s = 0; s < samplers.size(); ++s)
+        {
+            // a non-identity matrix means the texture is inherited from an ancestor
+            const Sampler& sampler = samplers[s];
+            if (sampler._texture.valid() && sampler._matrix.isIdentity())
+            {
+                for (unsigned i = 0; i < sampler._texture->getNumImages(); ++i)
+                    if (sampler._texture->getImage(i))
+                        images.insert(sampler._texture->getImage(i));
+            }
+        }
+    }
+
+    size_t getDataSize(const osg::BufferData* data)
+    {
+        return data ? data->getTotalDataSize() : 0u;
+    }
+}
+
+void
+TileNode::updateMemoryFootprint()
+{
+    _memoryFootprint = computeMemoryFootprint();
+    _context->liveTiles()->updateMemoryFootprint( this );
+}
+
+size_t
+TileNode::computeMemoryFootprint() const
+{
+    size_t bytes = 0u;
+
+    std::set<const osg::Image*> images;
+
+    collectImages(_renderModel._sharedSamplers, images);
+
+    for (unsigned p = 0; p < _renderModel._passes.size(); ++p)
+        collectImages(_renderModel._passes[p].samplers(), images);
+
+    // usually the elevation texture's image, so it's only counted once
+    if (getElevationRaster() && getElevationMatrix().isIdentity())
+        images.insert(getElevationRaster());
+
+    for (std::set<const osg::Image*>::const_iterator i = images.begin(); i != images.end(); ++i)
+    {
+        size_t size = (*i)->getTotalSizeInBytesIncludingMipmaps();
+        bytes += size;              // GPU
+        if ((*i)->data())
+            bytes += size;          // CPU copy, unless it was released after apply
+    }
+
+    const TileDrawable* drawable = _surface.valid() ? _surface->getDrawable() : 0L;
+    if (drawable)
+    {
+        // Geometry lives on both the CPU and the GPU. The pool may share it
+        // with other tiles, but we count it in full.
+        const SharedGeometry* geom = drawable->_geom.get();
+        if (geom)
+        {
+            bytes += 2u * (
+                getDataSize(geom->getVertexArray()) +
+                getDataSize(geom->getNormalArray()) +
+                getDataSize(geom->getTexCoordArray()) +
+                getDataSize(geom->getNeighborArray()) +
+                getDataSize(geom->getNeighborNormalArray()) +
+                getDataSize(geom->getDrawElements()) +
+                getDataSize(geom->getMaskElements()));
+        }
+
+        // CPU mesh cache used for intersections and bounds
+        if (drawable->_tileSize > 0)
+        {
+            size_t n = drawable->_tileSize;
+            bytes += n*n*sizeof(osg::Vec3f) + (n-1)*(n-1)*6*sizeof(GLuint);
+        }
+    }
+
+    return bytes;
+}
+
 void
 TileNode::removeSubTiles()
 {
     _childrenReady = false;
     this->removeChildren(0, this->getNumChildren());
+    _loadChildrenRequest = 0L;
 }
 
 
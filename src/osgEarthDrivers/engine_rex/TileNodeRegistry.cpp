@@ -61,13 +61,14 @@ TileNodeRegistry::setMapRevision(const Revision& rev,
     {
         if ( _maprev != rev || setToDirty )
         {
-            Threading::ScopedWriteLock exclusive( _tilesMutex );
+            _maprev = rev;
 
-            if ( _maprev != rev || setToDirty )
+            for(unsigned s = 0; s < NUM_SHARDS; ++s)
             {
-                _maprev = rev;
+                Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+                TileNodeMap& tiles = _shards[s]._tiles;
 
-                for( TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+                for( TileNodeMap::iterator i = tiles.begin(); i != tiles.end(); ++i )
                 {
                     i->second.tile->setMapRevision( _maprev );
                     if ( setToDirty )
@@ -88,17 +89,21 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
                            unsigned         minLevel,
                            unsigned         maxLevel)
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
-    
     bool checkSRS = false;
-    for( TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i )
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
     {
-        const TileKey& key = i->first;
-        if (minLevel <= key.getLOD() && 
-            maxLevel >= key.getLOD() &&
-            extent.intersects(i->first.getExtent(), checkSRS) )
+        Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+        TileNodeMap& tiles = _shards[s]._tiles;
+
+        for( TileNodeMap::iterator i = tiles.begin(); i != tiles.end(); ++i )
         {
-            i->second.tile->setDirty( true );
+            const TileKey& key = i->first;
+            if (minLevel <= key.getLOD() && 
+                maxLevel >= key.getLOD() &&
+                extent.intersects(i->first.getExtent(), checkSRS) )
+            {
+                i->second.tile->setDirty( true );
+            }
         }
     }
 }
@@ -106,14 +111,27 @@ TileNodeRegistry::setDirty(const GeoExtent& extent,
 void
 TileNodeRegistry::addSafely(TileNode* tile)
 {
-    _tiles.insert( tile->getKey(), tile );
+    {
+        Shard& shard = getShard( tile->getKey() );
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+
+        RandomAccessTileMap::Entry* old = shard._tiles.findEntry( tile->getKey() );
+        if ( old )
+            shard._bytes -= old->bytes;
+
+        RandomAccessTileMap::Entry& entry = shard._tiles.insert( tile->getKey(), tile );
+        entry.bytes = tile->getMemoryFootprint();
+        shard._bytes += entry.bytes;
     
-    if ( _revisioningEnabled )
-        tile->setMapRevision( _maprev );
+        if ( _revisioningEnabled )
+            tile->setMapRevision( _maprev );
+    }
     
     // Start waiting on our neighbors
     if (_notifyNeighbors)
     {
+        Threading::ScopedMutexLock lock( _notifiersMutex );
+
         startListeningFor(tile->getKey().createNeighborKey(1, 0), tile);
         startListeningFor(tile->getKey().createNeighborKey(0, 1), tile);
 
@@ -125,8 +143,8 @@ TileNodeRegistry::addSafely(TileNode* tile)
 
             for(TileKeySet::iterator listener = listeners.begin(); listener != listeners.end(); ++listener)
             {
-                TileNode* listenerTile = _tiles.find( *listener );
-                if ( listenerTile )
+                osg::ref_ptr<TileNode> listenerTile;
+                if ( get(*listener, listenerTile) )
                 {
                     listenerTile->notifyOfArrival( tile );
                 }
@@ -135,31 +153,50 @@ TileNodeRegistry::addSafely(TileNode* tile)
         }
 
         OE_DEBUG << LC << _name 
-            << ": tiles=" << _tiles.size()
+            << ": tiles=" << size()
             << ", notifiers=" << _notifiers.size()
             << std::endl;
     }
 
-    Metrics::counter("RexStats", "Tiles", _tiles.size());
+    reportSize();
 }
 
-void
-TileNodeRegistry::removeSafely(const TileKey& key)
+bool
+TileNodeRegistry::removeSafely(const TileKey& key, osg::ref_ptr<TileNode>& out_tile)
 {
-    TileNode* tile = _tiles.find(key);
-    if (tile)
     {
-        if (_notifyNeighbors)
-        {
-            // remove neighbor listeners:
-            stopListeningFor(key.createNeighborKey(1, 0), tile);
-            stopListeningFor(key.createNeighborKey(0, 1), tile);
-        }
+        Shard& shard = getShard( key );
+        Threading::ScopedWriteLock exclusive( shard._mutex );
+
+        RandomAccessTileMap::Entry* entry = shard._tiles.findEntry(key);
+        if ( !entry || !entry->tile.valid() )
+            return false;
+
+        out_tile = entry->tile.get();
+        shard._bytes -= entry->bytes;
 
         // remove the tile.
-        _tiles.erase( key );
+        shard._tiles.erase( key );
+    }
 
-        Metrics::counter("RexStats", "Tiles", _tiles.size());
+    if (_notifyNeighbors)
+    {
+        // remove neighbor listeners:
+        Threading::ScopedMutexLock lock( _notifiersMutex );
+        stopListeningFor(key.createNeighborKey(1, 0), out_tile.get());
+        stopListeningFor(key.createNeighborKey(0, 1), out_tile.get());
+    }
+
+    reportSize();
+    return true;
+}
+
+void
+TileNodeRegistry::reportSize() const
+{
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("RexStats", "Tiles", size());
     }
 }
 
@@ -168,7 +205,6 @@ TileNodeRegistry::add( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
         addSafely( tile );
     }
 }
@@ -178,13 +214,12 @@ TileNodeRegistry::add( const TileNodeVector& tiles )
 {
     if ( tiles.size() > 0 )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
         for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
         {
             if ( i->valid() )
                 addSafely( i->get() );
         }
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+        OE_TEST << LC << _name << ": tiles=" << size() << std::endl;
     }
 }
 
@@ -193,8 +228,8 @@ TileNodeRegistry::remove( TileNode* tile )
 {
     if ( tile )
     {
-        Threading::ScopedWriteLock exclusive( _tilesMutex );
-        removeSafely( tile->getKey() );
+        osg::ref_ptr<TileNode> removed;
+        removeSafely( tile->getKey(), removed );
     }
 }
   
@@ -202,9 +237,10 @@ TileNodeRegistry::remove( TileNode* tile )
 bool
 TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedReadLock shared( _tilesMutex );
+    const Shard& shard = getShard( key );
+    Threading::ScopedReadLock shared( shard._mutex );
 
-    out_tile = _tiles.find(key);
+    out_tile = const_cast<TileNode*>(shard._tiles.find(key));
     return out_tile.valid();
 }
 
@@ -212,56 +248,94 @@ TileNodeRegistry::get( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 bool
 TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
-
-    out_tile = _tiles.find(key);
-    if ( out_tile.valid() )
-    {
-        removeSafely( key );
-    }
-    return out_tile.valid();
+    return removeSafely( key, out_tile );
 }
 
 
 void
 TileNodeRegistry::run( TileNodeRegistry::Operation& op )
 {
-    Threading::ScopedWriteLock lock( _tilesMutex );
-    unsigned size = _tiles.size();
-    op.operator()( _tiles );
-    if ( size != _tiles.size() )
-        OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedWriteLock lock( _shards[s]._mutex );
+        op.operator()( _shards[s]._tiles );
+    }
+    OE_TEST << LC << _name << ": tiles=" << size() << std::endl;
 }
 
 
 void
 TileNodeRegistry::run( const TileNodeRegistry::ConstOperation& op ) const
 {
-    Threading::ScopedReadLock lock( _tilesMutex );
-    op.operator()( _tiles );
-    OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock lock( _shards[s]._mutex );
+        op.operator()( _shards[s]._tiles );
+    }
+    OE_TEST << LC << _name << ": tiles=" << size() << std::endl;
+}
+
+
+unsigned
+TileNodeRegistry::size() const
+{
+    // don't bother mutex-protecting this.
+    unsigned total = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+        total += _shards[s]._tiles.size();
+    return total;
+}
+
+size_t
+TileNodeRegistry::getMemoryFootprint() const
+{
+    size_t total = 0u;
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        Threading::ScopedReadLock shared( _shards[s]._mutex );
+        total += _shards[s]._bytes;
+    }
+    return total;
 }
 
+void
+TileNodeRegistry::updateMemoryFootprint(TileNode* tile)
+{
+    Shard& shard = getShard( tile->getKey() );
+    Threading::ScopedWriteLock exclusive( shard._mutex );
+
+    // ignore tiles that are not (or no longer) registered here
+    RandomAccessTileMap::Entry* entry = shard._tiles.findEntry( tile->getKey() );
+    if ( entry && entry->tile.get() == tile )
+    {
+        shard._bytes -= entry->bytes;
+        entry->bytes = tile->getMemoryFootprint();
+        shard._bytes += entry->bytes;
+    }
+}
 
 bool
 TileNodeRegistry::empty() const
 {
-    // don't bother mutex-protecteding this.
-    return _tiles.empty();
+    // don't bother mutex-protecting this.
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+        if ( !_shards[s]._tiles.empty() )
+            return false;
+    return true;
 }
 
 void
 TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
 {
-    // ASSUME EXCLUSIVE LOCK
+    // ASSUME NOTIFIER LOCK
 
-    TileNode* tile = _tiles.find( tileToWaitFor );
-    if ( tile )
+    osg::ref_ptr<TileNode> tile;
+    if ( get(tileToWaitFor, tile) )
     {
         OE_DEBUG << LC << waiter->getKey().str() << " listened for " << tileToWaitFor.str()
             << ", but it was already in the repo.\n";
 
-        waiter->notifyOfArrival( tile );
+        waiter->notifyOfArrival( tile.get() );
     }
     else
     {
@@ -274,7 +348,7 @@ TileNodeRegistry::startListeningFor(const TileKey& tileToWaitFor, TileNode* wait
 void
 TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, TileNode* waiter)
 {
-    // ASSUME EXCLUSIVE LOCK
+    // ASSUME NOTIFIER LOCK
 
     TileKeyOneToMany::iterator i = _notifiers.find(tileToWaitFor);
     if (i != _notifiers.end())
@@ -293,10 +367,21 @@ TileNodeRegistry::stopListeningFor(const TileKey& tileToWaitFor, TileNode* waite
 TileNode*
 TileNodeRegistry::takeAny()
 {
-    Threading::ScopedWriteLock exclusive( _tilesMutex );
-    osg::ref_ptr<TileNode> tile = _tiles.begin()->second.tile.get();
-    removeSafely( tile->getKey() );
-    return tile.release();
+    for(unsigned s = 0; s < NUM_SHARDS; ++s)
+    {
+        TileKey key;
+        {
+            Threading::ScopedReadLock shared( _shards[s]._mutex );
+            if ( _shards[s]._tiles.empty() )
+                continue;
+            key = _shards[s]._tiles.begin()->first;
+        }
+
+        osg::ref_ptr<TileNode> tile;
+        if ( removeSafely(key, tile) )
+            return tile.release();
+    }
+    return 0L;
 }
 
 void
@@ -304,18 +389,26 @@ TileNodeRegistry::releaseAll(ResourceReleaser* releaser)
 {
     ResourceReleaser::ObjectList objects;
     {
-        Threading::ScopedWriteLock exclusive(_tilesMutex);
+        Threading::ScopedMutexLock lock( _notifiersMutex );
 
-        for (TileNodeMap::iterator i = _tiles.begin(); i != _tiles.end(); ++i)
+        for(unsigned s = 0; s < NUM_SHARDS; ++s)
         {
-            objects.push_back(i->second.tile.get());
+            Threading::ScopedWriteLock exclusive( _shards[s]._mutex );
+            TileNodeMap& tiles = _shards[s]._tiles;
+
+            for (TileNodeMap::iterator i = tiles.begin(); i != tiles.end(); ++i)
+            {
+                objects.push_back(i->second.tile.get());
+            }
+
+            tiles.clear();
+            _shards[s]._bytes = 0u;
         }
 
-        _tiles.clear();
         _notifiers.clear();
-
-        Metrics::counter("RexStats", "Tiles", _tiles.size());
     }
 
+    reportSize();
+
     releaser->push(objects);
-}
\ No newline at end of file
+}
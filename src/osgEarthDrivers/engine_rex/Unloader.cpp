@@ -23,6 +23,8 @@
 #include <osgEarth/Metrics>
 #include <osgEarth/NodeUtils>
 
+#include <map>
+
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
 
@@ -36,11 +38,12 @@ namespace
     {
         TileNodeRegistry*      _tiles;
         unsigned               _count;
+        size_t                 _bytes;
 
         ResourceReleaser::ObjectList _nodes;
 
         ExpirationCollector(TileNodeRegistry* tiles)
-            : _tiles(tiles), _count(0)
+            : _tiles(tiles), _count(0), _bytes(0)
         {
             // set up to traverse the entire subgraph, ignoring node masks.
             setTraversalMode( TRAVERSE_ALL_CHILDREN );
@@ -55,11 +58,21 @@ namespace
             {
                 _nodes.push_back(tn);
                 _tiles->remove( tn );
+                _bytes += tn->getMemoryFootprint();
                 _count++;
             }
             traverse(node);
         }
     };
+
+    // most recent frame in which any of a tile's subtiles was visited.
+    unsigned getLastSubTileTraversalFrame(TileNode* parent)
+    {
+        unsigned frame = 0u;
+        for (unsigned i = 0; i < parent->getNumChildren(); ++i)
+            frame = osg::maximum(frame, parent->getSubTile(i)->getLastTraversalFrame());
+        return frame;
+    }
 }
 
 //........................................................................
@@ -70,7 +83,8 @@ namespace
 
 UnloaderGroup::UnloaderGroup(TileNodeRegistry* tiles) :
 _tiles(tiles),
-_threshold( INT_MAX )
+_threshold( INT_MAX ),
+_memoryBudget( 0u )
 {
     ADJUST_EVENT_TRAV_COUNT(this, +1);
 }
@@ -84,46 +98,119 @@ UnloaderGroup::unloadChildren(const std::vector<TileKey>& keys)
     _mutex.unlock();
 }
 
+unsigned
+UnloaderGroup::unloadSubTiles(TileNode* parentNode, size_t& out_bytes)
+{
+    // find and move all tiles to be unloaded to the dead pile.
+    ExpirationCollector collector( _tiles );
+    for(unsigned i=0; i<parentNode->getNumChildren(); ++i)
+        parentNode->getSubTile(i)->accept( collector );
+
+    // submit all collected nodes for GL resource release:
+    if (!collector._nodes.empty() && _releaser.valid())
+        _releaser->push(collector._nodes);
+
+    parentNode->removeSubTiles();
+
+    out_bytes += collector._bytes;
+    return collector._count;
+}
+
 void
 UnloaderGroup::traverse(osg::NodeVisitor& nv)
 {
     if ( nv.getVisitorType() == nv.EVENT_VISITOR )
-    {        
-        if ( _parentKeys.size() > _threshold )
+    {
+        if ( _memoryBudget > 0u )
+        {
+            if ( !_parentKeys.empty() )
+                expireByMemory( nv );
+        }
+        else if ( _parentKeys.size() > _threshold )
         {
-            ScopedMetric m("Unloader expire");
+            expireByCount( nv );
+        }
+    }
+    osg::Group::traverse( nv );
+}
+
+void
+UnloaderGroup::expireByCount(osg::NodeVisitor& nv)
+{
+    ScopedMetric m("Unloader expire");
 
-            unsigned unloaded=0, notFound=0, notDormant=0;
-            Threading::ScopedMutexLock lock( _mutex );
-            for(std::set<TileKey>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
+    unsigned unloaded=0, notFound=0, notDormant=0;
+    size_t bytes = 0;
+    Threading::ScopedMutexLock lock( _mutex );
+    for(std::set<TileKey>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
+    {
+        osg::ref_ptr<TileNode> parentNode;
+        if ( _tiles->get(*parentKey, parentNode) )
+        {
+            // re-check for dormancy in case something has changed
+            if ( parentNode->areSubTilesDormant(nv.getFrameStamp()) )
             {
-                osg::ref_ptr<TileNode> parentNode;
-                if ( _tiles->get(*parentKey, parentNode) )
-                {
-                    // re-check for dormancy in case something has changed
-                    if ( parentNode->areSubTilesDormant(nv.getFrameStamp()) )
-                    {
-                        // find and move all tiles to be unloaded to the dead pile.
-                        ExpirationCollector collector( _tiles );
-                        for(unsigned i=0; i<parentNode->getNumChildren(); ++i)
-                            parentNode->getSubTile(i)->accept( collector );
-                        unloaded += collector._count;
-
-                        // submit all collected nodes for GL resource release:
-                        if (!collector._nodes.empty() && _releaser.valid())
-                            _releaser->push(collector._nodes);
-
-                        parentNode->removeSubTiles();
-                    }
-                    else notDormant++;
-                }
-                else notFound++;
+                unloaded += unloadSubTiles( parentNode.get(), bytes );
             }
-
-            OE_DEBUG << LC << "Total=" << _parentKeys.size() << "; threshold=" << _threshold << "; unloaded=" << unloaded << "; notDormant=" << notDormant << "; notFound=" << notFound << "\n";
-            _parentKeys.clear();
+            else notDormant++;
         }
+        else notFound++;
     }
-    osg::Group::traverse( nv );
+
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("RexUnloader", "Unloaded", unloaded);
+    }
+
+    OE_DEBUG << LC << "Total=" << _parentKeys.size() << "; threshold=" << _threshold << "; unloaded=" << unloaded << "; notDormant=" << notDormant << "; notFound=" << notFound << "\n";
+    _parentKeys.clear();
 }
 
+void
+UnloaderGroup::expireByMemory(osg::NodeVisitor& nv)
+{
+    ScopedMetric m("Unloader expire");
+
+    size_t total = _tiles->getMemoryFootprint();
+
+    unsigned unloaded = 0;
+    size_t bytes = 0;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( total > _memoryBudget )
+    {
+        // order the dormant candidates by when their subtiles were last visited:
+        typedef std::multimap<unsigned, osg::ref_ptr<TileNode> > LRU;
+        LRU lru;
+        for(std::set<TileKey>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
+        {
+            osg::ref_ptr<TileNode> parentNode;
+            if ( _tiles->get(*parentKey, parentNode) && parentNode->areSubTilesDormant(nv.getFrameStamp()) )
+            {
+                lru.insert( std::make_pair(getLastSubTileTraversalFrame(parentNode.get()), parentNode) );
+            }
+        }
+
+        // evict the oldest first until we're under budget.
+        for(LRU::iterator i = lru.begin(); i != lru.end() && bytes < total && total - bytes > _memoryBudget; ++i)
+        {
+            // skip tiles already removed along with an ancestor's subtree
+            osg::ref_ptr<TileNode> stillLive;
+            if ( _tiles->get(i->second->getKey(), stillLive) )
+            {
+                unloaded += unloadSubTiles( i->second.get(), bytes );
+            }
+        }
+    }
+
+    size_t live = bytes < total ? total - bytes : 0u;
+
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("RexUnloader", "Unloaded", unloaded, "Live MB", (double)live/1048576.0);
+    }
+
+    OE_DEBUG << LC << "Live=" << live << " bytes; budget=" << _memoryBudget << "; candidates=" << _parentKeys.size() << "; unloaded=" << unloaded << " (" << bytes << " bytes)\n";
+    _parentKeys.clear();
+}
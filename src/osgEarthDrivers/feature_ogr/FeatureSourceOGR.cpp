@@ -529,7 +529,7 @@ public:
         OGRFeatureH feature_handle = OGR_F_Create( OGR_L_GetLayerDefn( _layerHandle ) );
         if ( feature_handle )
         {
-            const AttributeTable& attrs = feature->getAttrs();
+            const AttributeTable& attrs = feature->getAllAttrs();
 
             // assign the attributes:
             int num_fields = OGR_F_GetFieldCount( feature_handle );
@@ -26,6 +26,7 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/URI>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ThreadingUtils>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -35,6 +36,7 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <map>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -690,7 +692,9 @@ public:
       _warpedDS(NULL),
       _options(options),
       _maxDataLevel(30),
-      _linearUnits(1.0)
+      _linearUnits(1.0),
+      _warpPolar(false),
+      _threadSafeReads(false)
     {
     }
 
@@ -698,6 +702,16 @@ public:
     {
         GDAL_SCOPED_LOCK;
 
+        // Close any per-thread dataset handles:
+        for (ThreadDatasets::iterator i = _threadDatasets.begin(); i != _threadDatasets.end(); ++i)
+        {
+            if (i->second._warpedDS && i->second._warpedDS != i->second._srcDS)
+                GDALClose(i->second._warpedDS);
+            if (i->second._srcDS)
+                GDALClose(i->second._srcDS);
+        }
+        _threadDatasets.clear();
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -846,6 +860,7 @@ public:
                         if (_srcDS)
                         {
                             OE_INFO << LC << INDENT << "Read VRT from cache!" << std::endl;
+                            _reopenPath = result.getString();
                         }
                     }
                 }
@@ -861,6 +876,14 @@ public:
 
                     if (_srcDS)
                     {
+                        // An in-memory VRT has no file to reopen, but GDAL will
+                        // open its XML description directly:
+                        char** vrtXML = _srcDS->GetMetadata("xml:VRT");
+                        if (vrtXML && vrtXML[0])
+                        {
+                            _reopenPath = vrtXML[0];
+                        }
+
                         //Cache the VRT so we don't have to build it next time.
                         if (_cacheBin)
                         {
@@ -903,6 +926,7 @@ public:
                 //If we couldn't build a VRT, just try opening the file directly
                 //Open the dataset
                 _srcDS = (GDALDataset*)GDALOpen( files[0].c_str(), GA_ReadOnly );
+                _reopenPath = files[0];
 
                 if (_srcDS)
                 {
@@ -920,6 +944,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _reopenPath = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -1050,27 +1075,12 @@ public:
 
         if ( requiresReprojection || (profile && !profile->getSRS()->isEquivalentTo( src_srs.get() )) )
         {
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {
-                std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            // remember the warp parameters so we can build the same VRT for each reading thread
+            _warpPolar = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
+            _warpSrcWKT = src_srs->getWKT();
+            _warpDstWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+
+            _warpedDS = createWarpedDataset(_srcDS);
 
             if ( _warpedDS )
             {
@@ -1249,17 +1259,113 @@ public:
         setProfile( profile );
         OE_DEBUG << LC << INDENT << "Set Profile to " << (profile ? profile->toString() : "NULL") <<  std::endl;
 
+        if (_options.threadSafeReads() == true)
+        {
+            if (_reopenPath.empty())
+            {
+                OE_WARN << LC << INDENT << "thread_safe_reads is not available for this source; reads will be serialized" << std::endl;
+            }
+            else
+            {
+                _threadSafeReads = true;
+                OE_INFO << LC << INDENT << "Using per-thread datasets for concurrent reads" << std::endl;
+            }
+        }
+
         return STATUS_OK;
     }
 
+    /**
+    * Creates the warped VRT for a source dataset using the parameters
+    * established in initialize(). Caller must hold the GDAL lock.
+    */
+    GDALDataset* createWarpedDataset(GDALDataset* srcDS)
+    {
+        if (_warpSrcWKT.empty())
+        {
+            return srcDS;
+        }
+        else if (_warpPolar)
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    /**
+    * Gets the calling thread's own (warped) dataset, opening it on first use.
+    * Only the open itself runs under the GDAL lock; reads from the returned
+    * dataset do not need it since no other thread touches it.
+    * Returns NULL if the dataset could not be opened.
+    */
+    GDALDataset* getThreadDataset()
+    {
+        unsigned id = Threading::getCurrentThreadId();
+        {
+            Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+            ThreadDatasets::const_iterator i = _threadDatasets.find(id);
+            if (i != _threadDatasets.end())
+                return i->second._warpedDS;
+        }
+
+        Datasets ds;
+        {
+            GDAL_SCOPED_LOCK;
+            ds._srcDS = (GDALDataset*)GDALOpen(_reopenPath.c_str(), GA_ReadOnly);
+            if (ds._srcDS)
+            {
+                ds._warpedDS = createWarpedDataset(ds._srcDS);
+                if (!ds._warpedDS)
+                {
+                    GDALClose(ds._srcDS);
+                    ds._srcDS = 0L;
+                }
+            }
+        }
+
+        if (!ds._warpedDS)
+        {
+            OE_WARN << LC << "Failed to open a per-thread dataset; falling back on serialized reads" << std::endl;
+        }
+
+        // store the result even on failure so we don't retry on every read
+        Threading::ScopedMutexLock lock(_threadDatasetsMutex);
+        _threadDatasets[id] = ds;
+        return ds._warpedDS;
+    }
+
+    /**
+    * Holds the global GDAL lock unless the caller is reading from its own
+    * per-thread dataset.
+    */
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _mutex(lock ? &getGDALMutex() : 0L) { if (_mutex) _mutex->lock(); }
+        ~OptionalGDALLock() { if (_mutex) _mutex->unlock(); }
+        OpenThreads::ReentrantMutex* _mutex;
+    };
+
 
     /**
     * Finds a raster band based on color interpretation
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1269,8 +1375,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1447,18 +1551,140 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        return readImage( key.getExtent(), getPixelsPerTile(), progress );
+    }
+
+    /**
+    * Reads the four children of a key. When a single read of the key's extent
+    * at twice the tile size gives exactly the pixels of four separate reads,
+    * that one read is split up; otherwise each child gets its own read window,
+    * with all four reads under one hold of the dataset.
+    */
+    bool createChildImages( const TileKey&           key,
+        osg::ref_ptr<osg::Image> out_images[4],
+        ProgressCallback*        progress)
+    {
+        if (key.getLevelOfDetail()+1 > _maxDataLevel)
+            return false;
+
+        int tileSize = getPixelsPerTile();
+
+        if ( !canSplitChildReads(key) )
+        {
+            GDALDataset* warpedDS = _threadSafeReads ? getThreadDataset() : 0L;
+            OptionalGDALLock lock( warpedDS == 0L );
+
+            bool any = false;
+            for (unsigned q = 0; q < 4; ++q)
+            {
+                out_images[q] = readImage( key.createChildKey(q).getExtent(), tileSize, progress );
+                any = any || out_images[q].valid();
+            }
+            return any;
+        }
+
+        osg::ref_ptr<osg::Image> image = readImage( key.getExtent(), 2*tileSize, progress );
+        if (!image.valid())
+            return false;
+
+        // Rows run south to north after the read, and child quadrants 0 and 1
+        // are the northern ones (see TileKey::createChildKey).
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            int col = (q & 1) ? tileSize : 0;
+            int row = (q & 2) ? 0 : tileSize;
+
+            osg::Image* child = new osg::Image();
+            child->allocateImage(tileSize, tileSize, 1, image->getPixelFormat(), image->getDataType());
+            child->setInternalTextureFormat(image->getInternalTextureFormat());
+            ImageUtils::markAsUnNormalized(child, ImageUtils::isUnNormalized(image.get()));
+
+            unsigned rowBytes = child->getRowSizeInBytes();
+            for (int t = 0; t < tileSize; ++t)
+            {
+                memcpy(child->data(0, t), image->data(col, row + t), rowBytes);
+            }
+
+            out_images[q] = child;
+        }
+
+        return true;
+    }
+
+    /**
+    * Source pixel window that readImage uses for an extent lying inside the
+    * dataset: the pixel bounds, widened to whole pixels.
+    */
+    void getReadWindow(const GeoExtent& extent, int& off_x, int& off_y, int& width, int& height)
+    {
+        double src_min_x, src_min_y, src_max_x, src_max_y;
+        geoToPixel( extent.xMin(), extent.yMax(), src_min_x, src_min_y );
+        geoToPixel( extent.xMax(), extent.yMin(), src_max_x, src_max_y );
+
+        off_x  = (int)floor(src_min_x);
+        off_y  = (int)floor(src_min_y);
+        width  = (int)ceil(src_max_x) - off_x;
+        height = (int)ceil(src_max_y) - off_y;
+    }
 
-        int tileSize = getPixelsPerTile(); //_options.tileSize().value();
+    /**
+    * Whether splitting one double-size read of a key gives the same pixels as
+    * reading each child on its own. That holds only for nearest sampling, with
+    * the key inside the data, and when the children's read windows are exactly
+    * the four halves of the parent's. Otherwise the resampling kernel and the
+    * whole-pixel widening straddle the child seams.
+    */
+    bool canSplitChildReads(const TileKey& key)
+    {
+        if ( *_options.interpolation() != INTERP_NEAREST )
+            return false;
+
+        const GeoExtent& extent = key.getExtent();
+        if ( extent.xMin() < _bounds.xMin() || extent.xMax() > _bounds.xMax() ||
+             extent.yMin() < _bounds.yMin() || extent.yMax() > _bounds.yMax() )
+            return false;
+
+        int x, y, w, h;
+        getReadWindow( extent, x, y, w, h );
+        if ( w <= 0 || h <= 0 || w % 2 != 0 || h % 2 != 0 )
+            return false;
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            int cx, cy, cw, ch;
+            getReadWindow( key.createChildKey(q).getExtent(), cx, cy, cw, ch );
+
+            // quadrants 0 and 1 are the northern ones, at the top of the window
+            int ex = (q & 1) ? x + w/2 : x;
+            int ey = (q & 2) ? y + h/2 : y;
+            if ( cx != ex || cy != ey || cw != w/2 || ch != h/2 )
+                return false;
+        }
+        return true;
+    }
+
+    /**
+    * Reads an extent of the dataset into a square image of the given size.
+    */
+    osg::Image* readImage( const GeoExtent&  tileExtent,
+        int               tileSize,
+        ProgressCallback* progress)
+    {
+        // Read from this thread's own dataset if we can; otherwise serialize
+        // on the global GDAL lock.
+        GDALDataset* warpedDS = _threadSafeReads ? getThreadDataset() : 0L;
+        OptionalGDALLock lock( warpedDS == 0L );
+        if ( !warpedDS )
+            warpedDS = _warpedDS;
 
         osg::ref_ptr<osg::Image> image;
 
         //Get the extents of the tile
         double xmin, ymin, xmax, ymax;
-        key.getExtent().getBounds(xmin, ymin, xmax, ymax);
+        tileExtent.getBounds(xmin, ymin, xmax, ymax);
 
         // Compute the intersection of the incoming key with the data extents of the dataset
-        osgEarth::GeoExtent intersection = key.getExtent().intersectionSameSRS( _extents );
+        osgEarth::GeoExtent intersection = tileExtent.intersectionSameSRS( _extents );
         if (!intersection.isValid())
         {
             return 0;
@@ -1512,8 +1738,8 @@ public:
         int height = (int)(src_max_y - src_min_y);
 
 
-        int rasterWidth = _warpedDS->GetRasterXSize();
-        int rasterHeight = _warpedDS->GetRasterYSize();
+        int rasterWidth = warpedDS->GetRasterXSize();
+        int rasterHeight = warpedDS->GetRasterYSize();
         if (off_x + width > rasterWidth || off_y + height > rasterHeight)
         {
             OE_WARN << LC << "Read window outside of bounds of dataset.  Source Dimensions=" << rasterWidth << "x" << rasterHeight << " Read Window=" << off_x << ", " << off_y << " " << width << "x" << height << std::endl;
@@ -1526,10 +1752,10 @@ public:
         double offset_top = ymax - intersection.yMax();
 
 
-        int target_width = (int)ceil((intersection.width() / key.getExtent().width())*(double)tileSize);
-        int target_height = (int)ceil((intersection.height() / key.getExtent().height())*(double)tileSize);
-        int tile_offset_left = (int)floor((offset_left / key.getExtent().width()) * (double)tileSize);
-        int tile_offset_top = (int)floor((offset_top / key.getExtent().height()) * (double)tileSize);
+        int target_width = (int)ceil((intersection.width() / tileExtent.width())*(double)tileSize);
+        int target_height = (int)ceil((intersection.height() / tileExtent.height())*(double)tileSize);
+        int tile_offset_left = (int)floor((offset_left / tileExtent.width()) * (double)tileSize);
+        int tile_offset_top = (int)floor((offset_top / tileExtent.height()) * (double)tileSize);
 
         // Compute spacing
         double dx       = (xmax - xmin) / (tileSize-1);
@@ -1547,44 +1773,44 @@ public:
 
 
 
-        GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-        GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-        GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-        GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+        GDALRasterBand* bandRed = findBandByColorInterp(warpedDS, GCI_RedBand);
+        GDALRasterBand* bandGreen = findBandByColorInterp(warpedDS, GCI_GreenBand);
+        GDALRasterBand* bandBlue = findBandByColorInterp(warpedDS, GCI_BlueBand);
+        GDALRasterBand* bandAlpha = findBandByColorInterp(warpedDS, GCI_AlphaBand);
 
-        GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+        GDALRasterBand* bandGray = findBandByColorInterp(warpedDS, GCI_GrayIndex);
 
-        GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+        GDALRasterBand* bandPalette = findBandByColorInterp(warpedDS, GCI_PaletteIndex);
 
         if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
         {
             OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
             //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
             //RGB = 3 bands
-            if (_warpedDS->GetRasterCount() == 3)
+            if (warpedDS->GetRasterCount() == 3)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
             }
             //RGBA = 4 bands
-            else if (_warpedDS->GetRasterCount() == 4)
+            else if (warpedDS->GetRasterCount() == 4)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
-                bandAlpha = _warpedDS->GetRasterBand( 4 );
+                bandRed   = warpedDS->GetRasterBand( 1 );
+                bandGreen = warpedDS->GetRasterBand( 2 );
+                bandBlue  = warpedDS->GetRasterBand( 3 );
+                bandAlpha = warpedDS->GetRasterBand( 4 );
             }
             //Gray = 1 band
-            else if (_warpedDS->GetRasterCount() == 1)
+            else if (warpedDS->GetRasterCount() == 1)
             {
-                bandGray = _warpedDS->GetRasterBand( 1 );
+                bandGray = warpedDS->GetRasterBand( 1 );
             }
             //Gray + alpha = 2 bands
-            else if (_warpedDS->GetRasterCount() == 2)
+            else if (warpedDS->GetRasterCount() == 2)
             {
-                bandGray  = _warpedDS->GetRasterBand( 1 );
-                bandAlpha = _warpedDS->GetRasterBand( 2 );
+                bandGray  = warpedDS->GetRasterBand( 1 );
+                bandAlpha = warpedDS->GetRasterBand( 2 );
             }
         }
 
@@ -1912,9 +2138,9 @@ public:
         return true;
     }
 
+    // Callers either hold the GDAL lock or own the band's (per-thread) dataset.
     bool isValidValue(float v, GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
         return isValidValue_noLock( v, band );
     }
 
@@ -2046,7 +2272,12 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // Read from this thread's own dataset if we can; otherwise serialize
+        // on the global GDAL lock.
+        GDALDataset* warpedDS = _threadSafeReads ? getThreadDataset() : 0L;
+        OptionalGDALLock lock( warpedDS == 0L );
+        if ( !warpedDS )
+            warpedDS = _warpedDS;
 
         int tileSize = getPixelsPerTile();
 
@@ -2061,11 +2292,11 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(warpedDS, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = warpedDS->GetRasterBand(1);
             }
 
             if (_options.interpolation() == INTERP_NEAREST)
@@ -2084,9 +2315,9 @@ public:
                 int iNumRows = iRowMax - iRowMin + 1;
 
                 int iWinColMin = max(0, iColMin);
-                int iWinColMax = min(_warpedDS->GetRasterXSize()-1, iColMax);
+                int iWinColMax = min(warpedDS->GetRasterXSize()-1, iColMax);
                 int iWinRowMin = max(0, iRowMin);
-                int iWinRowMax = min(_warpedDS->GetRasterYSize()-1, iRowMax);
+                int iWinRowMax = min(warpedDS->GetRasterYSize()-1, iRowMax);
                 int iNumWinCols = iWinColMax - iWinColMin + 1;
                 int iNumWinRows = iWinRowMax - iWinRowMin + 1;
 
@@ -2158,6 +2389,26 @@ private:
     osg::ref_ptr< osgDB::Options > _dbOptions;
 
     unsigned int _maxDataLevel;
+
+    // Parameters for (re)creating the warped VRT
+    bool        _warpPolar;
+    std::string _warpSrcWKT;
+    std::string _warpDstWKT;
+
+    // Per-thread dataset handles, keyed by thread ID, for thread_safe_reads.
+    // The shared _srcDS/_warpedDS remain the "master" datasets; only immutable
+    // properties (e.g. raster size) are read from them without the GDAL lock.
+    struct Datasets
+    {
+        Datasets() : _srcDS(0L), _warpedDS(0L) { }
+        GDALDataset* _srcDS;
+        GDALDataset* _warpedDS;
+    };
+    typedef std::map<unsigned, Datasets> ThreadDatasets;
+    ThreadDatasets   _threadDatasets;
+    Threading::Mutex _threadDatasetsMutex;
+    std::string      _reopenPath;
+    bool             _threadSafeReads;
 };
 
 
@@ -24,6 +24,7 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/Cache>
 #include <osgDB/FileUtils>
 
 #include <sstream>
@@ -61,6 +62,16 @@ MBTilesTileSource::MBTilesTileSource(const TileSourceOptions& options) :
 TileSource( options ),
 _options  ( options ),
 _database ( NULL ),
+_insertStmt( NULL ),
+_insertImageStmt( NULL ),
+_insertMapStmt( NULL ),
+_selectMapStmt( NULL ),
+_deleteImageStmt( NULL ),
+_selectStmt( NULL ),
+_pendingWrites( 0u ),
+_deduplicate( false ),
+_numWrites( 0u ),
+_numSharedWrites( 0u ),
 _minLevel ( 0 ),
 _maxLevel ( 20 ),
 _forceRGB ( false )
@@ -68,6 +79,39 @@ _forceRGB ( false )
     //nop
 }
 
+MBTilesTileSource::~MBTilesTileSource()
+{
+    {
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
+        commit();
+
+        if ( _deduplicate && _numWrites > 0u )
+        {
+            OE_INFO << LC << _numSharedWrites << " of " << _numWrites << " tiles deduplicated ("
+                << (100.0*(double)_numSharedWrites/(double)_numWrites) << "%)" << std::endl;
+        }
+
+        sqlite3_finalize( _insertStmt );
+        sqlite3_finalize( _insertImageStmt );
+        sqlite3_finalize( _insertMapStmt );
+        sqlite3_finalize( _selectMapStmt );
+        sqlite3_finalize( _deleteImageStmt );
+        sqlite3_finalize( _selectStmt );
+        sqlite3_close( _database );
+        _insertStmt = NULL;
+        _selectStmt = NULL;
+        _database = NULL;
+    }
+
+    Threading::ScopedMutexLock lock(_readConnectionsMutex);
+    for (ReadConnections::iterator i = _readConnections.begin(); i != _readConnections.end(); ++i)
+    {
+        sqlite3_finalize( i->second._select );
+        sqlite3_close( i->second._db );
+    }
+    _readConnections.clear();
+}
+
 Status
 MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
 {
@@ -120,6 +164,19 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
             << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(_database) );
     }
 
+    _fullFilename = fullFilename;
+
+    // Write-ahead logging lets readers on other connections see committed
+    // tiles while a write transaction is open. The setting persists in the file.
+    if ( readWrite && _options.wal() == true )
+    {
+        if ( SQLITE_OK != sqlite3_exec(_database, "PRAGMA journal_mode=WAL", 0L, 0L, 0L) ||
+             SQLITE_OK != sqlite3_exec(_database, "PRAGMA synchronous=NORMAL", 0L, 0L, 0L) )
+        {
+            OE_WARN << LC << "Failed to enable WAL journaling: " << sqlite3_errmsg(_database) << std::endl;
+        }
+    }
+
     // New database setup:
     if ( isNewDatabase )
     {
@@ -165,6 +222,16 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
     // If the database pre-existed, read in the information from the metadata.
     else // !isNewDatabase
     {
+        // writes must go to the underlying tables if [tiles] is a dedup view.
+        _deduplicate = hasTable("map") && hasTable("images");
+
+        // replacing a tile releases its old image, which needs a lookup by image.
+        if ( _deduplicate && readWrite &&
+             SQLITE_OK != sqlite3_exec(_database, "CREATE INDEX IF NOT EXISTS map_tile_id ON map (tile_id)", 0L, 0L, 0L) )
+        {
+            OE_WARN << LC << "Failed to index [map] by image: " << sqlite3_errmsg(_database) << std::endl;
+        }
+
         if ( _options.computeLevels() == true )
         {
             computeLevels();
@@ -278,6 +345,14 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
         osgEarth::endsWith(_tileFormat, "jpg", false) ||
         osgEarth::endsWith(_tileFormat, "jpeg", false);
 
+    // prepare the tile query once up front; it's reused for every read on this connection.
+    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+    if ( SQLITE_OK != sqlite3_prepare_v2(_database, query.c_str(), -1, &_selectStmt, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        _selectStmt = NULL;
+    }
+
     // make an empty image.
     int size = 256;
     _emptyImage = new osg::Image();
@@ -299,12 +374,79 @@ MBTilesTileSource::getCachePolicyHint(const Profile* targetProfile) const
 }
 
 
+bool
+MBTilesTileSource::readTileData(sqlite3* db, sqlite3_stmt* select, int z, int x, int y, std::string& out) const
+{
+    if ( select == NULL )
+        return false;
+
+    sqlite3_bind_int( select, 1, z );
+    sqlite3_bind_int( select, 2, x );
+    sqlite3_bind_int( select, 3, y );
+
+    bool found = false;
+    int rc = sqlite3_step( select );
+    if ( rc == SQLITE_ROW)
+    {
+        // the pointer returned from _blob gets freed internally by sqlite, supposedly
+        const char* data = (const char*)sqlite3_column_blob( select, 0 );
+        int dataLen = sqlite3_column_bytes( select, 0 );
+        out.assign( data, dataLen );
+        found = true;
+    }
+    else if ( rc != SQLITE_DONE )
+    {
+        OE_DEBUG << LC << "SQL QUERY failed: " << sqlite3_errmsg(db) << std::endl;
+    }
+
+    sqlite3_reset( select );
+    sqlite3_clear_bindings( select );
+    return found;
+}
+
+MBTilesTileSource::ReadConnection*
+MBTilesTileSource::getReadConnection()
+{
+    unsigned id = Threading::getCurrentThreadId();
+
+    Threading::ScopedMutexLock lock(_readConnectionsMutex);
+
+    ReadConnections::iterator i = _readConnections.find(id);
+    if ( i != _readConnections.end() )
+        return &i->second;
+
+    ReadConnection conn;
+    conn._db = NULL;
+    conn._select = NULL;
+
+    int rc = sqlite3_open_v2( _fullFilename.c_str(), &conn._db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L );
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Failed to open read connection to \"" << _fullFilename << "\": " << sqlite3_errmsg(conn._db) << std::endl;
+        sqlite3_close( conn._db );
+        return NULL;
+    }
+
+    // without WAL, a reader can collide with a write transaction; wait it out.
+    sqlite3_busy_timeout( conn._db, 5000 );
+
+    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+    if ( SQLITE_OK != sqlite3_prepare_v2(conn._db, query.c_str(), -1, &conn._select, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(conn._db) << std::endl;
+        sqlite3_close( conn._db );
+        return NULL;
+    }
+
+    ReadConnection& result = _readConnections[id];
+    result = conn;
+    return &result;
+}
+
 osg::Image*
 MBTilesTileSource::createImage(const TileKey&    key,
                                ProgressCallback* progress)
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -324,66 +466,47 @@ MBTilesTileSource::createImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
-    {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
-    }
+    // Get the image data. Only the database access is serialized; decompression
+    // and decoding happen outside the lock.
+    std::string dataBuffer;
+    bool found = false;
 
-    bool valid = true;
-
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
+    if ( _options.concurrentReads() == true )
+    {
+        ReadConnection* conn = getReadConnection();
+        if ( !conn )
+            return NULL;
 
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
+        found = readTileData( conn->_db, conn->_select, z, x, y, dataBuffer );
+    }
+    else
     {
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+        Threading::ScopedMutexLock exclusiveLock(_mutex);
+        found = readTileData( _database, _selectStmt, z, x, y, dataBuffer );
+    }
 
-        std::string dataBuffer( data, dataLen );
+    if ( !found )
+        return NULL;
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                if ( _options.filename().isSet() )
-                    OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
-                else
-                    OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
+            if ( _options.filename().isSet() )
+                OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
             else
-            {
-                dataBuffer = value;
-            }
-        }
-
-        // decode the raw image data:
-        if ( valid )
-        {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
+                OE_WARN << LC << "Decompression failed" << std::endl;
+            return NULL;
         }
-    }
-    else
-    {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        dataBuffer = value;
     }
 
-    sqlite3_finalize( select );
-    return result;
+    // decode the raw image data:
+    std::istringstream inputStream(dataBuffer);
+    return ImageUtils::readStream(inputStream, _dbOptions.get());
 }
 
 bool
@@ -394,8 +517,6 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     if ( (getMode() & MODE_WRITE) == 0 )
         return false;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -438,47 +559,199 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
-    if ( rc != SQLITE_OK )
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    // open a new transaction at the start of each batch. Deduplicated writes
+    // touch two tables, so they always get a transaction.
+    unsigned batchSize = _options.batchSize().get();
+    bool useTransaction = batchSize > 1u || _deduplicate;
+    if ( useTransaction && _pendingWrites == 0u )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        if ( SQLITE_OK != sqlite3_exec(_database, "BEGIN TRANSACTION", 0L, 0L, 0L) )
+        {
+            OE_WARN << LC << "Failed to begin transaction: " << sqlite3_errmsg(_database) << std::endl;
+            return false;
+        }
+    }
+
+    bool ok;
+
+    if ( _deduplicate )
+    {
+        // Store each distinct blob once in [images], keyed by the hash of its contents,
+        // and point the tile at it from [map].
+        std::string tileID = Cache::makeContentHash( value );
+
+        ok =
+            prepare( "INSERT OR IGNORE INTO images (tile_id, tile_data) VALUES (?, ?)", _insertImageStmt ) &&
+            prepare( "INSERT OR REPLACE INTO map (zoom_level, tile_column, tile_row, tile_id) VALUES (?, ?, ?, ?)", _insertMapStmt );
+
+        if ( ok )
+        {
+            sqlite3_bind_text( _insertImageStmt, 1, tileID.c_str(), tileID.length(), SQLITE_STATIC );
+            sqlite3_bind_blob( _insertImageStmt, 2, value.c_str(), value.length(), SQLITE_STATIC );
+            ok = execute( _insertImageStmt );
+
+            if ( ok )
+            {
+                ++_numWrites;
+                if ( sqlite3_changes(_database) == 0 )
+                {
+                    ++_numSharedWrites;
+                }
+                if ( _numWrites % 1000u == 0u )
+                {
+                    OE_INFO << LC << "Dedup ratio " << (100.0*(double)_numSharedWrites/(double)_numWrites)
+                        << "% (" << _numWrites << " tiles)" << std::endl;
+                }
+
+                // the image this tile used before, if any:
+                std::string oldTileID;
+                ok = getTileID( z, x, y, oldTileID );
+
+                if ( ok )
+                {
+                    sqlite3_bind_int( _insertMapStmt, 1, z );
+                    sqlite3_bind_int( _insertMapStmt, 2, x );
+                    sqlite3_bind_int( _insertMapStmt, 3, y );
+                    sqlite3_bind_text( _insertMapStmt, 4, tileID.c_str(), tileID.length(), SQLITE_STATIC );
+                    ok = execute( _insertMapStmt );
+                }
+
+                // drop the old image once no tile refers to it.
+                if ( ok && !oldTileID.empty() && oldTileID != tileID )
+                {
+                    ok = prepare( "DELETE FROM images WHERE tile_id = ? AND NOT EXISTS (SELECT 1 FROM map WHERE tile_id = ?)", _deleteImageStmt );
+                    if ( ok )
+                    {
+                        sqlite3_bind_text( _deleteImageStmt, 1, oldTileID.c_str(), oldTileID.length(), SQLITE_STATIC );
+                        sqlite3_bind_text( _deleteImageStmt, 2, oldTileID.c_str(), oldTileID.length(), SQLITE_STATIC );
+                        ok = execute( _deleteImageStmt );
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        ok = prepare( "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)", _insertStmt );
+        if ( ok )
+        {
+            sqlite3_bind_int( _insertStmt, 1, z );
+            sqlite3_bind_int( _insertStmt, 2, x );
+            sqlite3_bind_int( _insertStmt, 3, y );
+            sqlite3_bind_blob( _insertStmt, 4, value.c_str(), value.length(), SQLITE_STATIC );
+            ok = execute( _insertStmt );
+        }
+    }
+
+    if ( useTransaction )
+    {
+        if ( ++_pendingWrites >= batchSize )
+        {
+            ok = commit() && ok;
+        }
+    }
+
+    return ok;
+}
+
+bool
+MBTilesTileSource::getTileID(int z, int x, int y, std::string& out_tileID)
+{
+    out_tileID.clear();
+
+    if ( !prepare( "SELECT tile_id FROM map WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?", _selectMapStmt ) )
         return false;
+
+    sqlite3_bind_int( _selectMapStmt, 1, z );
+    sqlite3_bind_int( _selectMapStmt, 2, x );
+    sqlite3_bind_int( _selectMapStmt, 3, y );
+
+    int rc = sqlite3_step( _selectMapStmt );
+    if ( rc == SQLITE_ROW )
+    {
+        const char* text = (const char*)sqlite3_column_text( _selectMapStmt, 0 );
+        if ( text )
+            out_tileID = text;
     }
 
-    // bind parameters:
-    sqlite3_bind_int( insert, 1, z );
-    sqlite3_bind_int( insert, 2, x );
-    sqlite3_bind_int( insert, 3, y );
+    sqlite3_reset( _selectMapStmt );
+    sqlite3_clear_bindings( _selectMapStmt );
 
-    // bind the data blob:
-    sqlite3_bind_blob( insert, 4, value.c_str(), value.length(), SQLITE_STATIC );
+    if ( rc != SQLITE_ROW && rc != SQLITE_DONE )
+    {
+        OE_WARN << LC << "Failed to look up tile: " << sqlite3_errmsg(_database) << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // run the sql.
-    bool ok = true;
+bool
+MBTilesTileSource::flush()
+{
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+    return commit();
+}
+
+bool
+MBTilesTileSource::prepare(const std::string& query, sqlite3_stmt*& stmt)
+{
+    // statements are prepared once and reused for every tile.
+    if ( stmt != NULL )
+        return true;
+
+    if ( SQLITE_OK != sqlite3_prepare_v2(_database, query.c_str(), -1, &stmt, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        stmt = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool
+MBTilesTileSource::execute(sqlite3_stmt* stmt)
+{
+    int rc;
     int tries = 0;
     do {
-        rc = sqlite3_step(insert);
+        rc = sqlite3_step(stmt);
     }
     while (++tries < 100 && (rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
 
+    bool ok = true;
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << sqlite3_sql(stmt) << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
 #else
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed query: " << sqlite3_sql(stmt) << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
 #endif
         ok = false;
     }
 
-    sqlite3_finalize( insert );
-
+    sqlite3_reset( stmt );
+    sqlite3_clear_bindings( stmt );
     return ok;
 }
 
+bool
+MBTilesTileSource::commit()
+{
+    if ( _pendingWrites == 0u )
+        return true;
+
+    _pendingWrites = 0u;
+
+    if ( SQLITE_OK != sqlite3_exec(_database, "COMMIT TRANSACTION", 0L, 0L, 0L) )
+    {
+        OE_WARN << LC << "Failed to commit transaction: " << sqlite3_errmsg(_database) << std::endl;
+        return false;
+    }
+    return true;
+}
+
 bool
 MBTilesTileSource::getMetaData(const std::string& key, std::string& value)
 {
@@ -581,6 +854,22 @@ MBTilesTileSource::computeLevels()
     OE_DEBUG << LC << "Computing levels took " << osg::Timer::instance()->delta_s(startTime, endTime ) << " s" << std::endl;
 }
 
+bool
+MBTilesTileSource::hasTable(const std::string& name)
+{
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    sqlite3_stmt* select = NULL;
+    std::string query = "SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?";
+    if ( SQLITE_OK != sqlite3_prepare_v2(_database, query.c_str(), -1, &select, 0L) )
+        return false;
+
+    sqlite3_bind_text( select, 1, name.c_str(), name.length(), SQLITE_STATIC );
+    bool found = sqlite3_step( select ) == SQLITE_ROW;
+    sqlite3_finalize( select );
+    return found;
+}
+
 bool
 MBTilesTileSource::createTables()
 {
@@ -599,6 +888,52 @@ MBTilesTileSource::createTables()
         return false;
     }
 
+    char* errorMsg = 0L;
+
+    if ( _options.deduplicate() == true )
+    {
+        // Deduplicated layout: [tiles] is a view joining the key map to the
+        // distinct tile images, so readers don't need to know the difference.
+        const char* queries[] = {
+            "CREATE TABLE IF NOT EXISTS map ("
+            " zoom_level integer,"
+            " tile_column integer,"
+            " tile_row integer,"
+            " tile_id text)",
+
+            "CREATE UNIQUE INDEX IF NOT EXISTS map_index ON map ("
+            " zoom_level, tile_column, tile_row)",
+
+            "CREATE TABLE IF NOT EXISTS images ("
+            " tile_data blob,"
+            " tile_id text)",
+
+            "CREATE UNIQUE INDEX IF NOT EXISTS images_id ON images (tile_id)",
+
+            "CREATE INDEX IF NOT EXISTS map_tile_id ON map (tile_id)",
+
+            "CREATE VIEW IF NOT EXISTS tiles AS SELECT"
+            " map.zoom_level AS zoom_level,"
+            " map.tile_column AS tile_column,"
+            " map.tile_row AS tile_row,"
+            " images.tile_data AS tile_data"
+            " FROM map JOIN images ON images.tile_id = map.tile_id"
+        };
+
+        for (unsigned i = 0; i < sizeof(queries)/sizeof(queries[0]); ++i)
+        {
+            if (SQLITE_OK != sqlite3_exec(_database, queries[i], 0L, 0L, &errorMsg))
+            {
+                OE_WARN << LC << "Failed to create deduplicated tile tables: " << errorMsg << std::endl;
+                sqlite3_free( errorMsg );
+                return false;
+            }
+        }
+
+        _deduplicate = true;
+        return true;
+    }
+
     query =
         "CREATE TABLE IF NOT EXISTS tiles ("
         " zoom_level integer,"
@@ -606,8 +941,6 @@ MBTilesTileSource::createTables()
         " tile_row integer,"
         " tile_data blob)";
 
-    char* errorMsg = 0L;
-
     if (SQLITE_OK != sqlite3_exec(_database, query.c_str(), 0L, 0L, &errorMsg))
     {
         OE_WARN << LC << "Failed to create table [tiles]: " << errorMsg << std::endl;
@@ -31,6 +31,9 @@
 // complete the feature set.
 //#define MAXIMUM_ISOLATION
 
+// most compiled snippets each heap keeps before it starts over.
+#define MAX_COMPILED_SCRIPTS 1024
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Drivers::Duktape;
@@ -191,6 +194,28 @@ namespace
                         }
                         duk_put_prop_string(ctx, props_i, a->first.c_str());
                     }
+
+                    // schema fields of a feature stored in attribute columns
+                    // (a field this feature never set is not one of its properties):
+                    const AttributeColumns* columns = feature->getAttributeColumns();
+                    if ( columns )
+                    {
+                        unsigned row = feature->getAttributeRow();
+                        for(int field = 0; field < (int)columns->getNumFields(); ++field)
+                        {
+                            if ( !columns->isSet(row, field) )
+                                continue;
+
+                            switch(columns->getFieldType(field)) {
+                            case ATTRTYPE_DOUBLE: duk_push_number (ctx, columns->getDouble(row, field)); break;
+                            case ATTRTYPE_INT:    duk_push_int    (ctx, columns->getInt(row, field)); break;
+                            case ATTRTYPE_BOOL:   duk_push_boolean(ctx, columns->getBool(row, field)); break;
+                            case ATTRTYPE_STRING:
+                            default:              duk_push_string (ctx, columns->getString(row, field).c_str()); break;
+                            }
+                            duk_put_prop_string(ctx, props_i, columns->getFieldName(field).c_str());
+                        }
+                    }
                 }
                 duk_put_prop_string(ctx, feature_i, "properties");
             }
@@ -207,6 +232,7 @@ namespace
 DuktapeEngine::Context::Context()
 {
     _ctx = 0L;
+    _numCompiled = 0;
 }
 
 void
@@ -249,6 +275,82 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
     }
 }
 
+bool
+DuktapeEngine::Context::pushCompiled(const std::string& code)
+{
+    duk_push_heap_stash(_ctx);                                         // [stash]
+    if ( !duk_get_prop_string(_ctx, -1, "oe_compiled") || _numCompiled >= MAX_COMPILED_SCRIPTS )
+    {
+        // first use, or the cache is full: start with an empty one.
+        duk_pop(_ctx);                                                 // [stash]
+        duk_push_object(_ctx);                                         // [stash, cache]
+        duk_dup_top(_ctx);                                             // [stash, cache, cache]
+        duk_put_prop_string(_ctx, -3, "oe_compiled");                  // [stash, cache]
+        _numCompiled = 0;
+    }
+    duk_remove(_ctx, -2);                                              // [cache]
+
+    if ( duk_get_prop_string(_ctx, -1, code.c_str()) )                 // [cache, function]
+    {
+        duk_remove(_ctx, -2);                                          // [function]
+        return true;
+    }
+    duk_pop(_ctx);                                                     // [cache]
+
+    // compile as eval code, so that calling the function returns the value
+    // of the last statement just like duk_peval_string does.
+    if ( duk_pcompile_string(_ctx, DUK_COMPILE_EVAL, code.c_str()) != 0 ) // [cache, error]
+    {
+        duk_remove(_ctx, -2);                                          // [error]
+        return false;
+    }
+
+    duk_dup_top(_ctx);                                                 // [cache, function, function]
+    duk_put_prop_string(_ctx, -3, code.c_str());                       // [cache, function]
+    duk_remove(_ctx, -2);                                              // [function]
+    ++_numCompiled;
+    return true;
+}
+
+ScriptResult
+DuktapeEngine::Context::call(Feature const* feature, bool complete)
+{
+    // [function]
+    if ( feature && feature != _feature.get() )
+    {
+        // encode the feature in the global object and push a native pointer:
+        setFeature(_ctx, feature, complete);
+    }
+    else if ( !feature )
+    {
+        // don't let the script see the feature from a previous call:
+        duk_push_global_object(_ctx);                                  // [function, global]
+        duk_del_prop_string(_ctx, -1, "feature");                      // [function, global]
+        duk_pop(_ctx);                                                 // [function]
+    }
+
+    // remember the feature so we don't re-create it if not necessary
+    _feature = feature;
+
+    // run the script. On error, the top of stack will hold the error
+    // message instead of the return value.
+    duk_dup_top(_ctx);                                                 // [function, function]
+    duk_push_global_object(_ctx);                                      // [function, function, global]
+    bool ok = (duk_pcall_method(_ctx, 0) == DUK_EXEC_SUCCESS);         // [function, "result"]
+
+    std::string resultString;
+    const char* resultVal = duk_to_string(_ctx, -1);
+    if ( resultVal )
+        resultString = resultVal;
+
+    // pop the return value:
+    duk_pop(_ctx); // [function]
+
+    return ok ?
+        ScriptResult(resultString, true) :
+        ScriptResult("", false, resultString);
+}
+
 DuktapeEngine::Context::~Context()
 {
     if ( _ctx )
@@ -294,33 +396,62 @@ DuktapeEngine::run(const std::string&   code,
     duk_context* ctx = c._ctx;
 #endif
 
-	if ( feature && feature != c._feature.get() )
+    if ( !c.pushCompiled(code) ) // [ error ]
     {
-		// encode the feature in the global object and push a native pointer:
-		setFeature(ctx, feature, complete);
-	}
+        std::string error = duk_safe_to_string(ctx, -1);
+        duk_pop(ctx); // []
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        return ScriptResult("", false, error);
+    }
 
-    // remember the feature so we don't re-create it if not necessary
-    c._feature = feature;
+    ScriptResult result = c.call(feature, complete); // [ function ]
+    duk_pop(ctx); // []
 
-    // run the script. On error, the top of stack will hold the error
-    // message instead of the return value.
-    std::string resultString;
+    if ( !result.success() )
+    {
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+    }
 
-    bool ok = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
-    const char* resultVal = duk_to_string(ctx, -1);
-    if ( resultVal )
-        resultString = resultVal;
+    return result;
+}
+
+void
+DuktapeEngine::runBatch(const std::string&         code,
+                        const FeatureList&         features,
+                        std::vector<ScriptResult>& out_results,
+                        FilterContext const*       context)
+{
+#ifdef MAXIMUM_ISOLATION
+    ScriptEngine::runBatch(code, features, out_results, context);
+#else
+    if (code.empty())
+    {
+        out_results.resize(out_results.size() + features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+        return;
+    }
+
+    bool complete = (getProfile() == "full");
+
+    Context& c = _contexts.get();
+    c.initialize( _options, complete );
+    duk_context* ctx = c._ctx;
 
-    if ( !ok )
+    if ( !c.pushCompiled(code) ) // [ error ]
     {
+        ScriptResult error("", false, duk_safe_to_string(ctx, -1));
+        duk_pop(ctx); // []
         OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        out_results.resize(out_results.size() + features.size(), error);
+        return;
     }
 
-    // pop the return value:
-    duk_pop(ctx); // []
+    // look up and compile the snippet once, then call it for each feature.
+    out_results.reserve(out_results.size() + features.size());
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        out_results.push_back( c.call(i->get(), complete) ); // [ function ]
+    }
 
-    return ok ?
-        ScriptResult(resultString, true) :
-        ScriptResult("", false, resultString);
+    duk_pop(ctx); // []
+#endif
 }
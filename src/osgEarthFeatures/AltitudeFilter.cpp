@@ -91,7 +91,8 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
             StringExpression temp( _altitude->script().get() );
             feature->eval( temp, &cx );
         }
-        if (feature->getGeometry() == 0L)
+        const Feature* constFeature = feature;
+        if (constFeature->getGeometry() == 0L)
             continue;
 
         double minHAT       =  DBL_MAX;
@@ -194,7 +195,8 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             StringExpression temp( _altitude->script().get() );
             feature->eval( temp, &cx );
         }
-        if (feature->getGeometry() == 0L)
+        const Feature* constFeature = feature;
+        if (constFeature->getGeometry() == 0L)
             continue;
 
         double maxTerrainZ  = -DBL_MAX;
@@ -210,7 +212,7 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
             offsetZ = feature->eval( offsetExpr, &cx );
 
-        osgEarth::Bounds bounds = feature->getGeometry()->getBounds();
+        osgEarth::Bounds bounds = constFeature->getGeometry()->getBounds();
         const osg::Vec2d& center = bounds.center2d();
         GeoPoint centroid(featureSRS.get(), center.x(), center.y());
         double   centroidElevation = 0.0;
@@ -90,7 +90,8 @@ BufferFilter::push( FeatureList& input, FilterContext& context )
     for( FeatureList::iterator i = input.begin(); i != input.end(); )
     {
         Feature* feature = i->get();
-        if ( !feature || !feature->getGeometry() )
+        const Geometry* geom = feature ? static_cast<const Feature*>(feature)->getGeometry() : 0L;
+        if ( !geom )
             continue;
 
         osg::ref_ptr<Symbology::Geometry> output;
@@ -105,7 +106,7 @@ BufferFilter::push( FeatureList& input, FilterContext& context )
 
         params._cornerSegs = _numQuadSegs;
 
-        if ( feature->getGeometry()->buffer( _distance.value(), output, params ) )
+        if ( geom->buffer( _distance.value(), output, params ) )
         {
             feature->setGeometry( output.get() );
             ++i;
@@ -605,10 +605,10 @@ BuildGeometryFilter::processPoints(FeatureList& features, FilterContext& context
     {
         Feature* input = f->get();
 
-        GeometryIterator parts( input->getGeometry(), true );
+        ConstGeometryIterator parts( static_cast<const Feature*>(input)->getGeometry(), true );
         while( parts.hasMore() )
         {
-            Geometry* part = parts.next();
+            const Geometry* part = parts.next();
 
             // extract the required point symbol; bail out if not found.
             const PointSymbol* point =
@@ -1338,9 +1338,10 @@ BuildGeometryFilter::push( FeatureList& input, FilterContext& context )
         }
 
         // if no style is set, use the geometry type:
-        if ( !has_polysymbol && !has_linesymbol && !has_polylinesymbol && !has_pointsymbol && f->getGeometry() )
+        const Geometry* geom = static_cast<const Feature*>(f)->getGeometry();
+        if ( !has_polysymbol && !has_linesymbol && !has_polylinesymbol && !has_pointsymbol && geom )
         {
-            switch( f->getGeometry()->getComponentType() )
+            switch( geom->getComponentType() )
             {
             default:
             case Geometry::TYPE_LINESTRING:
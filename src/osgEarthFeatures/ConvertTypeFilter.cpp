@@ -80,9 +80,10 @@ ConvertTypeFilter::push( FeatureList& input, FilterContext& context )
     for( FeatureList::iterator i = input.begin(); i != input.end(); ++i )
     {
         Feature* input = i->get();
-        if ( input && input->getGeometry() && input->getGeometry()->getComponentType() != _toType )
+        const Geometry* geom = input ? static_cast<const Feature*>(input)->getGeometry() : 0L;
+        if ( geom && geom->getComponentType() != _toType )
         {
-            input->setGeometry( input->getGeometry()->cloneAs(_toType) );
+            input->setGeometry( geom->cloneAs(_toType) );
         }
     }
 
@@ -50,7 +50,7 @@ CropFilter::push( FeatureList& input, FilterContext& context )
             bool keepFeature = false;
 
             Feature* feature = i->get();
-            Geometry* featureGeom = feature->getGeometry();
+            const Geometry* featureGeom = static_cast<const Feature*>(feature)->getGeometry();
 
             if ( featureGeom && featureGeom->isValid() )
             {
@@ -87,7 +87,7 @@ CropFilter::push( FeatureList& input, FilterContext& context )
 
             Feature* feature = i->get();
 
-            Symbology::Geometry* featureGeom = feature->getGeometry();
+            const Symbology::Geometry* featureGeom = static_cast<const Feature*>(feature)->getGeometry();
             if ( featureGeom && featureGeom->isValid() )
             {
                 // test for trivial acceptance:
@@ -166,9 +166,217 @@ AttributeValue::getBool( bool defaultValue ) const
 
 //----------------------------------------------------------------------------
 
+AttributeColumns::AttributeColumns( const FeatureSchema& schema, unsigned numRows ) :
+_numRows( numRows )
+{
+    _columns.reserve( schema.size() );
+    for( FeatureSchema::const_iterator i = schema.begin(); i != schema.end(); ++i )
+    {
+        if ( _fieldIDs.find(i->first) != _fieldIDs.end() )
+            continue;
+
+        _fieldIDs[i->first] = (int)_columns.size();
+        _columns.push_back( Column() );
+        _columns.back()._name = i->first;
+        _columns.back()._type = i->second == ATTRTYPE_UNSPECIFIED ? ATTRTYPE_STRING : i->second;
+    }
+
+    for( std::vector<Column>::iterator c = _columns.begin(); c != _columns.end(); ++c )
+    {
+        switch( c->_type ) {
+            case ATTRTYPE_DOUBLE: c->_doubles.resize( numRows, 0.0 ); break;
+            case ATTRTYPE_INT:
+            case ATTRTYPE_BOOL:   c->_ints.resize( numRows, 0 ); break;
+            default:              c->_strings.resize( numRows ); break;
+        }
+        c->_set.resize( numRows, 0 );
+    }
+}
+
+AttributeColumns*
+AttributeColumns::pack( FeatureList& features, const FeatureSchema& schema )
+{
+    AttributeColumns* columns = new AttributeColumns( schema, features.size() );
+
+    unsigned row = 0;
+    for( FeatureList::iterator i = features.begin(); i != features.end(); ++i, ++row )
+    {
+        if ( i->valid() )
+            i->get()->setAttributeColumns( columns, row );
+    }
+
+    return columns;
+}
+
+int
+AttributeColumns::getFieldID( const std::string& name ) const
+{
+    std::map<std::string, int, CIStringComp>::const_iterator i = _fieldIDs.find(name);
+    return i != _fieldIDs.end() ? i->second : -1;
+}
+
+void
+AttributeColumns::set( unsigned row, int field, const std::string& value )
+{
+    Column& c = _columns[field];
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: c._doubles[row] = osgEarth::as<double>(value, 0.0); break;
+        case ATTRTYPE_INT:    c._ints[row] = osgEarth::as<int>(value, 0); break;
+        case ATTRTYPE_BOOL:   c._ints[row] = osgEarth::as<bool>(value, false) ? 1 : 0; break;
+        default:              c._strings[row] = value; break;
+    }
+    c._set[row] = 1;
+}
+
+void
+AttributeColumns::set( unsigned row, int field, double value )
+{
+    Column& c = _columns[field];
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: c._doubles[row] = value; break;
+        case ATTRTYPE_INT:    c._ints[row] = (int)value; break;
+        case ATTRTYPE_BOOL:   c._ints[row] = value != 0.0 ? 1 : 0; break;
+        default:              c._strings[row] = osgEarth::toString(value); break;
+    }
+    c._set[row] = 1;
+}
+
+void
+AttributeColumns::set( unsigned row, int field, int value )
+{
+    Column& c = _columns[field];
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: c._doubles[row] = (double)value; break;
+        case ATTRTYPE_INT:    c._ints[row] = value; break;
+        case ATTRTYPE_BOOL:   c._ints[row] = value != 0 ? 1 : 0; break;
+        default:              c._strings[row] = osgEarth::toString(value); break;
+    }
+    c._set[row] = 1;
+}
+
+void
+AttributeColumns::set( unsigned row, int field, bool value )
+{
+    Column& c = _columns[field];
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: c._doubles[row] = value ? 1.0 : 0.0; break;
+        case ATTRTYPE_INT:
+        case ATTRTYPE_BOOL:   c._ints[row] = value ? 1 : 0; break;
+        default:              c._strings[row] = osgEarth::toString(value); break;
+    }
+    c._set[row] = 1;
+}
+
+void
+AttributeColumns::set( unsigned row, int field, const AttributeValue& value )
+{
+    if ( !value.second.set )
+    {
+        setNull( row, field );
+        return;
+    }
+
+    switch( value.first ) {
+        case ATTRTYPE_STRING: set( row, field, value.second.stringValue ); break;
+        case ATTRTYPE_DOUBLE: set( row, field, value.second.doubleValue ); break;
+        case ATTRTYPE_INT:    set( row, field, value.second.intValue ); break;
+        case ATTRTYPE_BOOL:   set( row, field, value.second.boolValue ); break;
+        case ATTRTYPE_UNSPECIFIED: setNull( row, field ); break;
+    }
+}
+
+std::string
+AttributeColumns::getString( unsigned row, int field ) const
+{
+    const Column& c = _columns[field];
+    if ( !c._set[row] )
+    {
+        return "";
+    }
+
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: return osgEarth::toString(c._doubles[row]);
+        case ATTRTYPE_INT:    return osgEarth::toString(c._ints[row]);
+        case ATTRTYPE_BOOL:   return osgEarth::toString(c._ints[row] != 0);
+        default:              return c._strings[row];
+    }
+}
+
+double
+AttributeColumns::getDouble( unsigned row, int field, double defaultValue ) const
+{
+    const Column& c = _columns[field];
+    if ( !c._set[row] )
+    {
+        return defaultValue;
+    }
+
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: return c._doubles[row];
+        case ATTRTYPE_INT:    return (double)c._ints[row];
+        case ATTRTYPE_BOOL:   return c._ints[row] != 0 ? 1.0 : 0.0;
+        default:              return osgEarth::as<double>(c._strings[row], defaultValue);
+    }
+}
+
+int
+AttributeColumns::getInt( unsigned row, int field, int defaultValue ) const
+{
+    const Column& c = _columns[field];
+    if ( !c._set[row] )
+    {
+        return defaultValue;
+    }
+
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: return (int)c._doubles[row];
+        case ATTRTYPE_INT:    return c._ints[row];
+        case ATTRTYPE_BOOL:   return c._ints[row] != 0 ? 1 : 0;
+        default:              return osgEarth::as<int>(c._strings[row], defaultValue);
+    }
+}
+
+bool
+AttributeColumns::getBool( unsigned row, int field, bool defaultValue ) const
+{
+    const Column& c = _columns[field];
+    if ( !c._set[row] )
+    {
+        return defaultValue;
+    }
+
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: return c._doubles[row] != 0.0;
+        case ATTRTYPE_INT:
+        case ATTRTYPE_BOOL:   return c._ints[row] != 0;
+        default:              return osgEarth::as<bool>(c._strings[row], defaultValue);
+    }
+}
+
+AttributeValue
+AttributeColumns::get( unsigned row, int field ) const
+{
+    const Column& c = _columns[field];
+
+    AttributeValue a;
+    a.first = c._type;
+    a.second.set = c._set[row] != 0;
+
+    switch( c._type ) {
+        case ATTRTYPE_DOUBLE: a.second.doubleValue = c._doubles[row]; break;
+        case ATTRTYPE_INT:    a.second.intValue = c._ints[row]; break;
+        case ATTRTYPE_BOOL:   a.second.boolValue = c._ints[row] != 0; break;
+        default:              a.second.stringValue = c._strings[row]; break;
+    }
+    return a;
+}
+
+//----------------------------------------------------------------------------
+
 Feature::Feature( FeatureID fid ) :
 _fid( fid ),
-_srs( 0L )
+_srs( 0L ),
+_row( 0 )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
@@ -177,7 +385,8 @@ _srs( 0L )
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
 _geom ( geom ),
 _srs  ( srs ),
-_fid  ( fid )
+_fid  ( fid ),
+_row  ( 0 )
 {
     if ( !style.empty() )
         _style = style;
@@ -190,10 +399,25 @@ _fid      ( rhs._fid ),
 _attrs    ( rhs._attrs ),
 _style    ( rhs._style ),
 _geoInterp( rhs._geoInterp ),
-_srs      ( rhs._srs.get() )
+_srs      ( rhs._srs.get() ),
+_row      ( 0 )
 {
+    // the copy owns its attributes, so it does not share the row.
+    if ( rhs._columns.valid() )
+        rhs.getColumnValues( _attrs );
+
     if ( rhs._geom.valid() )
-        _geom = rhs._geom->clone();
+    {
+        // a shallow copy borrows the geometry until someone asks to change it.
+        if ( copyOp.getCopyFlags() == osg::CopyOp::SHALLOW_COPY )
+        {
+            _geom = rhs._geom.get();
+        }
+        else
+        {
+            _geom = rhs._geom->clone();
+        }
+    }
 
     dirty();
 }
@@ -232,6 +456,17 @@ Feature::setSRS( const SpatialReference* srs )
     dirty();
 }
 
+Geometry*
+Feature::getGeometry()
+{
+    // copy on write: the caller may change the geometry, so stop sharing it.
+    // This applies to the original as well as to its shallow copies.
+    if ( _geom.valid() && _geom->referenceCount() > 1 )
+        _geom = _geom->clone();
+    dirty();
+    return _geom.get();
+}
+
 void
 Feature::setGeometry( Geometry* geom )
 {
@@ -250,6 +485,13 @@ Feature::dirty()
 void
 Feature::set( const std::string& name, const std::string& value )
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->set( _row, field, value );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
@@ -259,6 +501,13 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->set( _row, field, value );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
@@ -268,6 +517,13 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->set( _row, field, value );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
@@ -277,12 +533,26 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, const AttributeValue& value)
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->set( _row, field, value );
+        return;
+    }
+
     _attrs[ name ] = value;
 }
 
 void
 Feature::set( const std::string& name, bool value )
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->set( _row, field, value );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
@@ -292,6 +562,13 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->setNull( _row, field );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];    
     a.second.set = false;
 }
@@ -299,6 +576,13 @@ Feature::setNull( const std::string& name)
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
+    int field = getFieldID(name);
+    if ( field >= 0 )
+    {
+        _columns->setNull( _row, field );
+        return;
+    }
+
     AttributeValue& a = _attrs[name];
     a.first = type;    
     a.second.set = false;
@@ -307,44 +591,109 @@ Feature::setNull( const std::string& name, AttributeType type)
 
 
 
+AttributeTable
+Feature::getAllAttrs() const
+{
+    AttributeTable attrs( _attrs );
+    if ( _columns.valid() )
+        getColumnValues( attrs );
+    return attrs;
+}
+
+void
+Feature::setAttributeColumns( AttributeColumns* columns, unsigned row )
+{
+    // take back the values from any columns we were already using:
+    if ( _columns.valid() )
+    {
+        getColumnValues( _attrs );
+        _columns = 0L;
+        _row = 0;
+    }
+
+    if ( !columns )
+        return;
+
+    _columns = columns;
+    _row = row;
+
+    for( int field = 0; field < (int)columns->getNumFields(); ++field )
+    {
+        AttributeTable::iterator i = _attrs.find( columns->getFieldName(field) );
+        if ( i != _attrs.end() )
+        {
+            columns->set( _row, field, i->second );
+            _attrs.erase( i );
+        }
+    }
+}
+
+void
+Feature::getColumnValues( AttributeTable& out ) const
+{
+    for( int field = 0; field < (int)_columns->getNumFields(); ++field )
+    {
+        if ( _columns->isSet(_row, field) )
+            out[_columns->getFieldName(field)] = _columns->get( _row, field );
+    }
+}
+
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->isSet( _row, field );
+
+    return _attrs.find(name) != _attrs.end();
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->getString( _row, field );
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->getDouble( _row, field, defaultValue );
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->getInt( _row, field, defaultValue );
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->getBool( _row, field, defaultValue );
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
+    int field = getFieldID(name);
+    if ( field >= 0 ) return _columns->isSet( _row, field );
+
+    AttributeTable::const_iterator i = _attrs.find(name);
     return i != _attrs.end()? i->second.second.set : false;
 }
 
@@ -355,8 +704,13 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      int field = getFieldID(i->first);
+      AttributeTable::const_iterator ai = field >= 0 ? _attrs.end() : _attrs.find(i->first);
+      if (field >= 0)
+      {
+        val = _columns->getDouble(_row, field, 0.0);
+      }
+      else if (ai != _attrs.end())
       {
         val = ai->second.getDouble(0.0);
       }
@@ -388,8 +742,13 @@ Feature::eval(NumericExpression& expr, Session* session) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         double val = 0.0;
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-        if (ai != _attrs.end())
+        int field = getFieldID(i->first);
+        AttributeTable::const_iterator ai = field >= 0 ? _attrs.end() : _attrs.find(i->first);
+        if (field >= 0)
+        {
+            val = _columns->getDouble(_row, field, 0.0);
+        }
+        else if (ai != _attrs.end())
         {
             val = ai->second.getDouble(0.0);
         }
@@ -423,8 +782,22 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     const StringExpression::Variables& vars = expr.variables();
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
+      int field = getFieldID(i->first);
+      if (field >= 0)
+      {
+          expr.set( *i, _columns->getString(_row, field) );
+          continue;
+      }
+
+      AttributeTable::const_iterator ai = _attrs.find(i->first);
+      if (ai != _attrs.end() && ai->second.first == ATTRTYPE_STRING && ai->second.second.set)
+      {
+        // no need to copy a string attribute first
+        expr.set( *i, ai->second.second.stringValue );
+        continue;
+      }
+
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
       if (ai != _attrs.end())
       {
         val = ai->second.getString();
@@ -459,8 +832,22 @@ Feature::eval(StringExpression& expr, Session* session) const
     const StringExpression::Variables& vars = expr.variables();
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
+        int field = getFieldID(i->first);
+        if (field >= 0)
+        {
+            expr.set( *i, _columns->getString(_row, field) );
+            continue;
+        }
+
+        AttributeTable::const_iterator ai = _attrs.find(i->first);
+        if (ai != _attrs.end() && ai->second.first == ATTRTYPE_STRING && ai->second.second.set)
+        {
+            // no need to copy a string attribute first
+            expr.set( *i, ai->second.second.stringValue );
+            continue;
+        }
+
         std::string val = "";
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
         if (ai != _attrs.end())
         {
             val = ai->second.getString();
@@ -608,12 +995,22 @@ Feature::getGeoJSON() const
         root["geometry"] = geometryValue;
     }
 
+    // Read the attribute columns without detaching from them:
+    const AttributeTable* attrs = &_attrs;
+    AttributeTable allAttrs;
+    if ( _columns.valid() )
+    {
+        allAttrs = _attrs;
+        getColumnValues( allAttrs );
+        attrs = &allAttrs;
+    }
+
     //Write out all the properties         
     Json::Value props(Json::objectValue);    
-    if (getAttrs().size() > 0)
+    if (attrs->size() > 0)
     {
 
-        for (AttributeTable::const_iterator itr = getAttrs().begin(); itr != getAttrs().end(); ++itr)
+        for (AttributeTable::const_iterator itr = attrs->begin(); itr != attrs->end(); ++itr)
         {
             if (itr->second.first == ATTRTYPE_INT)
             {
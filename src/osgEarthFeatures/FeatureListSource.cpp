@@ -20,18 +20,87 @@
 #include <osgEarthFeatures/FeatureCursor>
 #include <osgEarthFeatures/Filter>
 #include <osgEarth/Progress>
+#include <algorithm>
 
 using namespace osgEarth::Features;
 
+// Children per node of the spatial index
+#define INDEX_NODE_SIZE 16
+
+namespace
+{
+    bool intersects2d(const osgEarth::Bounds& a, const osgEarth::Bounds& b)
+    {
+        return
+            a.xMin() <= b.xMax() && b.xMin() <= a.xMax() &&
+            a.yMin() <= b.yMax() && b.yMin() <= a.yMax();
+    }
+
+    template<typename T> struct LessX {
+        bool operator()(const T& lhs, const T& rhs) const {
+            return lhs._bounds.xMin() + lhs._bounds.xMax() < rhs._bounds.xMin() + rhs._bounds.xMax();
+        }
+    };
+
+    template<typename T> struct LessY {
+        bool operator()(const T& lhs, const T& rhs) const {
+            return lhs._bounds.yMin() + lhs._bounds.yMax() < rhs._bounds.yMin() + rhs._bounds.yMax();
+        }
+    };
+
+    template<typename T> struct LessSeq {
+        bool operator()(const T& lhs, const T& rhs) const {
+            return lhs._seq < rhs._seq;
+        }
+    };
+
+    // Sort-Tile-Recursive packing: orders items so that each run of
+    // INDEX_NODE_SIZE items is a compact tile. Sort by x, cut into vertical
+    // slices of about sqrt(n/INDEX_NODE_SIZE) tiles each, and sort each slice by y.
+    template<typename T>
+    void sortTileRecursive(std::vector<T>& items)
+    {
+        std::sort(items.begin(), items.end(), LessX<T>());
+
+        unsigned numNodes = (items.size() + INDEX_NODE_SIZE - 1) / INDEX_NODE_SIZE;
+        unsigned sliceSize = INDEX_NODE_SIZE * (unsigned)ceil(sqrt((double)numNodes));
+
+        for (unsigned i = 0; i < items.size(); i += sliceSize)
+        {
+            unsigned end = osg::minimum(i + sliceSize, (unsigned)items.size());
+            std::sort(items.begin() + i, items.begin() + end, LessY<T>());
+        }
+    }
+
+    // Groups each run of INDEX_NODE_SIZE items into a node of the next level up.
+    template<typename T, typename NODE>
+    void packLevel(const std::vector<T>& items, std::vector<NODE>& output)
+    {
+        output.reserve((items.size() + INDEX_NODE_SIZE - 1) / INDEX_NODE_SIZE);
+
+        for (unsigned i = 0; i < items.size(); i += INDEX_NODE_SIZE)
+        {
+            NODE node;
+            node._first = i;
+            node._count = osg::minimum((unsigned)INDEX_NODE_SIZE, (unsigned)items.size() - i);
+            for (unsigned j = i; j < i + node._count; ++j)
+                node._bounds.expandBy(items[j]._bounds);
+            output.push_back(node);
+        }
+    }
+}
+
 FeatureListSource::FeatureListSource():
-FeatureSource()
+FeatureSource(),
+_indexDirty  ( true )
 {
     //nop
 }
 
 FeatureListSource::FeatureListSource(const GeoExtent& defaultExtent ) :
 FeatureSource (),
-_defaultExtent( defaultExtent )
+_defaultExtent( defaultExtent ),
+_indexDirty   ( true )
 {
     //nop
 }
@@ -42,12 +111,27 @@ FeatureListSource::createFeatureCursor(const Symbology::Query& query, ProgressCa
     if (getFeatureProfile() == 0L)
         setFeatureProfile(createFeatureProfile());
 
+    // Find the features in the query bounds, if there are any.
+    FeatureList selected;
+    if ( query.bounds().isSet() )
+    {
+        Threading::ScopedMutexLock lock(_indexMutex);
+        if ( _indexDirty )
+        {
+            buildIndex();
+            _indexDirty = false;
+        }
+        queryIndex( *query.bounds(), selected );
+    }
+    const FeatureList& features = query.bounds().isSet() ? selected : _features;
+
     //Create a copy of all of the features before returning the cursor.
     //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
+    //The copies are shallow: each one clones its geometry only when a filter asks to change it.
     FeatureList cursorFeatures;
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+    for (FeatureList::const_iterator itr = features.begin(); itr != features.end(); ++itr)
     {
-        Feature* feature = new Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
+        Feature* feature = new Feature(*(itr->get()), osg::CopyOp::SHALLOW_COPY);
         cursorFeatures.push_back( feature );
     }    
     return new FeatureListCursor( cursorFeatures );
@@ -67,7 +151,7 @@ FeatureListSource::createFeatureProfile()
         // Compute the extent of the features
         for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
         {
-            Feature* feature = itr->get();
+            const Feature* feature = itr->get();
             if (feature->getGeometry())
             {
                 bounds.expandBy( feature->getGeometry()->getBounds() );
@@ -82,10 +166,99 @@ FeatureListSource::createFeatureProfile()
         return new FeatureProfile( _defaultExtent );
 }
 
+void
+FeatureListSource::buildIndex()
+{
+    _entries.clear();
+    _unbounded.clear();
+    _levels.clear();
+
+    unsigned seq = 0;
+    for (FeatureList::const_iterator itr = _features.begin(); itr != _features.end(); ++itr, ++seq)
+    {
+        const Feature* feature = itr->get();
+
+        IndexEntry entry;
+        entry._feature = itr->get();
+        entry._seq = seq;
+        if ( feature && feature->getGeometry() )
+            entry._bounds = feature->getGeometry()->getBounds();
+
+        if ( entry._bounds.isValid() )
+            _entries.push_back( entry );
+        else
+            _unbounded.push_back( entry );
+    }
+
+    if ( _entries.empty() )
+        return;
+
+    sortTileRecursive( _entries );
+    _levels.push_back( std::vector<IndexNode>() );
+    packLevel( _entries, _levels.back() );
+
+    // pack each level into the one above it until a single level of
+    // at most INDEX_NODE_SIZE nodes remains as the root:
+    while ( _levels.back().size() > INDEX_NODE_SIZE )
+    {
+        sortTileRecursive( _levels.back() );
+        std::vector<IndexNode> parents;
+        packLevel( _levels.back(), parents );
+        _levels.push_back( std::vector<IndexNode>() );
+        _levels.back().swap( parents );
+    }
+}
+
+void
+FeatureListSource::queryIndex(const Bounds& bounds, FeatureList& output) const
+{
+    std::vector<IndexEntry> hits( _unbounded );
+
+    if ( !_levels.empty() )
+    {
+        // depth-first walk from the root level; pairs are (level, node)
+        std::vector< std::pair<unsigned, unsigned> > stack;
+        unsigned top = _levels.size() - 1;
+        for (unsigned i = 0; i < _levels[top].size(); ++i)
+            stack.push_back( std::make_pair(top, i) );
+
+        while ( !stack.empty() )
+        {
+            unsigned level = stack.back().first;
+            const IndexNode& node = _levels[level][stack.back().second];
+            stack.pop_back();
+
+            if ( !intersects2d(node._bounds, bounds) )
+                continue;
+
+            for (unsigned i = node._first; i < node._first + node._count; ++i)
+            {
+                if ( level > 0 )
+                    stack.push_back( std::make_pair(level-1, i) );
+                else if ( intersects2d(_entries[i]._bounds, bounds) )
+                    hits.push_back( _entries[i] );
+            }
+        }
+    }
+
+    // return the features in the order they appear in the list:
+    std::sort( hits.begin(), hits.end(), LessSeq<IndexEntry>() );
+    for (std::vector<IndexEntry>::const_iterator i = hits.begin(); i != hits.end(); ++i)
+        output.push_back( i->_feature );
+}
+
+void
+FeatureListSource::dirtyIndex()
+{
+    Threading::ScopedMutexLock lock(_indexMutex);
+    _indexDirty = true;
+}
+
 bool
 FeatureListSource::deleteFeature(FeatureID fid)
 {
     dirtyFeatureProfile();
+    dirtyIndex();
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
     {
         if (itr->get()->getFID() == fid)
@@ -101,6 +274,9 @@ FeatureListSource::deleteFeature(FeatureID fid)
 Feature*
 FeatureListSource::getFeature( FeatureID fid )
 {
+    // the caller may change the feature:
+    dirtyIndex();
+
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
     {
         if (itr->get()->getFID() == fid)
@@ -114,6 +290,7 @@ FeatureListSource::getFeature( FeatureID fid )
 bool FeatureListSource::insertFeature(Feature* feature)
 {
     dirtyFeatureProfile();
+    dirtyIndex();
     _features.push_back( feature );
     dirty();
     return true;
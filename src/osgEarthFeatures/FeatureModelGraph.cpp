@@ -35,6 +35,7 @@
 #include <osgEarth/GLUtils>
 
 #include <osg/CullFace>
+#include <osg/MatrixTransform>
 #include <osg/PagedLOD>
 #include <osg/ProxyNode>
 #include <osg/PolygonOffset>
@@ -46,6 +47,7 @@
 
 #include <algorithm>
 #include <iterator>
+#include <typeinfo>
 
 #define LC "[FeatureModelGraph] " << getName() << ": "
 
@@ -73,6 +75,88 @@ namespace
     };
 }
 
+namespace
+{
+    // signals a MultiEvent when a compile task is done with.
+    class CompileProgress : public ProgressCallback
+    {
+    public:
+        CompileProgress(Threading::MultiEvent* done) : _done(done) { }
+
+        void onCompleted() { _done->set(); }
+
+    private:
+        Threading::MultiEvent* _done;
+    };
+
+    // compiles one chunk of a tile's working set into a node.
+    struct CompileChunkTask : public TaskRequest
+    {
+        CompileChunkTask(FeatureNodeFactory* factory, const Style& style, const FilterContext& context) :
+            _factory(factory), _style(style), _context(context), _ran(false), _ok(false) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<FeatureCursor> cursor = new FeatureListCursor(_features);
+            _ok = _factory->createOrUpdateNode(cursor.get(), _style, _context, _node);
+            _ran = true;
+        }
+
+        FeatureNodeFactory*     _factory;
+        Style                   _style;
+        FilterContext           _context;
+        FeatureList             _features;
+        osg::ref_ptr<osg::Node> _node;
+        bool                    _ran;
+        bool                    _ok;
+    };
+
+    // whether the children of "a" and "b" can live under one of them.
+    bool sameContainer(osg::Group* a, osg::Group* b)
+    {
+        if ( typeid(*a) != typeid(*b) || a->getStateSet() != b->getStateSet() || a->getName() != b->getName() )
+            return false;
+
+        if ( typeid(*a) == typeid(osg::Group) )
+            return true;
+
+        if ( typeid(*a) == typeid(osg::MatrixTransform) )
+        {
+            osg::MatrixTransform* ma = static_cast<osg::MatrixTransform*>(a);
+            osg::MatrixTransform* mb = static_cast<osg::MatrixTransform*>(b);
+            return ma->getMatrix() == mb->getMatrix() && ma->getReferenceFrame() == mb->getReferenceFrame();
+        }
+
+        return false;
+    }
+
+    // folds sibling groups and transforms that are interchangeable into one,
+    // all the way down, so the geodes below them end up side by side.
+    void mergeSiblings(osg::Group* group)
+    {
+        for (unsigned i = 0; i < group->getNumChildren(); ++i)
+        {
+            osg::Group* first = group->getChild(i)->asGroup();
+            if ( !first )
+                continue;
+
+            for (unsigned j = i+1; j < group->getNumChildren(); )
+            {
+                osg::Group* other = group->getChild(j)->asGroup();
+                if ( other && sameContainer(first, other) )
+                {
+                    for (unsigned c = 0; c < other->getNumChildren(); ++c)
+                        first->addChild( other->getChild(c) );
+                    group->removeChild( j );
+                }
+                else ++j;
+            }
+
+            mergeSiblings( first );
+        }
+    }
+}
+
 //---------------------------------------------------------------------------
 
 // pseudo-loader for paging in feature tiles for a FeatureModelGraph.
@@ -283,6 +367,13 @@ FeatureModelGraph::ctor()
         return;
     }
 
+    // A dedicated pool for compiling large tiles in parallel.
+    if ( _options.compileThreads().get() > 0u )
+    {
+        _compileService = new TaskService("FeatureModelGraph compile", _options.compileThreads().get());
+        OE_INFO << LC << "Compiling features on " << _options.compileThreads().get() << " threads" << std::endl;
+    }
+
     // Set up a shared resource cache for the session. A session-wide cache means
     // that all the paging threads that load data from this FMG will load resources
     // from a single cache; e.g., once a texture is loaded in one thread, the same
@@ -1460,8 +1551,21 @@ FeatureModelGraph::createStyleGroup(const Style&          style,
         context = crop2.push( workingSet, context );
     }
 
-    // finally, compile the features into a node.
-    if ( workingSet.size() > 0 )
+    // finally, compile the features into a node. A large working set
+    // compiles in chunks on the compile pool.
+    if ( _compileService.valid() && workingSet.size() > _options.compileChunkSize().get() )
+    {
+        osg::ref_ptr<osg::Node> node;
+        if ( compileInParallel( workingSet, style, context, node ) )
+        {
+            styleGroup = getOrCreateStyleGroupFromFactory( style );
+
+            if ( node.valid() )
+                styleGroup->addChild( node.get() );
+        }
+    }
+
+    else if ( workingSet.size() > 0 )
     {
         osg::ref_ptr<osg::Node> node;
         osg::ref_ptr<FeatureCursor> newCursor = new FeatureListCursor(workingSet);
@@ -1481,6 +1585,82 @@ FeatureModelGraph::createStyleGroup(const Style&          style,
 }
 
 
+bool
+FeatureModelGraph::compileInParallel(FeatureList&                           workingSet,
+                                     const Style&                           style,
+                                     const FilterContext&                   context,
+                                     osg::ref_ptr<osg::Node>&               output)
+{
+    // split the working set into even chunks of at most compileChunkSize features.
+    // (count as we go; std::list::size may be linear)
+    unsigned count = workingSet.size();
+    unsigned chunkSize = osg::maximum(_options.compileChunkSize().get(), 1u);
+    unsigned numChunks = (count + chunkSize - 1u) / chunkSize;
+    chunkSize = (count + numChunks - 1u) / numChunks;
+
+    std::vector< osg::ref_ptr<CompileChunkTask> > tasks;
+    while ( count > 0u )
+    {
+        unsigned n = osg::minimum(chunkSize, count);
+        FeatureList::iterator end = workingSet.begin();
+        std::advance(end, n);
+
+        CompileChunkTask* task = new CompileChunkTask(_factory.get(), style, context);
+        task->_features.splice(task->_features.end(), workingSet, workingSet.begin(), end);
+        tasks.push_back(task);
+        count -= n;
+    }
+
+    // hand all but the last chunk to the pool, and compile that one here:
+    Threading::MultiEvent done(tasks.size()-1);
+    for (unsigned i = 0; i+1 < tasks.size(); ++i)
+    {
+        tasks[i]->setProgressCallback(new CompileProgress(&done));
+        _compileService->add(tasks[i].get());
+    }
+
+    (*tasks.back())(0L);
+
+    // the tasks refer to this tile's features, so wait for every one. The
+    // pool completes tasks it drops without running (e.g. on shutdown);
+    // compile those here so the tile doesn't lose them.
+    if ( tasks.size() > 1u )
+        done.wait();
+
+    bool ok = false;
+    osg::ref_ptr<osg::Group> group = new osg::Group();
+    for (unsigned i = 0; i < tasks.size(); ++i)
+    {
+        if ( !tasks[i]->_ran )
+            (*tasks[i])(0L);
+
+        if ( tasks[i]->_ok )
+        {
+            ok = true;
+            if ( tasks[i]->_node.valid() )
+                group->addChild( tasks[i]->_node.get() );
+        }
+    }
+
+    // Every chunk was compiled with the same context, so the chunks share
+    // their localizing transforms; fold them together so that the tile has
+    // one transform and one set of geodes, as if compiled in one piece.
+    mergeSiblings( group.get() );
+
+    osgUtil::Optimizer::MergeGeodesVisitor mergeGeodes;
+    group->accept( mergeGeodes );
+
+    if ( group->getNumChildren() == 1u )
+        output = group->getChild(0);
+    else if ( group->getNumChildren() > 1u )
+        output = group.get();
+
+    OE_DEBUG << LC << "Compiled " << tasks.size() << " chunks of " << chunkSize << " features\n";
+
+    return ok;
+}
+
+
 osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&          style, 
                                     const Query&          query, 
@@ -48,7 +48,9 @@ _clusterCulling    ( true ),
 _backfaceCulling   ( true ),
 _alphaBlending     ( true ),
 _sessionWideResourceCache( true ),
-_nodeCaching(false)
+_nodeCaching(false),
+_compileThreads    ( 0u ),
+_compileChunkSize  ( 2500u )
 {
     fromConfig(co.getConfig());
 }
@@ -72,6 +74,8 @@ FeatureModelOptions::fromConfig(const Config& conf)
     conf.get( "node_caching",     _nodeCaching );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
+    conf.get( "compile_threads",    _compileThreads );
+    conf.get( "compile_chunk_size", _compileChunkSize );
 
     // Support a singleton style (convenience)
     optional<Style> style;
@@ -103,6 +107,8 @@ FeatureModelOptions::getConfig() const
     conf.set( "node_caching",     _nodeCaching );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
+    conf.set( "compile_threads",    _compileThreads );
+    conf.set( "compile_chunk_size", _compileChunkSize );
 
     return conf;
 }
@@ -136,6 +142,8 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.get( "node_caching",     _nodeCaching );
     
     conf.get( "session_wide_resource_cache", _sessionWideResourceCache );
+    conf.get( "compile_threads",    _compileThreads );
+    conf.get( "compile_chunk_size", _compileChunkSize );
 }
 
 Config
@@ -164,6 +172,8 @@ FeatureModelSourceOptions::getConfig() const
     conf.set( "node_caching",     _nodeCaching );
     
     conf.set( "session_wide_resource_cache", _sessionWideResourceCache );
+    conf.set( "compile_threads",    _compileThreads );
+    conf.set( "compile_chunk_size", _compileChunkSize );
 
     return conf;
 }
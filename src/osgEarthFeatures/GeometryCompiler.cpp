@@ -284,8 +284,8 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     // first feature.
     if ( !point && !line && !polygon && !extrusion && !text && !model && !icon && workingSet.size() > 0 )
     {
-        Feature* first = workingSet.begin()->get();
-        Geometry* geom = first->getGeometry();
+        const Feature* first = workingSet.begin()->get();
+        const Geometry* geom = first->getGeometry();
         if ( geom )
         {
             switch( geom->getComponentType() )
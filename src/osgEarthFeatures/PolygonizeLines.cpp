@@ -635,10 +635,10 @@ PolygonizeLinesFilter::push(FeatureList& input, FilterContext& cx)
 
         // iterate over all the feature's geometry parts. We will treat
         // them as lines strings.
-        GeometryIterator parts( f->getGeometry(), false );
+        ConstGeometryIterator parts( static_cast<const Feature*>(f)->getGeometry(), false );
         while( parts.hasMore() )
         {
-            Geometry* part = parts.next();
+            const Geometry* part = parts.next();
 
             // skip empty geometry
             if ( part->size() == 0 )
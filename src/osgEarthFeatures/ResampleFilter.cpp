@@ -58,7 +58,7 @@ ResampleFilterOptions( conf )
 bool
 ResampleFilter::push( Feature* input, FilterContext& context )
 {
-    if ( !input || !input->getGeometry() )
+    if ( !input || !static_cast<const Feature*>(input)->getGeometry() )
         return true;
 
     bool success = true;
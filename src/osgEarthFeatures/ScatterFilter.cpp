@@ -197,7 +197,7 @@ ScatterFilter::push(FeatureList& features, FilterContext& context )
     {
         Feature* f = i->get();
         
-        Geometry* geom = f->getGeometry();
+        const Geometry* geom = static_cast<const Feature*>(f)->getGeometry();
         if ( !geom )
             continue;
 
@@ -63,7 +63,7 @@ ScriptFilter::push(Feature* input, FilterContext& context)
 {
     bool keep = true;
 
-    if (!input || !input->getGeometry() || !_engine.valid())
+    if (!input || !static_cast<const Feature*>(input)->getGeometry() || !_engine.valid())
         return false;
 
     ScriptResult result = _engine->run(_expression.get(), input, &context);
@@ -88,10 +88,26 @@ ScriptFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
+    // features without geometry never pass, so don't run the script on them.
+    // (const access, so a shared geometry is not copied just to check it)
     for( FeatureList::iterator i = input.begin(); i != input.end(); )
     {
-        if ( push( i->get(), context ) )
+        const Feature* feature = i->get();
+        if ( feature && feature->getGeometry() )
+            ++i;
+        else
+            i = input.erase(i);
+    }
+
+    // run the expression over the whole list at once, so the engine
+    // only has to look up the compiled script one time.
+    std::vector<ScriptResult> results;
+    _engine->runBatch(_expression.get(), input, results, &context);
+
+    unsigned r = 0;
+    for( FeatureList::iterator i = input.begin(); i != input.end(); ++r )
+    {
+        if ( results[r].asBool() )
         {
             ++i;
         }
@@ -90,10 +90,10 @@ _defaultInterp( GEOINTERP_GREAT_CIRCLE )
 void
 TessellateOperator::operator()( Feature* feature, FilterContext& context ) const
 {
+    const Geometry* geom = feature ? static_cast<const Feature*>(feature)->getGeometry() : 0L;
     if (_numPartitions <= 1 ||
-        !feature || 
-        !feature->getGeometry() || 
-        feature->getGeometry()->getComponentType() == Geometry::TYPE_POINTSET )
+        !geom || 
+        geom->getComponentType() == Geometry::TYPE_POINTSET )
     {
         return;
     }
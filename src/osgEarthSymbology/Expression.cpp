@@ -28,9 +28,13 @@ using namespace osgEarth::Symbology;
 
 #define LC "[Expression] "
 
+// Evaluation stack depth that eval() handles without allocating
+#define MAX_LOCAL_STACK 32
+
 NumericExpression::NumericExpression() :
 _value(0.0),
-_dirty(true)
+_dirty(true),
+_maxDepth(0)
 {
     //nop
 }
@@ -38,7 +42,8 @@ _dirty(true)
 NumericExpression::NumericExpression( const std::string& expr ) : 
 _src  ( expr ),
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_maxDepth( 0 )
 {
     init();
 }
@@ -48,14 +53,16 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_maxDepth( rhs._maxDepth )
 {
     //nop
 }
 
 NumericExpression::NumericExpression( double staticValue ) :
 _value( staticValue ),
-_dirty( false )
+_dirty( false ),
+_maxDepth( 0 )
 {
     _src = Stringify() << staticValue;
     init();
@@ -63,7 +70,8 @@ _dirty( false )
 
 NumericExpression::NumericExpression( const Config& conf ) :
 _value( 0.0 ),
-_dirty( true )
+_dirty( true ),
+_maxDepth( 0 )
 {
     mergeConfig( conf );
     init();
@@ -264,6 +272,78 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    compile();
+}
+
+void
+NumericExpression::compile()
+{
+    // Simulate the evaluation stack, tracking which entries are literals.
+    // The stack's size never depends on the data, so an operator that is
+    // short of operands would always be skipped; drop it now. An operator
+    // whose operands are both literals becomes a literal itself.
+    AtomVector program;
+    program.reserve( _rpn.size() );
+    std::vector<bool> literal;
+    _maxDepth = 0;
+
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        Atom a = _rpn[i];
+
+        if ( IS_OPERATOR(a) || a.first == MIN || a.first == MAX )
+        {
+            if ( literal.size() < 2 )
+                continue;
+
+            bool fold = literal[literal.size()-1] && literal[literal.size()-2];
+            literal.pop_back();
+
+            if ( fold )
+            {
+                // both operands are the last two instructions:
+                double op2 = program.back().second; program.pop_back();
+                double op1 = program.back().second; program.pop_back();
+
+                double r =
+                    a.first == ADD  ? op1 + op2 :
+                    a.first == SUB  ? op1 - op2 :
+                    a.first == MULT ? op1 * op2 :
+                    a.first == DIV  ? op1 / op2 :
+                    a.first == MOD  ? fmod(op1, op2) :
+                    a.first == MIN  ? osg::minimum(op1, op2) :
+                                      osg::maximum(op1, op2);
+
+                program.push_back( Atom(OPERAND, r) );
+            }
+            else
+            {
+                program.push_back( a );
+                literal.back() = false;
+            }
+        }
+        else
+        {
+            // a stray parenthesis pushes its (zero) value, like an operand.
+            if ( a.first != VARIABLE )
+                a.first = OPERAND;
+
+            program.push_back( a );
+            literal.push_back( a.first == OPERAND );
+            _maxDepth = osg::maximum( _maxDepth, (unsigned)literal.size() );
+        }
+    }
+
+    _rpn.swap( program );
+
+    // point the variables at their new places in the program.
+    unsigned var_i = 0;
+    for( unsigned i=0; i<_rpn.size() && var_i<_vars.size(); ++i )
+    {
+        if ( _rpn[i].first == VARIABLE )
+            _vars[var_i++].second = i;
+    }
 }
 
 void 
@@ -282,82 +362,34 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
-
-        for( unsigned i=0; i<_rpn.size(); ++i )
+        // compile() dropped any operator without two operands, so the
+        // program can run without checking the stack.
+        double local[MAX_LOCAL_STACK];
+        std::vector<double> deep;
+        double* s = local;
+        if ( _maxDepth > MAX_LOCAL_STACK )
         {
-            const Atom& a = _rpn[i];
+            deep.resize( _maxDepth );
+            s = &deep[0];
+        }
 
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::minimum(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::maximum(op1, op2) );
-                }
-            }
-            else // OPERAND or VARIABLE
+        unsigned n = 0;
+        for( AtomVector::const_iterator i = _rpn.begin(); i != _rpn.end(); ++i )
+        {
+            switch( i->first )
             {
-                s.push( a.second );
+            case ADD:  --n; s[n-1] = s[n-1] + s[n]; break;
+            case SUB:  --n; s[n-1] = s[n-1] - s[n]; break;
+            case MULT: --n; s[n-1] = s[n-1] * s[n]; break;
+            case DIV:  --n; s[n-1] = s[n-1] / s[n]; break;
+            case MOD:  --n; s[n-1] = fmod(s[n-1], s[n]); break;
+            case MIN:  --n; s[n-1] = osg::minimum(s[n-1], s[n]); break;
+            case MAX:  --n; s[n-1] = osg::maximum(s[n-1], s[n]); break;
+            default:   s[n++] = i->second; break; // OPERAND or VARIABLE
             }
         }
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
+        const_cast<NumericExpression*>(this)->_value = n > 0 ? s[n-1] : 0.0;
         const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
@@ -550,11 +582,12 @@ StringExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stringstream buf;
+        // append in place so the result reuses its buffer from one eval to the next
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
@@ -1074,6 +1074,17 @@ EarthManipulator::setViewpoint(const Viewpoint& vp, double duration_seconds)
                 _settings->getAutoViewpointDurationLimits( minDur, maxDur );
                 _setVPDuration.set( minDur + ratio*(maxDur-minDur), Units::SECONDS );
             }
+
+            // Let the terrain engine start loading the destination area now.
+            osg::ref_ptr<MapNode> mapNode;
+            if ( _mapNode.lock(mapNode) && mapNode->getTerrainEngine() )
+            {
+                osg::Vec3d up = _srs->isGeographic() ? endWorld : osg::Vec3d(0,0,1);
+                up.normalize();
+                mapNode->getTerrainEngine()->notifyOfCameraDestination(
+                    endWorld + up*range1,
+                    _setVPDuration.as(Units::SECONDS) );
+            }
         }
 
         else
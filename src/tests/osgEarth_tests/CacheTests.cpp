@@ -24,6 +24,9 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/Registry>
 #include <osgEarth/Cache>
+#include <osgEarth/FileUtils>
+#include <osgEarth/MemCache>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth;
 
@@ -83,3 +86,115 @@ TEST_CASE( "Cache" ) {
         REQUIRE(r2.failed());
     }  
 }
+
+TEST_CASE( "Pack cache" ) {
+
+    Config conf;
+    conf.set("driver", "pack");
+    conf.set("path", getTempName(getTempPath(), "oe_pack_cache"));
+    conf.set("pack_size_mb", 1);
+    conf.set("index_capacity", 16);
+    conf.set("background_compaction", false);
+    CacheOptions options = CacheOptions(ConfigOptions(conf));
+
+    const unsigned count = 64;
+    std::string value(65536, 'x');
+
+    {
+        osg::ref_ptr<Cache> cache = CacheFactory::create(options);
+        REQUIRE(cache.valid());
+
+        osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+        REQUIRE(bin.valid());
+
+        // enough records to grow the index and spill into several pack files:
+        for (unsigned i = 0; i < count; ++i)
+        {
+            osg::ref_ptr<StringObject> s = new StringObject(Stringify() << value << i);
+            REQUIRE(bin->write(Stringify() << "key" << i, s.get(), 0L));
+        }
+
+        // overwrite and remove every other record, leaving dead space:
+        for (unsigned i = 0; i < count; i += 2)
+        {
+            osg::ref_ptr<StringObject> s = new StringObject("overwritten");
+            REQUIRE(bin->write(Stringify() << "key" << i, s.get(), 0L));
+            REQUIRE(bin->remove(Stringify() << "key" << (i+1)));
+        }
+
+        REQUIRE(bin->touch("key0"));
+        REQUIRE_FALSE(bin->touch("key1"));
+
+        unsigned before = bin->getStorageSize();
+        REQUIRE(bin->compact());
+        REQUIRE(bin->getStorageSize() < before);
+    }
+
+    // reopen and make sure everything survived, including the removals:
+    {
+        osg::ref_ptr<Cache> cache = CacheFactory::create(options);
+        REQUIRE(cache.valid());
+
+        osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+        REQUIRE(bin.valid());
+
+        for (unsigned i = 0; i < count; i += 2)
+        {
+            ReadResult r = bin->readString(Stringify() << "key" << i, 0L);
+            REQUIRE(r.succeeded());
+            REQUIRE(r.getString() == "overwritten");
+
+            REQUIRE(bin->getRecordStatus(Stringify() << "key" << (i+1)) == CacheBin::STATUS_NOT_FOUND);
+        }
+
+        REQUIRE(cache->clear());
+        REQUIRE(bin->readString("key0", 0L).failed());
+    }
+}
+
+TEST_CASE( "MemCache" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache(1024);
+    cache->setMaxBinSizeBytes(16 * 1024 * 1024);
+
+    CacheBin* bin = cache->addBin("test_bin");
+    REQUIRE(bin != 0L);
+
+    // 1MB each:
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(512, 512, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    SECTION("Byte budget")
+    {
+        for (unsigned i = 0; i < 32; ++i)
+        {
+            REQUIRE(bin->write(Stringify() << "key" << i, image.get(), Config()));
+        }
+
+        CacheStats stats = cache->getStats("test_bin");
+        REQUIRE(stats._bytes <= 16u * 1024u * 1024u);
+        REQUIRE(stats._entries < 32u);
+
+        // the most recent write always survives:
+        REQUIRE(bin->readImage("key31", 0L).succeeded());
+        REQUIRE(bin->readImage("no_such_key", 0L).failed());
+
+        stats = cache->getStats("test_bin");
+        REQUIRE(stats._hits == 1u);
+        REQUIRE(stats._misses == 1u);
+    }
+
+    SECTION("Global budget")
+    {
+        size_t oldMax = MemCache::getGlobalMaxSizeBytes();
+        MemCache::setGlobalMaxSizeBytes(MemCache::getGlobalSizeBytes() + 4 * 1024 * 1024);
+
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            REQUIRE(bin->write(Stringify() << "key" << i, image.get(), Config()));
+        }
+        REQUIRE(cache->getStats("test_bin")._entries <= 4u);
+
+        MemCache::setGlobalMaxSizeBytes(oldMax);
+    }
+}
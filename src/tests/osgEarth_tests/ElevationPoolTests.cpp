@@ -0,0 +1,154 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Map>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/Registry>
+#include <osg/Timer>
+
+#include <osgEarthDrivers/gdal/GDALOptions>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace ElevationPoolTest
+{
+    Map* createMap()
+    {
+        GDALOptions opt;
+        opt.url() = "../data/terrain/mt_rainier_90m.tif";
+
+        Map* map = new Map();
+        map->addLayer(new ElevationLayer(ElevationLayerOptions("rainier", opt)));
+        return map;
+    }
+
+    // Regular grid of points around Mt. Rainier, in WGS84.
+    void createPoints(unsigned dim, std::vector<osg::Vec3d>& points)
+    {
+        points.clear();
+        for (unsigned r = 0; r < dim; ++r)
+            for (unsigned c = 0; c < dim; ++c)
+                points.push_back(osg::Vec3d(
+                    -121.9 + 0.3*(double)c/(double)(dim-1),
+                    46.7 + 0.3*(double)r/(double)(dim-1),
+                    0.0));
+    }
+}
+
+TEST_CASE( "ElevationEnvelope::getElevations matches per-point sampling" ) {
+
+    osg::ref_ptr<Map> map = ElevationPoolTest::createMap();
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    std::vector<osg::Vec3d> points;
+    ElevationPoolTest::createPoints(64, points);
+
+    osg::ref_ptr<ElevationEnvelope> batched = map->getElevationPool()->createEnvelope(wgs84, 12u);
+    std::vector<float> output;
+    unsigned count = batched->getElevations(points, output);
+    REQUIRE(output.size() == points.size());
+    REQUIRE(count > 0u);
+
+    osg::ref_ptr<ElevationEnvelope> scalar = map->getElevationPool()->createEnvelope(wgs84, 12u);
+    for (unsigned i = 0; i < points.size(); ++i)
+    {
+        REQUIRE(output[i] == scalar->getElevation(points[i].x(), points[i].y()));
+    }
+}
+
+TEST_CASE( "ElevationPool tracks cache hits and evictions" ) {
+
+    osg::ref_ptr<Map> map = ElevationPoolTest::createMap();
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    ElevationPool* pool = map->getElevationPool();
+    pool->setMaxEntries(16u);
+    pool->resetStats();
+
+    std::vector<osg::Vec3d> points;
+    ElevationPoolTest::createPoints(64, points);
+    std::vector<float> output;
+
+    osg::ref_ptr<ElevationEnvelope> env1 = pool->createEnvelope(wgs84, 12u);
+    env1->getElevations(points, output);
+    REQUIRE(pool->getNumMisses() > 0u);
+
+    // a second envelope over the same area should hit the cache
+    osg::ref_ptr<ElevationEnvelope> env2 = pool->createEnvelope(wgs84, 12u);
+    env2->getElevations(points, output);
+    REQUIRE(pool->getNumHits() > 0u);
+
+    // sparse points at a much higher LOD each need their own tile,
+    // overflowing the small cache
+    ElevationPoolTest::createPoints(8, points);
+    osg::ref_ptr<ElevationEnvelope> env3 = pool->createEnvelope(wgs84, 16u);
+    env3->getElevations(points, output);
+    REQUIRE(pool->getNumEvictions() > 0u);
+}
+
+TEST_CASE( "ElevationPool keeps the tile it just loaded, however small the cache" ) {
+
+    osg::ref_ptr<Map> map = ElevationPoolTest::createMap();
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    ElevationPool* pool = map->getElevationPool();
+    pool->setMaxEntries(1u);
+    pool->resetStats();
+
+    osg::ref_ptr<ElevationEnvelope> env1 = pool->createEnvelope(wgs84, 12u);
+    float h1 = env1->getElevation(-121.76, 46.85);
+    REQUIRE(pool->getNumMisses() > 0u);
+
+    osg::ref_ptr<ElevationEnvelope> env2 = pool->createEnvelope(wgs84, 12u);
+    float h2 = env2->getElevation(-121.76, 46.85);
+    REQUIRE(pool->getNumHits() > 0u);
+    REQUIRE(h1 == h2);
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "ElevationEnvelope::getElevations throughput", "[.][benchmark]" ) {
+
+    osg::ref_ptr<Map> map = ElevationPoolTest::createMap();
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    std::vector<osg::Vec3d> points;
+    ElevationPoolTest::createPoints(1000, points);
+
+    // warm up the pool so both runs sample already-loaded tiles
+    std::vector<float> output;
+    osg::ref_ptr<ElevationEnvelope> env = map->getElevationPool()->createEnvelope(wgs84, 12u);
+    env->getElevations(points, output);
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < points.size(); ++i)
+        env->getElevation(points[i].x(), points[i].y());
+    osg::Timer_t t1 = osg::Timer::instance()->tick();
+    env->getElevations(points, output);
+    osg::Timer_t t2 = osg::Timer::instance()->tick();
+
+    OE_NOTICE << points.size() << " points:"
+        << " per-point=" << osg::Timer::instance()->delta_m(t0, t1) << "ms"
+        << " batched=" << osg::Timer::instance()->delta_m(t1, t2) << "ms"
+        << std::endl;
+}
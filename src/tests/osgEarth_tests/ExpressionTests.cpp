@@ -0,0 +1,126 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarthSymbology/Expression>
+#include <osgEarthFeatures/Feature>
+#include <osg/Timer>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Features;
+
+TEST_CASE( "NumericExpression" ) {
+
+    SECTION("Literals follow operator precedence") {
+        REQUIRE(NumericExpression("1 + 2 * 3").eval() == 7.0);
+        REQUIRE(NumericExpression("(1 + 2) * 3").eval() == 9.0);
+        REQUIRE(NumericExpression("10 % 4").eval() == 2.0);
+        REQUIRE(NumericExpression("min(4, 2) + max(1, 5)").eval() == 7.0);
+        REQUIRE(NumericExpression(12.5).eval() == 12.5);
+    }
+
+    SECTION("Variables are set per evaluation") {
+        NumericExpression expr("[a] - [b] / 2 + 3 * 4");
+        REQUIRE(expr.variables().size() == 2);
+
+        expr.set(expr.variables()[0], 10.0);
+        expr.set(expr.variables()[1], 4.0);
+        REQUIRE(expr.eval() == 20.0);
+
+        expr.set(expr.variables()[1], 8.0);
+        REQUIRE(expr.eval() == 18.0);
+    }
+
+    SECTION("Copies evaluate independently") {
+        NumericExpression expr("[a] * 2");
+        NumericExpression copy(expr);
+        expr.set(expr.variables()[0], 1.0);
+        copy.set(copy.variables()[0], 5.0);
+        REQUIRE(expr.eval() == 2.0);
+        REQUIRE(copy.eval() == 10.0);
+    }
+}
+
+TEST_CASE( "Feature evaluates expressions against its attributes" ) {
+
+    osg::ref_ptr<Feature> feature = new Feature(new Geometry(), SpatialReference::create("wgs84"));
+    feature->set("Height", 10.0);
+    feature->set("name", std::string("Main"));
+    feature->set("lanes", 4);
+
+    const FilterContext* noContext = 0L;
+
+    SECTION("Numeric") {
+        NumericExpression expr("[HEIGHT] * 2 + [lanes]");
+        REQUIRE(feature->eval(expr, noContext) == 24.0);
+
+        feature->set("height", 3.0);
+        REQUIRE(feature->eval(expr, noContext) == 10.0);
+    }
+
+    SECTION("String") {
+        StringExpression expr("[name] + \" St, \" + [lanes]");
+        REQUIRE(feature->eval(expr, noContext) == "Main St, 4");
+
+        feature->set("name", std::string("Elm"));
+        REQUIRE(feature->eval(expr, noContext) == "Elm St, 4");
+    }
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "Expression evaluation throughput", "[.][benchmark]" ) {
+
+    const unsigned count = 1000000;
+    osg::ref_ptr<const SpatialReference> wgs84 = SpatialReference::create("wgs84");
+
+    std::vector< osg::ref_ptr<Feature> > features(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        features[i] = new Feature(new Geometry(), wgs84.get());
+        features[i]->set("height", (double)(i % 50));
+        features[i]->set("levels", (int)(i % 7));
+        features[i]->set("name", std::string(i % 2 ? "North" : "South"));
+    }
+
+    const FilterContext* noContext = 0L;
+
+    NumericExpression height("max([height], [levels] * 3.5) + 2 * 0.5");
+    double sum = 0.0;
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < count; ++i)
+        sum += features[i]->eval(height, noContext);
+    double numericTime = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    StringExpression label("[name] + \" Tower \" + [levels]");
+    unsigned length = 0;
+    start = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < count; ++i)
+        length += features[i]->eval(label, noContext).length();
+    double stringTime = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    REQUIRE(sum > 0.0);
+    REQUIRE(length > 0u);
+
+    OE_NOTICE << "numeric: " << (unsigned)((double)count / numericTime) << " evals/s"
+        << "  string: " << (unsigned)((double)count / stringTime) << " evals/s" << std::endl;
+}
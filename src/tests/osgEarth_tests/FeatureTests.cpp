@@ -24,6 +24,9 @@
 
 #include <osgEarthFeatures/Feature>
 #include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/FeatureListSource>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/GeometryCompiler>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -105,3 +108,185 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+TEST_CASE("Feature attributes stored in shared columns") {
+    osg::ref_ptr<const SpatialReference> wgs84 = osgEarth::SpatialReference::create("wgs84");
+
+    FeatureList features;
+    for (int i = 0; i < 3; ++i)
+    {
+        Feature* feature = new Feature(new Geometry(), wgs84.get());
+        feature->set("name", std::string("building"));
+        feature->set("height", 10.0 * i);
+        feature->set("floors", i);
+        feature->set("extra", std::string("kept"));
+        features.push_back(feature);
+    }
+    features.back()->setNull("name");
+
+    FeatureSchema schema;
+    schema["name"] = ATTRTYPE_STRING;
+    schema["height"] = ATTRTYPE_DOUBLE;
+    schema["floors"] = ATTRTYPE_INT;
+    schema["roof"] = ATTRTYPE_BOOL;
+
+    osg::ref_ptr<AttributeColumns> columns = AttributeColumns::pack(features, schema);
+    REQUIRE(columns->getNumFields() == 4);
+    REQUIRE(columns->getNumRows() == 3);
+    REQUIRE(columns->getFieldID("HEIGHT") == columns->getFieldID("height"));
+    REQUIRE(columns->getFieldID("extra") == -1);
+
+    Feature* feature = features.front().get();
+    Feature* last = features.back().get();
+
+    SECTION("Accessors read the columns") {
+        REQUIRE(feature->getAttributeColumns() == columns.get());
+        REQUIRE(feature->getString("name") == "building");
+        REQUIRE(last->getDouble("Height") == 20.0);
+        REQUIRE(last->getInt("floors") == 2);
+        REQUIRE(last->getString("floors") == "2");
+        REQUIRE(last->isSet("name") == false);
+        REQUIRE(last->getString("name") == "");
+        REQUIRE(feature->hasAttr("height") == true);
+        REQUIRE(feature->hasAttr("roof") == false);
+        REQUIRE(last->hasAttr("name") == false);
+        REQUIRE(feature->isSet("roof") == false);
+        REQUIRE(feature->getBool("roof", true) == true);
+        REQUIRE(feature->getString("extra") == "kept");
+        REQUIRE(feature->getAttrs().size() == 1);
+    }
+
+    SECTION("Setters write the row, converting to the schema type") {
+        feature->set("height", std::string("42.5"));
+        feature->set("roof", true);
+        REQUIRE(feature->getDouble("height") == 42.5);
+        REQUIRE(feature->getBool("roof") == true);
+        REQUIRE(features.back()->getBool("roof") == false);
+    }
+
+    SECTION("Copies get their own table; reading all attributes does not detach") {
+        osg::ref_ptr<Feature> copy = new Feature(*last);
+        REQUIRE(copy->getAttributeColumns() == 0L);
+        REQUIRE(copy->getDouble("height") == 20.0);
+        REQUIRE(copy->isSet("name") == false);
+
+        // fields the feature never set (or set to NULL) are left out:
+        const Feature* constLast = last;
+        REQUIRE(constLast->getAllAttrs().size() == 3);
+        REQUIRE(constLast->getAllAttrs().count("roof") == 0);
+        REQUIRE(feature->getAllAttrs().size() == 4);
+        REQUIRE(constLast->getAttrs().size() == 1);
+        REQUIRE(last->getAttributeColumns() == columns.get());
+        REQUIRE(last->getInt("floors") == 2);
+    }
+
+    SECTION("Detaching moves the values back into the feature") {
+        last->setAttributeColumns(0L, 0);
+        REQUIRE(last->getAttributeColumns() == 0L);
+        REQUIRE(last->getAttrs().size() == 3);
+        REQUIRE(last->hasAttr("roof") == false);
+        REQUIRE(last->getDouble("height") == 20.0);
+    }
+}
+
+TEST_CASE("FeatureListSource answers bounded queries from its spatial index") {
+    osg::ref_ptr<const SpatialReference> wgs84 = osgEarth::SpatialReference::create("wgs84");
+    osg::ref_ptr<FeatureListSource> source = new FeatureListSource();
+
+    // one point feature per whole degree on a 100x50 grid:
+    for (int y = 0; y < 50; ++y)
+    {
+        for (int x = 0; x < 100; ++x)
+        {
+            PointSet* point = new PointSet();
+            point->push_back(osg::Vec3d(x, y, 0));
+            Feature* feature = new Feature(point, wgs84.get());
+            feature->setFID(y*100 + x);
+            source->insertFeature(feature);
+        }
+    }
+    source->open();
+
+    Query query;
+    query.bounds() = Bounds(9.5, 19.5, 20.5, 25.5);
+
+    SECTION("Only features in the bounds come back, in list order") {
+        FeatureList features;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query, 0L);
+        cursor->fill(features);
+        REQUIRE(features.size() == 11*6);
+        REQUIRE(features.front()->getFID() == 20*100 + 10);
+        REQUIRE(features.back()->getFID() == 25*100 + 20);
+
+        osg::ref_ptr<FeatureCursor> all = source->createFeatureCursor(Query(), 0L);
+        features.clear();
+        all->fill(features);
+        REQUIRE(features.size() == 5000);
+    }
+
+    SECTION("Changes through the API rebuild the index") {
+        source->deleteFeature(20*100 + 10);
+        FeatureList features;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query, 0L);
+        cursor->fill(features);
+        REQUIRE(features.size() == 11*6 - 1);
+    }
+
+    SECTION("Cursor features copy their geometry only on write") {
+        const Feature* original = source->getFeature(20*100 + 10);
+        FeatureList features;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query, 0L);
+        cursor->fill(features);
+
+        const Feature* copy = features.front().get();
+        REQUIRE(copy != original);
+        REQUIRE(copy->getGeometry() == original->getGeometry());
+
+        Geometry* geom = features.front()->getGeometry();
+        REQUIRE(geom != original->getGeometry());
+        (*geom)[0].x() = 50.0;
+        REQUIRE((*original->getGeometry())[0].x() == 10.0);
+    }
+
+    SECTION("Changing the source feature does not change filled cursor features") {
+        FeatureList features;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(query, 0L);
+        cursor->fill(features);
+
+        Feature* original = source->getFeature(20*100 + 10);
+        const Feature* copy = features.front().get();
+        REQUIRE(copy->getFID() == original->getFID());
+
+        (*original->getGeometry())[0].x() = 50.0;
+        REQUIRE((*copy->getGeometry())[0].x() == 10.0);
+
+        // and the index sees the change:
+        features.clear();
+        cursor = source->createFeatureCursor(query, 0L);
+        cursor->fill(features);
+        REQUIRE(features.size() == 11*6 - 1);
+    }
+}
+
+TEST_CASE("GeometryCompiler reads feature geometry without copying it") {
+    osg::ref_ptr<const SpatialReference> wgs84 = osgEarth::SpatialReference::create("wgs84");
+
+    PointSet* point = new PointSet();
+    point->push_back(osg::Vec3d(10, 20, 0));
+    osg::ref_ptr<const Feature> original = new Feature(point, wgs84.get());
+
+    FeatureList features;
+    features.push_back(new Feature(*original, osg::CopyOp::SHALLOW_COPY));
+    const Feature* copy = features.front().get();
+    REQUIRE(copy->getGeometry() == original->getGeometry());
+
+    // no style, so the compiler picks a symbol from the geometry type
+    // and builds points, none of which changes the geometry:
+    GeometryCompiler compiler;
+    osg::ref_ptr<osg::Node> node = compiler.compile(features, Style(), FilterContext());
+    REQUIRE(node.valid());
+
+    REQUIRE(features.size() == 1u);
+    REQUIRE(features.front().get() == copy);
+    REQUIRE(copy->getGeometry() == original->getGeometry());
+}
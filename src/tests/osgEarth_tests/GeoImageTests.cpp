@@ -0,0 +1,142 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/GeoData>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/Notify>
+#include <osg/Timer>
+
+using namespace osgEarth;
+
+namespace GeoImageTest
+{
+    // Smooth synthetic RGBA image so that resampling differences stay small.
+    GeoImage createImage(unsigned size)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        image->setInternalTextureFormat(GL_RGBA8);
+
+        ImageUtils::PixelWriter write(image);
+        for (unsigned t = 0; t < size; ++t)
+        {
+            for (unsigned s = 0; s < size; ++s)
+            {
+                float u = (float)s / (float)size;
+                float v = (float)t / (float)size;
+                write(osg::Vec4(
+                    0.5f + 0.5f*sinf(u * 6.2831853f),
+                    0.5f + 0.5f*cosf(v * 6.2831853f),
+                    0.5f*(u + v),
+                    1.0f), s, t);
+            }
+        }
+
+        const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+        return GeoImage(image, GeoExtent(wgs84, -123.0, 45.0, -120.0, 48.0));
+    }
+
+    // PSNR (in dB) of the RGB channels over the pixels that are opaque in both images.
+    double psnr(const osg::Image* a, const osg::Image* b)
+    {
+        ImageUtils::PixelReader readA(a);
+        ImageUtils::PixelReader readB(b);
+        double sse = 0.0;
+        unsigned count = 0;
+        for (int t = 0; t < a->t(); ++t)
+        {
+            for (int s = 0; s < a->s(); ++s)
+            {
+                osg::Vec4 pa = readA(s, t);
+                osg::Vec4 pb = readB(s, t);
+                if (pa.a() < 1.0f || pb.a() < 1.0f)
+                    continue;
+                for (unsigned k = 0; k < 3; ++k)
+                {
+                    double d = pa[k] - pb[k];
+                    sse += d*d;
+                }
+                count += 3;
+            }
+        }
+        if (count == 0)
+            return 0.0;
+        double mse = sse / (double)count;
+        return mse > 0.0 ? 10.0 * log10(1.0 / mse) : 100.0;
+    }
+}
+
+TEST_CASE( "GeoImage native reprojection matches GDAL reprojection" ) {
+
+    GeoImage src = GeoImageTest::createImage(256);
+    REQUIRE(src.valid());
+
+    const SpatialReference* utm = SpatialReference::get("epsg:32610");
+    REQUIRE(utm != 0L);
+
+    GeoExtent destExtent = src.getExtent().transform(utm);
+
+    GeoImage gdal = src.reproject(utm, &destExtent, 256, 256, true);
+    REQUIRE(gdal.valid());
+
+    SECTION("Bilinear") {
+        GeoImage native = src.reprojectNative(utm, &destExtent, 256, 256, INTERP_BILINEAR);
+        REQUIRE(native.valid());
+        REQUIRE(native.getImage()->s() == 256);
+        REQUIRE(native.getImage()->t() == 256);
+        REQUIRE(GeoImageTest::psnr(gdal.getImage(), native.getImage()) > 30.0);
+    }
+
+    SECTION("Cubic") {
+        GeoImage native = src.reprojectNative(utm, &destExtent, 256, 256, INTERP_CUBIC);
+        REQUIRE(native.valid());
+        REQUIRE(GeoImageTest::psnr(gdal.getImage(), native.getImage()) > 30.0);
+    }
+
+    SECTION("Nearest") {
+        GeoImage native = src.reprojectNative(utm, &destExtent, 256, 256, INTERP_NEAREST);
+        REQUIRE(native.valid());
+        REQUIRE(GeoImageTest::psnr(gdal.getImage(), native.getImage()) > 25.0);
+    }
+}
+
+TEST_CASE( "GeoImage native reprojection benchmark", "[.][benchmark]" ) {
+
+    GeoImage src = GeoImageTest::createImage(256);
+    const SpatialReference* utm = SpatialReference::get("epsg:32610");
+    GeoExtent destExtent = src.getExtent().transform(utm);
+    const unsigned iterations = 50;
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < iterations; ++i)
+        src.reproject(utm, &destExtent, 256, 256, true);
+    osg::Timer_t t1 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < iterations; ++i)
+        src.reprojectNative(utm, &destExtent, 256, 256, INTERP_BILINEAR);
+    osg::Timer_t t2 = osg::Timer::instance()->tick();
+
+    OE_NOTICE << "GDAL reprojection:   " << osg::Timer::instance()->delta_m(t0, t1) / (double)iterations << " ms/tile" << std::endl;
+    OE_NOTICE << "Native reprojection: " << osg::Timer::instance()->delta_m(t1, t2) / (double)iterations << " ms/tile" << std::endl;
+}
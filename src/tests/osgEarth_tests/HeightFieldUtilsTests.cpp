@@ -0,0 +1,205 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/SpatialReference>
+#include <osg/Timer>
+
+using namespace osgEarth;
+
+namespace HeightFieldUtilsTest
+{
+    // Bumpy synthetic terrain with a few hundred meters of relief.
+    osg::HeightField* createHeightField(unsigned cols, unsigned rows)
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate(cols, rows);
+        for (unsigned r = 0; r < rows; ++r)
+            for (unsigned c = 0; c < cols; ++c)
+                hf->setHeight(c, r, 1000.0f*sin(0.3f*c)*cos(0.2f*r) + 50.0f*(float)((c*7 + r*13) % 11));
+        return hf;
+    }
+
+    // Per-post normal and curvature as HeightFieldUtils::createNormalMap
+    // used to compute them, kept here only as a baseline.
+    void referenceNormal(const osg::HeightField* hf, int s, int t, float dx, float dy, osg::Vec3f& out_n, float& out_c)
+    {
+        int sMax = hf->getNumColumns()-1, tMax = hf->getNumRows()-1;
+        float h = hf->getHeight(s, t);
+
+        osg::Vec3f west ( s > 0 ? -dx : 0, 0, hf->getHeight(osg::maximum(0, s-1), t) );
+        osg::Vec3f east ( s < sMax ? dx : 0, 0, hf->getHeight(osg::minimum(sMax, s+1), t) );
+        osg::Vec3f south( 0, t > 0 ? -dy : 0, hf->getHeight(s, osg::maximum(0, t-1)) );
+        osg::Vec3f north( 0, t < tMax ? dy : 0, hf->getHeight(s, osg::minimum(tMax, t+1)) );
+
+        out_n = (east-west) ^ (north-south);
+        out_n.normalize();
+
+        float D = (0.5*(west.z()+east.z()) - h) / (dx*dx);
+        float E = (0.5*(south.z()+north.z()) - h) / (dy*dy);
+        out_c = osg::clampBetween(-2.0f*(D+E)*100.0f, -1.0f, 1.0f);
+    }
+}
+
+TEST_CASE( "HeightFieldUtils row kernels" ) {
+
+    osg::ref_ptr<const SpatialReference> wgs84 = SpatialReference::get("wgs84");
+    GeoExtent extent(wgs84.get(), -10.0, 40.0, -9.0, 41.0);
+
+    osg::ref_ptr<osg::HeightField> hf = HeightFieldUtilsTest::createHeightField(65, 65);
+
+    SECTION("resampleHeightField matches per-sample interpolation") {
+        osg::ref_ptr<osg::HeightField> out = HeightFieldUtils::resampleHeightField(hf.get(), extent, 37, 23);
+        REQUIRE(out.valid());
+        for (int y = 0; y < 23; ++y)
+            for (int x = 0; x < 37; ++x)
+            {
+                float expected = HeightFieldUtils::getHeightAtNormalizedLocation(hf.get(), (double)x/36.0, (double)y/22.0);
+                REQUIRE(out->getHeight(x, y) == Approx(expected).epsilon(1e-5).scale(1000.0));
+            }
+    }
+
+    SECTION("createSubSample matches per-sample interpolation") {
+        GeoExtent sub(wgs84.get(), -9.8, 40.25, -9.3, 40.75);
+        osg::ref_ptr<osg::HeightField> out = HeightFieldUtils::createSubSample(hf.get(), extent, sub);
+        REQUIRE(out.valid());
+
+        double xInterval = extent.width() / 64.0, yInterval = extent.height() / 64.0;
+        for (int row = 0; row < 65; ++row)
+            for (int col = 0; col < 65; ++col)
+            {
+                double x = sub.xMin() + col*out->getXInterval();
+                double y = sub.yMin() + row*out->getYInterval();
+                float expected = HeightFieldUtils::getHeightAtLocation(hf.get(), x, y, extent.xMin(), extent.yMin(), xInterval, yInterval);
+                REQUIRE(out->getHeight(col, row) == Approx(expected).epsilon(1e-5).scale(1000.0));
+            }
+    }
+
+    SECTION("NO_DATA samples follow getHeightAtPixel") {
+        hf->setHeight(10, 10, NO_DATA_VALUE);
+        hf->setHeight(11, 10, NO_DATA_VALUE);
+        hf->setHeight(10, 11, NO_DATA_VALUE);
+        hf->setHeight(11, 11, NO_DATA_VALUE);
+        hf->setHeight(40, 30, NO_DATA_VALUE);
+
+        std::vector<float> out(129*129);
+        HeightFieldUtils::getHeightsAtPixels(hf.get(), 0.0, 0.5, 129, 0.0, 0.5, 129, &out[0]);
+        for (unsigned j = 0; j < 129; ++j)
+            for (unsigned i = 0; i < 129; ++i)
+            {
+                float expected = HeightFieldUtils::getHeightAtPixel(hf.get(), 0.5*i, 0.5*j);
+                if (expected == NO_DATA_VALUE)
+                    REQUIRE(out[j*129 + i] == NO_DATA_VALUE);
+                else
+                    REQUIRE(out[j*129 + i] == Approx(expected).epsilon(1e-5).scale(1000.0));
+            }
+    }
+
+    SECTION("createNormalRow matches per-post central differences") {
+        const int w = hf->getNumColumns(), h = hf->getNumRows();
+        const float dx = 84000.0f/64.0f, dy = 111000.0f/64.0f;
+        const float* heights = &hf->getHeightList().front();
+
+        std::vector<osg::Vec3f> normals(w);
+        std::vector<float> curvatures(w);
+
+        for (int t = 0; t < h; ++t)
+        {
+            const float* row = heights + t*w;
+            HeightFieldUtils::createNormalRow(
+                t > 0 ? row - w : row, row, t < h-1 ? row + w : row,
+                w, dx, dy, &normals[0], &curvatures[0]);
+
+            for (int s = 0; s < w; ++s)
+            {
+                osg::Vec3f n;
+                float c;
+                HeightFieldUtilsTest::referenceNormal(hf.get(), s, t, dx, dy, n, c);
+
+                normals[s].normalize();
+                REQUIRE(normals[s].x() == Approx(n.x()).epsilon(1e-5));
+                REQUIRE(normals[s].y() == Approx(n.y()).epsilon(1e-5));
+                REQUIRE(normals[s].z() == Approx(n.z()).epsilon(1e-5));
+                REQUIRE(curvatures[s] == Approx(c).epsilon(1e-5));
+            }
+        }
+    }
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "HeightFieldUtils row kernel throughput", "[.][benchmark]" ) {
+
+    osg::ref_ptr<osg::HeightField> hf = HeightFieldUtilsTest::createHeightField(257, 257);
+    const unsigned dim = 257, passes = 200;
+    const float dx = 300.0f, dy = 300.0f;
+
+    std::vector<float> out(dim*dim);
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    for (unsigned p = 0; p < passes; ++p)
+        for (unsigned j = 0; j < dim; ++j)
+            for (unsigned i = 0; i < dim; ++i)
+                out[j*dim + i] = HeightFieldUtils::getHeightAtPixel(hf.get(), 0.37*i + 3.1, 0.37*j + 5.3);
+    double perSample = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    float check = out[dim*dim/2];
+
+    start = osg::Timer::instance()->tick();
+    for (unsigned p = 0; p < passes; ++p)
+        HeightFieldUtils::getHeightsAtPixels(hf.get(), 3.1, 0.37, dim, 5.3, 0.37, dim, &out[0]);
+    double rows = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    REQUIRE(out[dim*dim/2] == Approx(check).epsilon(1e-5).scale(1000.0));
+
+    OE_NOTICE << "resample: per-sample=" << (unsigned)((double)(dim*dim*passes) / perSample) << " samples/s"
+        << " rows=" << (unsigned)((double)(dim*dim*passes) / rows) << " samples/s" << std::endl;
+
+    osg::Vec3f n;
+    float c;
+    start = osg::Timer::instance()->tick();
+    for (unsigned p = 0; p < passes; ++p)
+        for (int t = 0; t < (int)dim; ++t)
+            for (int s = 0; s < (int)dim; ++s)
+                HeightFieldUtilsTest::referenceNormal(hf.get(), s, t, dx, dy, n, c);
+    perSample = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    std::vector<osg::Vec3f> normals(dim);
+    std::vector<float> curvatures(dim);
+    const float* heights = &hf->getHeightList().front();
+    start = osg::Timer::instance()->tick();
+    for (unsigned p = 0; p < passes; ++p)
+        for (int t = 0; t < (int)dim; ++t)
+        {
+            const float* row = heights + t*dim;
+            HeightFieldUtils::createNormalRow(
+                t > 0 ? row - dim : row, row, t < (int)dim-1 ? row + dim : row,
+                dim, dx, dy, &normals[0], &curvatures[0]);
+            for (unsigned s = 0; s < dim; ++s)
+                normals[s].normalize();
+        }
+    rows = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    REQUIRE(normals[dim-1].z() == Approx(n.z()).epsilon(1e-5));
+
+    OE_NOTICE << "normals: per-post=" << (unsigned)((double)(dim*dim*passes) / perSample) << " posts/s"
+        << " rows=" << (unsigned)((double)(dim*dim*passes) / rows) << " posts/s" << std::endl;
+}
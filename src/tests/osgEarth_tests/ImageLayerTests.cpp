@@ -24,6 +24,8 @@
 
 #include <osgEarth/ImageLayer>
 #include <osgEarth/Registry>
+#include <osgEarth/ImageUtils>
+#include <osg/Timer>
 
 #include <osgEarthDrivers/gdal/GDALOptions>
 
@@ -72,4 +74,158 @@ TEST_CASE("Attribution works") {
     Status status = layer->open();
     REQUIRE(status.isOK());
     REQUIRE(layer->getAttribution() == attribution);
-}
\ No newline at end of file
+}
+TEST_CASE("GDAL thread_safe_reads returns the same data as serialized reads") {
+
+    GDALOptions serialOpt;
+    serialOpt.url() = "../data/world.tif";
+    osg::ref_ptr< ImageLayer > serial = new ImageLayer( ImageLayerOptions("serial", serialOpt) );
+    REQUIRE(serial->open().isOK());
+
+    GDALOptions concurrentOpt = serialOpt;
+    concurrentOpt.threadSafeReads() = true;
+    osg::ref_ptr< ImageLayer > concurrent = new ImageLayer( ImageLayerOptions("concurrent", concurrentOpt) );
+    REQUIRE(concurrent->open().isOK());
+
+    TileKey key(1, 1, 0, serial->getProfile());
+    GeoImage a = serial->createImage( key );
+    GeoImage b = concurrent->createImage( key );
+    REQUIRE(a.valid());
+    REQUIRE(b.valid());
+    REQUIRE(ImageUtils::areEquivalent(a.getImage(), b.getImage()));
+}
+
+TEST_CASE("GDAL reads the four children of a key in one request") {
+
+    GDALOptions opt;
+    opt.url() = "../data/world.tif";
+    osg::ref_ptr< ImageLayer > layer = new ImageLayer( ImageLayerOptions("world", opt) );
+    REQUIRE(layer->open().isOK());
+
+    TileKey parent(1, 1, 0, layer->getProfile());
+
+    SECTION("Each child matches a read of its own key") {
+        osg::ref_ptr<osg::Image> images[4];
+        REQUIRE(layer->getTileSource()->createChildImages(parent, images));
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            REQUIRE(images[q].valid());
+            osg::ref_ptr<osg::Image> single = layer->getTileSource()->createImage(parent.createChildKey(q), 0L, 0L);
+            REQUIRE(single.valid());
+            REQUIRE(ImageUtils::areEquivalent(images[q].get(), single.get()));
+        }
+    }
+
+    SECTION("Children match single reads for every sampling mode and window alignment") {
+        // Only nearest sampling on pixel-aligned windows may split one read;
+        // the resampling kernels, and windows that don't halve evenly at the
+        // deeper levels, have to read each child on its own.
+        const ElevationInterpolation modes[3] = { INTERP_NEAREST, INTERP_BILINEAR, INTERP_AVERAGE };
+        for (unsigned m = 0; m < 3; ++m)
+        {
+            GDALOptions modeOpt = opt;
+            modeOpt.interpolation() = modes[m];
+            osg::ref_ptr< ImageLayer > modeLayer = new ImageLayer( ImageLayerOptions("mode", modeOpt) );
+            REQUIRE(modeLayer->open().isOK());
+            TileSource* source = modeLayer->getTileSource();
+
+            const TileKey keys[3] = {
+                TileKey(1, 1, 0, modeLayer->getProfile()),
+                TileKey(3, 5, 2, modeLayer->getProfile()),
+                TileKey(5, 37, 11, modeLayer->getProfile()) };
+
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                osg::ref_ptr<osg::Image> images[4];
+                if (!source->createChildImages(keys[k], images))
+                    continue;
+
+                for (unsigned q = 0; q < 4; ++q)
+                {
+                    osg::ref_ptr<osg::Image> single = source->createImage(keys[k].createChildKey(q), 0L, 0L);
+                    REQUIRE(images[q].valid() == single.valid());
+                    if (single.valid())
+                        REQUIRE(ImageUtils::areEquivalent(images[q].get(), single.get()));
+                }
+            }
+        }
+    }
+
+    SECTION("The layer serves prefetched children through createImage") {
+        // a second layer reads each child on its own, for comparison:
+        osg::ref_ptr< ImageLayer > reference = new ImageLayer( ImageLayerOptions("reference", opt) );
+        REQUIRE(reference->open().isOK());
+
+        REQUIRE(layer->prefetchChildImages(parent, 0L));
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            TileKey child = parent.createChildKey(q);
+            GeoImage image = layer->createImage(child);
+            REQUIRE(image.valid());
+            REQUIRE(image.getExtent() == child.getExtent());
+
+            GeoImage expected = reference->createImage(child);
+            REQUIRE(expected.valid());
+            REQUIRE(ImageUtils::areEquivalent(image.getImage(), expected.getImage()));
+        }
+    }
+}
+
+namespace GDALReadBenchmark
+{
+    // Reads every tile at one LOD from a layer, over and over.
+    struct Reader : public OpenThreads::Thread
+    {
+        Reader(ImageLayer* layer, unsigned lod, unsigned passes) : _layer(layer), _lod(lod), _passes(passes) { }
+        void run()
+        {
+            unsigned wide, high;
+            _layer->getProfile()->getNumTiles(_lod, wide, high);
+            for (unsigned p = 0; p < _passes; ++p)
+                for (unsigned y = 0; y < high; ++y)
+                    for (unsigned x = 0; x < wide; ++x)
+                    {
+                        osg::ref_ptr<osg::Image> image = _layer->getTileSource()->createImage(
+                            TileKey(_lod, x, y, _layer->getProfile()), 0L, 0L);
+                    }
+        }
+        ImageLayer* _layer;
+        unsigned _lod, _passes;
+    };
+
+    double run(bool threadSafeReads, unsigned numThreads)
+    {
+        GDALOptions opt;
+        opt.url() = "../data/world.tif";
+        opt.threadSafeReads() = threadSafeReads;
+        osg::ref_ptr< ImageLayer > layer = new ImageLayer( ImageLayerOptions("bench", opt) );
+        layer->open();
+
+        std::vector<Reader*> readers;
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            readers.push_back(new Reader(layer.get(), 3u, 2u));
+            readers.back()->start();
+        }
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            readers[i]->join();
+            delete readers[i];
+        }
+        return osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    }
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE("GDAL concurrent read throughput", "[.][benchmark]") {
+
+    for (unsigned numThreads = 1; numThreads <= 16; numThreads *= 2)
+    {
+        double serial = GDALReadBenchmark::run(false, numThreads);
+        double concurrent = GDALReadBenchmark::run(true, numThreads);
+        OE_NOTICE << "threads=" << numThreads
+            << " serialized=" << serial << "s"
+            << " thread_safe_reads=" << concurrent << "s" << std::endl;
+    }
+}
@@ -0,0 +1,149 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/ScriptFilter>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/Feature>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Features;
+
+namespace
+{
+    FeatureList makeFeatures(unsigned count)
+    {
+        osg::ref_ptr<const SpatialReference> wgs84 = SpatialReference::create("wgs84");
+        FeatureList features;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            Feature* feature = new Feature(new Geometry(), wgs84.get());
+            feature->set("height", (double)(i * 10));
+            features.push_back(feature);
+        }
+        return features;
+    }
+}
+
+TEST_CASE( "JavaScript engine reuses compiled snippets" ) {
+
+    osg::ref_ptr<ScriptEngine> engine = ScriptEngineFactory::create("javascript");
+    REQUIRE(engine.valid());
+
+    FeatureList features = makeFeatures(3);
+    const std::string code = "feature.properties.height + 1";
+
+    SECTION("Each call sees its own feature") {
+        // the first call compiles; the rest run the cached function.
+        for (unsigned round = 0; round < 2; ++round)
+        {
+            for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+            {
+                ScriptResult result = engine->run(code, i->get());
+                REQUIRE(result.success());
+                REQUIRE(result.asDouble() == i->get()->getDouble("height") + 1.0);
+            }
+        }
+    }
+
+    SECTION("A snippet that fails to compile keeps failing") {
+        REQUIRE_FALSE(engine->run("feature.properties.height +", features.front().get()).success());
+        REQUIRE_FALSE(engine->run("feature.properties.height +", features.front().get()).success());
+    }
+
+    SECTION("A call without a feature does not see the previous one") {
+        REQUIRE(engine->run("typeof feature", features.front().get()).asString() == "object");
+        REQUIRE(engine->run("typeof feature").asString() == "undefined");
+    }
+}
+
+TEST_CASE( "JavaScript runBatch matches run for each feature" ) {
+
+    osg::ref_ptr<ScriptEngine> engine = ScriptEngineFactory::create("javascript");
+    REQUIRE(engine.valid());
+
+    FeatureList features = makeFeatures(4);
+    features.push_back(0L);
+
+    const std::string code = "feature.properties.height > 15";
+
+    std::vector<ScriptResult> results;
+    engine->runBatch(code, features, results);
+    REQUIRE(results.size() == features.size());
+
+    unsigned r = 0;
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++r)
+    {
+        ScriptResult single = engine->run(code, i->get());
+        REQUIRE(results[r].success() == single.success());
+        REQUIRE(results[r].asString() == single.asString());
+    }
+
+    // the NULL feature has no "feature" to read:
+    REQUIRE_FALSE(results.back().success());
+}
+
+TEST_CASE( "JavaScript sees only the set fields of a packed feature" ) {
+
+    osg::ref_ptr<ScriptEngine> engine = ScriptEngineFactory::create("javascript");
+    REQUIRE(engine.valid());
+
+    FeatureList features = makeFeatures(2);
+
+    FeatureSchema schema;
+    schema["height"] = ATTRTYPE_DOUBLE;
+    schema["roof"] = ATTRTYPE_BOOL;
+    osg::ref_ptr<AttributeColumns> columns = AttributeColumns::pack(features, schema);
+
+    Feature* feature = features.back().get();
+    REQUIRE(engine->run("feature.properties.height", feature).asDouble() == 10.0);
+    REQUIRE(engine->run("typeof feature.properties.roof", feature).asString() == "undefined");
+
+    feature->set("roof", true);
+    REQUIRE(engine->run("feature.properties.roof", feature).asBool() == true);
+}
+
+TEST_CASE( "ScriptFilter drops features without geometry" ) {
+
+    FeatureList features = makeFeatures(4);
+    features.push_back(0L);
+
+    // would pass the expression, but has no geometry:
+    Feature* empty = new Feature((Geometry*)0L, SpatialReference::create("wgs84"));
+    empty->set("height", 100.0);
+    features.push_back(empty);
+
+    ScriptFilter filter;
+    filter.expression() = std::string("feature.properties.height > 15");
+
+    FilterContext context;
+    filter.push(features, context);
+
+    REQUIRE(features.size() == 2u);
+    for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        REQUIRE(i->valid());
+        REQUIRE(i->get()->getDouble("height") > 15.0);
+    }
+}
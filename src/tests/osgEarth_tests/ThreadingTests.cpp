@@ -22,6 +22,8 @@
 
 #include <osgEarth/catch.hpp>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/TaskService>
+#include <osg/Timer>
 
 using namespace osgEarth;
 
@@ -132,4 +134,192 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+
+namespace TaskServiceTest
+{
+    // Trivial task that just counts how many times it ran.
+    struct CountingTask : public osgEarth::TaskRequest
+    {
+        CountingTask(OpenThreads::Atomic& counter, float priority) :
+            osgEarth::TaskRequest(priority), _counter(counter) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            ++_counter;
+        }
+
+        OpenThreads::Atomic& _counter;
+    };
+
+    // Progress callback that counts down an event when its request completes.
+    struct CompletionProgress : public ProgressCallback
+    {
+        CompletionProgress(Threading::MultiEvent& done) : _done(done) { }
+        void onCompleted() { _done.set(); }
+        Threading::MultiEvent& _done;
+    };
+
+    // The pre-sharding queue design (one mutex around a priority multimap),
+    // kept here only as a baseline for the throughput benchmark.
+    struct SingleLockQueue
+    {
+        TaskRequestPriorityMap _requests;
+        OpenThreads::Mutex _mutex;
+
+        void add(TaskRequest* r) {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _requests.insert(std::make_pair(r->getPriority(), osg::ref_ptr<TaskRequest>(r)));
+        }
+
+        TaskRequest* get() {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            if (_requests.empty()) return 0L;
+            osg::ref_ptr<TaskRequest> r = _requests.begin()->second.get();
+            _requests.erase(_requests.begin());
+            return r.release();
+        }
+    };
+
+    // Worker that drains a fixed number of requests from a queue.
+    template<typename QUEUE>
+    struct Drainer : public OpenThreads::Thread
+    {
+        Drainer(QUEUE* q, unsigned home, unsigned count) : _q(q), _home(home), _count(count) { }
+        void run();
+        QUEUE* _q;
+        unsigned _home, _count;
+    };
+
+    template<> void Drainer<TaskRequestQueue>::run()
+    {
+        for (unsigned i = 0; i < _count; ++i)
+        {
+            osg::ref_ptr<TaskRequest> r = _q->get(_home);
+            if (r.valid()) { r->setState(TaskRequest::STATE_IN_PROGRESS); r->run(); }
+        }
+    }
+
+    template<> void Drainer<SingleLockQueue>::run()
+    {
+        for (unsigned i = 0; i < _count; )
+        {
+            osg::ref_ptr<TaskRequest> r = _q->get();
+            if (r.valid()) { r->setState(TaskRequest::STATE_IN_PROGRESS); r->run(); ++i; }
+            else OpenThreads::Thread::YieldCurrentThread();
+        }
+    }
+
+    // Runs "numThreads" producers/consumers over "numTasks" requests and
+    // returns the elapsed time in seconds.
+    template<typename QUEUE>
+    double run(QUEUE* queue, unsigned numThreads, unsigned numTasks, OpenThreads::Atomic& counter)
+    {
+        unsigned perThread = numTasks / numThreads;
+        std::vector<Drainer<QUEUE>*> threads;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for (unsigned t = 0; t < numThreads; ++t)
+        {
+            threads.push_back(new Drainer<QUEUE>(queue, t, perThread));
+            threads.back()->start();
+        }
+
+        for (unsigned i = 0; i < perThread*numThreads; ++i)
+        {
+            queue->add(new CountingTask(counter, (float)(i % 16)));
+        }
+
+        for (unsigned t = 0; t < numThreads; ++t)
+        {
+            threads[t]->join();
+            delete threads[t];
+        }
+
+        return osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    }
+}
+
+TEST_CASE( "TaskService runs every request" ) {
+
+    OpenThreads::Atomic counter;
+    const unsigned numTasks = 1000;
+    {
+        osg::ref_ptr<TaskService> service = new TaskService("test", 4);
+        for (unsigned i = 0; i < numTasks; ++i)
+            service->add(new TaskServiceTest::CountingTask(counter, (float)(i % 7)));
+
+        while (service->getNumRequests() > 0 || (unsigned)counter < numTasks)
+            OpenThreads::Thread::microSleep(1000);
+    }
+
+    REQUIRE((unsigned)counter == numTasks);
+}
+
+TEST_CASE( "TaskRequestQueue completes the requests it drops" ) {
+
+    OpenThreads::Atomic counter;
+    const unsigned numTasks = 100;
+    Threading::MultiEvent done(numTasks);
+
+    // no threads service this queue, so nothing runs:
+    osg::ref_ptr<TaskRequestQueue> queue = new TaskRequestQueue();
+    std::vector< osg::ref_ptr<TaskRequest> > requests;
+    for (unsigned i = 0; i < numTasks; ++i)
+    {
+        requests.push_back(new TaskServiceTest::CountingTask(counter, 0.0f));
+        requests.back()->setProgressCallback(new TaskServiceTest::CompletionProgress(done));
+    }
+
+    SECTION("on cancel") {
+        for (unsigned i = 0; i < numTasks; ++i)
+            queue->add(requests[i].get());
+        queue->cancel();
+    }
+
+    SECTION("on clear") {
+        for (unsigned i = 0; i < numTasks; ++i)
+            queue->add(requests[i].get());
+        queue->clear();
+    }
+
+    SECTION("when added after shutdown") {
+        queue->setDone();
+        for (unsigned i = 0; i < numTasks; ++i)
+            queue->add(requests[i].get());
+    }
+
+    // would block forever if a request were dropped silently:
+    REQUIRE(done.wait());
+    REQUIRE(queue->getNumRequests() == 0u);
+    REQUIRE((unsigned)counter == 0u);
+    for (unsigned i = 0; i < numTasks; ++i)
+    {
+        REQUIRE(requests[i]->isCompleted());
+        REQUIRE(requests[i]->wasCanceled());
+    }
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "TaskRequestQueue throughput", "[.][benchmark]" ) {
+
+    const unsigned numTasks = 200000;
+    for (unsigned numThreads = 1; numThreads <= 32; numThreads *= 2)
+    {
+        OpenThreads::Atomic c1, c2;
+
+        osg::ref_ptr<TaskRequestQueue> sharded = new TaskRequestQueue(0, numThreads);
+        double t1 = TaskServiceTest::run(sharded.get(), numThreads, numTasks, c1);
+
+        TaskServiceTest::SingleLockQueue single;
+        double t2 = TaskServiceTest::run(&single, numThreads, numTasks, c2);
+
+        OE_NOTICE << "threads=" << numThreads
+            << " sharded=" << (unsigned)((double)(unsigned)c1 / t1) << " tasks/s"
+            << " single-lock=" << (unsigned)((double)(unsigned)c2 / t2) << " tasks/s"
+            << std::endl;
+
+        REQUIRE((unsigned)c1 == (unsigned)c2);
+    }
+}
@@ -0,0 +1,251 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2019 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/TileKeyHashMap>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Registry>
+#include <osg/Timer>
+#include <map>
+
+using namespace osgEarth;
+
+namespace TileKeyHashMapTest
+{
+    // all the keys of LODs [0..maxLOD] in the profile, coarsest first.
+    void collectKeys(const Profile* profile, unsigned maxLOD, std::vector<TileKey>& keys)
+    {
+        for (unsigned lod = 0; lod <= maxLOD; ++lod)
+        {
+            std::vector<TileKey> level;
+            profile->getAllKeysAtLOD(lod, level);
+            keys.insert(keys.end(), level.begin(), level.end());
+        }
+    }
+
+    // The pre-sharding registry design (one lock around a std::map),
+    // kept here only as a baseline for the lookup benchmark.
+    struct SingleLockMap
+    {
+        std::map<TileKey, int> _table;
+        mutable Threading::ReadWriteMutex _mutex;
+
+        void insert(const TileKey& key, int value) {
+            Threading::ScopedWriteLock lock(_mutex);
+            _table[key] = value;
+        }
+
+        bool get(const TileKey& key, int& out) const {
+            Threading::ScopedReadLock lock(_mutex);
+            std::map<TileKey, int>::const_iterator i = _table.find(key);
+            if (i == _table.end()) return false;
+            out = i->second;
+            return true;
+        }
+    };
+
+    // Hash maps spread over shards, each with its own lock, the way
+    // the REX TileNodeRegistry stores its tiles.
+    struct ShardedMap
+    {
+        enum { NUM_SHARDS = 16 };
+
+        struct Shard {
+            TileKeyHashMap<int> _table;
+            mutable Threading::ReadWriteMutex _mutex;
+        };
+        Shard _shards[NUM_SHARDS];
+
+        const Shard& shard(const TileKey& key) const {
+            return _shards[TileKeyHashMap<int>::shard(key, NUM_SHARDS)];
+        }
+
+        void insert(const TileKey& key, int value) {
+            Shard& s = const_cast<Shard&>(shard(key));
+            Threading::ScopedWriteLock lock(s._mutex);
+            s._table[key] = value;
+        }
+
+        bool get(const TileKey& key, int& out) const {
+            const Shard& s = shard(key);
+            Threading::ScopedReadLock lock(s._mutex);
+            const int* value = s._table.find(key);
+            if (!value) return false;
+            out = *value;
+            return true;
+        }
+    };
+
+    // Thread that looks up every key "passes" times, starting at a
+    // different offset than its peers.
+    template<typename MAP>
+    struct Reader : public OpenThreads::Thread
+    {
+        Reader(const MAP* m, const std::vector<TileKey>* keys, unsigned offset, unsigned passes) :
+            _m(m), _keys(keys), _offset(offset), _passes(passes), _found(0u) { }
+
+        void run()
+        {
+            unsigned n = _keys->size();
+            int value;
+            for (unsigned p = 0; p < _passes; ++p)
+                for (unsigned i = 0; i < n; ++i)
+                    if (_m->get((*_keys)[(i + _offset) % n], value))
+                        ++_found;
+        }
+
+        const MAP* _m;
+        const std::vector<TileKey>* _keys;
+        unsigned _offset, _passes, _found;
+    };
+
+    // Runs "numThreads" readers against the map and returns the elapsed
+    // time in seconds.
+    template<typename MAP>
+    double run(const MAP* m, const std::vector<TileKey>& keys, unsigned numThreads, unsigned passes, unsigned& found)
+    {
+        std::vector<Reader<MAP>*> threads;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for (unsigned t = 0; t < numThreads; ++t)
+        {
+            threads.push_back(new Reader<MAP>(m, &keys, t * (keys.size() / numThreads), passes));
+            threads.back()->start();
+        }
+
+        found = 0u;
+        for (unsigned t = 0; t < numThreads; ++t)
+        {
+            threads[t]->join();
+            found += threads[t]->_found;
+            delete threads[t];
+        }
+
+        return osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    }
+}
+
+TEST_CASE( "TileKeyHashMap" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    std::vector<TileKey> keys;
+    TileKeyHashMapTest::collectKeys(profile, 6, keys);
+
+    TileKeyHashMap<unsigned> m;
+    for (unsigned i = 0; i < keys.size(); ++i)
+        m[keys[i]] = i;
+
+    SECTION("Finds every inserted key") {
+        REQUIRE(m.size() == keys.size());
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            REQUIRE(m.find(keys[i]) != 0L);
+            REQUIRE(*m.find(keys[i]) == i);
+        }
+        REQUIRE(m.find(TileKey(7, 0, 0, profile)) == 0L);
+    }
+
+    SECTION("Erase keeps the rest of the map intact") {
+        // erase every third key
+        for (unsigned i = 0; i < keys.size(); i += 3)
+            REQUIRE(m.erase(keys[i]));
+
+        REQUIRE(!m.erase(keys[0]));
+
+        for (unsigned i = 0; i < keys.size(); ++i)
+        {
+            if (i % 3 == 0)
+                REQUIRE(m.find(keys[i]) == 0L);
+            else
+                REQUIRE(*m.find(keys[i]) == i);
+        }
+
+        // the dense array still holds exactly the remaining values
+        unsigned count = 0u;
+        for (unsigned i = 0; i < m.size(); ++i)
+        {
+            REQUIRE(m.at(i).second % 3 != 0);
+            REQUIRE(keys[m.at(i).second] == m.at(i).first);
+            ++count;
+        }
+        REQUIRE(count == keys.size() - (keys.size() + 2) / 3);
+    }
+
+    SECTION("Shards split the keys evenly") {
+        const unsigned numShards = 16;
+        unsigned counts[numShards] = { 0 };
+        for (unsigned i = 0; i < keys.size(); ++i)
+            counts[TileKeyHashMap<unsigned>::shard(keys[i], numShards)]++;
+
+        // within 20% of an even split
+        unsigned even = keys.size() / numShards;
+        for (unsigned s = 0; s < numShards; ++s)
+        {
+            REQUIRE(counts[s] > even * 8 / 10);
+            REQUIRE(counts[s] < even * 12 / 10);
+        }
+    }
+
+    SECTION("Clear empties the map") {
+        m.clear();
+        REQUIRE(m.empty());
+        REQUIRE(m.find(keys[0]) == 0L);
+        m[keys[0]] = 42u;
+        REQUIRE(*m.find(keys[0]) == 42u);
+    }
+}
+
+// Hidden by default; run with: osgEarth_tests "[benchmark]"
+TEST_CASE( "TileKeyHashMap sharded lookup throughput", "[.][benchmark]" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    std::vector<TileKey> keys;
+    TileKeyHashMapTest::collectKeys(profile, 7, keys);
+
+    TileKeyHashMapTest::SingleLockMap single;
+    TileKeyHashMapTest::ShardedMap sharded;
+    for (unsigned i = 0; i < keys.size(); ++i)
+    {
+        single.insert(keys[i], (int)i);
+        sharded.insert(keys[i], (int)i);
+    }
+
+    const unsigned passes = 4;
+    for (unsigned numThreads = 1; numThreads <= 16; numThreads *= 2)
+    {
+        unsigned f1, f2;
+        double t1 = TileKeyHashMapTest::run(&sharded, keys, numThreads, passes, f1);
+        double t2 = TileKeyHashMapTest::run(&single, keys, numThreads, passes, f2);
+
+        OE_NOTICE << "threads=" << numThreads
+            << " sharded=" << (unsigned)((double)f1 / t1) << " lookups/s"
+            << " single-lock=" << (unsigned)((double)f2 / t2) << " lookups/s"
+            << std::endl;
+
+        REQUIRE(f1 == f2);
+        REQUIRE(f1 == keys.size() * numThreads * passes);
+    }
+}